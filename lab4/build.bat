@@ -7,7 +7,7 @@ if not exist out\tokens mkdir out\tokens
 if not exist out\stem_tokens mkdir out\stem_tokens
 
 g++ -O2 -std=c++17 -Wall -Wextra ^
-  src\main.cpp src\utf8.cpp src\win_files.cpp src\tokenize.cpp src\stem_ru.cpp ^
+  src\main.cpp src\utf8.cpp src\win_files.cpp src\tokenize.cpp src\stem_ru.cpp src\stem_ru_snowball.cpp src\stem_cache.cpp src\token_writer.cpp src\term_ids.cpp src\file_reader.cpp src\file_scan.cpp ^
   -o bin\tokenize.exe
 
 if errorlevel 1 (
@@ -15,5 +15,14 @@ if errorlevel 1 (
   exit /b 1
 )
 
-echo Build OK: bin\tokenize.exe
+g++ -O2 -std=c++17 -Wall -Wextra ^
+  src\bench_stem.cpp src\stem_ru.cpp src\stem_ru_snowball.cpp src\stem_cache.cpp ^
+  -o bin\bench_stem.exe
+
+if errorlevel 1 (
+  echo Build failed.
+  exit /b 1
+)
+
+echo Build OK: bin\tokenize.exe bin\bench_stem.exe
 endlocal
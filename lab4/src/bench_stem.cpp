@@ -0,0 +1,157 @@
+#include "stem_ru.h"
+#include "stem_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+struct TokList {
+    unsigned char* bytes;
+    size_t len;
+    size_t cap;
+    uint32_t* offs;
+    size_t n;
+    size_t offs_cap;
+};
+
+static bool tl_add_file(TokList* tl, const char* path) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+
+    unsigned char tmp[1 << 16];
+    size_t start = tl->len;
+    size_t rd;
+    while ((rd = std::fread(tmp, 1, sizeof(tmp), f)) > 0) {
+        if (tl->len + rd > tl->cap) {
+            size_t nc = (tl->cap == 0 ? (1u << 20) : tl->cap);
+            while (nc < tl->len + rd) nc *= 2;
+            unsigned char* nb = (unsigned char*)std::realloc(tl->bytes, nc);
+            if (!nb) { std::fclose(f); return false; }
+            tl->bytes = nb;
+            tl->cap = nc;
+        }
+        std::memcpy(tl->bytes + tl->len, tmp, rd);
+        tl->len += rd;
+    }
+    std::fclose(f);
+
+    for (size_t i = start; i < tl->len; ++i) {
+        if (tl->bytes[i] != '\n' && tl->bytes[i] != '\r') continue;
+        tl->bytes[i] = 0;
+    }
+    size_t i = start;
+    while (i < tl->len) {
+        if (tl->bytes[i] == 0) { i++; continue; }
+        if (tl->n == tl->offs_cap) {
+            size_t nc = (tl->offs_cap == 0 ? 65536 : tl->offs_cap * 2);
+            uint32_t* no = (uint32_t*)std::realloc(tl->offs, nc * sizeof(uint32_t));
+            if (!no) return false;
+            tl->offs = no;
+            tl->offs_cap = nc;
+        }
+        tl->offs[tl->n++] = (uint32_t)i;
+        while (i < tl->len && tl->bytes[i] != 0) i++;
+    }
+    return true;
+}
+
+static double run_once(const TokList* tl, StemMode mode, bool cached, unsigned long long* out_bytes) {
+    unsigned char tok[256];
+    unsigned long long sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < tl->n; ++k) {
+        const unsigned char* s = tl->bytes + tl->offs[k];
+        size_t L = std::strlen((const char*)s);
+        if (L > sizeof(tok)) L = sizeof(tok);
+        std::memcpy(tok, s, L);
+        if (cached) stem_apply_cached(mode, tok, &L);
+        else stem_apply(mode, tok, &L);
+        sum += L;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    *out_bytes = sum;
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+static void usage() {
+    std::fprintf(stderr,
+        "Usage:\n"
+        "  bench_stem.exe [--reps N] <tokens_file> [<tokens_file> ...]\n"
+        "Runs each stemmer N times (default 5) and reports the best pass.\n"
+        "Token files hold one unstemmed token per line (tokenize.exe output).\n");
+}
+
+int main(int argc, char** argv) {
+    int reps = 5;
+    TokList tl;
+    std::memset(&tl, 0, sizeof(tl));
+
+    int files = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = std::atoi(argv[++i]);
+            if (reps < 1) reps = 1;
+            continue;
+        }
+        if (!tl_add_file(&tl, argv[i])) {
+            std::fprintf(stderr, "cannot read: %s\n", argv[i]);
+            return 1;
+        }
+        files++;
+    }
+    if (files == 0 || tl.n == 0) { usage(); return 2; }
+
+    // Passes alternate between the stemmers and the best pass of each is kept,
+    // so a noisy neighbour does not decide the verdict.
+    unsigned long long b_simple = 0, b_snow = 0;
+    run_once(&tl, STEM_SIMPLE, false, &b_simple);
+    double s_simple = 0.0, s_snow = 0.0;
+    for (int r = 0; r < reps; ++r) {
+        double a = run_once(&tl, STEM_SIMPLE, false, &b_simple);
+        double b = run_once(&tl, STEM_SNOWBALL, false, &b_snow);
+        if (r == 0 || a < s_simple) s_simple = a;
+        if (r == 0 || b < s_snow) s_snow = b;
+    }
+
+    // Cached passes run per mode, since switching modes resets the cache;
+    // the first (cold) pass of each is included in the best-of-N.
+    unsigned long long bc_simple = 0, bc_snow = 0;
+    double c_simple = 0.0, c_snow = 0.0;
+    for (int r = 0; r < reps; ++r) {
+        double a = run_once(&tl, STEM_SIMPLE, true, &bc_simple);
+        if (r == 0 || a < c_simple) c_simple = a;
+    }
+    StemCacheStats cs_simple;
+    stem_cache_stats(&cs_simple);
+    for (int r = 0; r < reps; ++r) {
+        double b = run_once(&tl, STEM_SNOWBALL, true, &bc_snow);
+        if (r == 0 || b < c_snow) c_snow = b;
+    }
+    StemCacheStats cs_all;
+    stem_cache_stats(&cs_all);
+    unsigned long long lookups = cs_all.lookups - cs_simple.lookups;
+    unsigned long long hits = cs_all.hits - cs_simple.hits;
+
+    double total = (double)tl.n;
+    double tps_simple = (s_simple > 0.0 ? total / s_simple : 0.0);
+    double tps_snow = (s_snow > 0.0 ? total / s_snow : 0.0);
+    double ratio = (tps_snow > 0.0 ? tps_simple / tps_snow : 0.0);
+
+    std::fprintf(stderr, "tokens=%llu reps=%d\n", (unsigned long long)tl.n, reps);
+    std::fprintf(stderr, "simple:   %.4f s  %.0f tokens/s  stem_bytes=%llu\n", s_simple, tps_simple, b_simple);
+    std::fprintf(stderr, "snowball: %.4f s  %.0f tokens/s  stem_bytes=%llu\n", s_snow, tps_snow, b_snow);
+    std::fprintf(stderr, "slowdown: %.2fx (limit 1.50x) %s\n", ratio, ratio <= 1.5 ? "OK" : "FAIL");
+    std::fprintf(stderr, "simple+cache:   %.4f s  %.0f tokens/s  speedup=%.2fx%s\n",
+                 c_simple, (c_simple > 0.0 ? total / c_simple : 0.0),
+                 (c_simple > 0.0 ? s_simple / c_simple : 0.0), bc_simple == b_simple ? "" : "  MISMATCH");
+    std::fprintf(stderr, "snowball+cache: %.4f s  %.0f tokens/s  speedup=%.2fx%s\n",
+                 c_snow, (c_snow > 0.0 ? total / c_snow : 0.0),
+                 (c_snow > 0.0 ? s_snow / c_snow : 0.0), bc_snow == b_snow ? "" : "  MISMATCH");
+    std::fprintf(stderr, "stem cache (snowball): lookups=%llu hits=%llu hit_rate=%.2f%%\n",
+                 lookups, hits, (lookups > 0 ? 100.0 * (double)hits / (double)lookups : 0.0));
+
+    std::free(tl.bytes);
+    std::free(tl.offs);
+    if (bc_simple != b_simple || bc_snow != b_snow) return 1;
+    return (ratio <= 1.5 ? 0 : 1);
+}
@@ -0,0 +1,203 @@
+#include "file_reader.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct ReadSlot {
+    ReadItem item;
+    bool ready;
+};
+
+struct FileReader {
+    const char* const* paths;
+    size_t count;
+    size_t depth;
+    size_t max_bytes;
+
+    ReadSlot* slots;
+    size_t next_index;
+    size_t consumed;
+    bool stopping;
+
+    std::mutex mu;
+    std::condition_variable can_read;
+    std::condition_variable can_take;
+
+    std::thread* workers;
+    size_t nworkers;
+};
+
+// The size comes from the open handle, so a file over max_bytes is
+// flagged without reading it and any other file is read into one buffer of
+// exactly its size (plus a terminating zero).
+#ifdef _WIN32
+
+static bool read_whole(const char* path, size_t max_bytes, ReadItem* it) {
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(h, &sz)) { CloseHandle(h); return false; }
+    if ((uint64_t)sz.QuadPart > max_bytes) {
+        CloseHandle(h);
+        it->large = true;
+        return true;
+    }
+
+    size_t size = (size_t)sz.QuadPart;
+    unsigned char* b = (unsigned char*)std::malloc(size + 1);
+    if (!b) { CloseHandle(h); return false; }
+    size_t n = 0;
+    bool ok = true;
+    while (n < size) {
+        size_t want = size - n;
+        DWORD chunk = (DWORD)(want < ((size_t)1 << 30) ? want : ((size_t)1 << 30));
+        DWORD rd = 0;
+        if (!ReadFile(h, b + n, chunk, &rd, nullptr)) { ok = false; break; }
+        if (rd == 0) break;
+        n += rd;
+    }
+    CloseHandle(h);
+
+    if (!ok) {
+        std::free(b);
+        return false;
+    }
+    b[n] = 0;
+    it->buf = b;
+    it->n = n;
+    return true;
+}
+
+#else
+
+static bool read_whole(const char* path, size_t max_bytes, ReadItem* it) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return false; }
+    if ((uint64_t)st.st_size > max_bytes) {
+        close(fd);
+        it->large = true;
+        return true;
+    }
+
+    size_t size = (size_t)st.st_size;
+    unsigned char* b = (unsigned char*)std::malloc(size + 1);
+    if (!b) { close(fd); return false; }
+    size_t n = 0;
+    bool ok = true;
+    while (n < size) {
+        ssize_t rd = read(fd, b + n, size - n);
+        if (rd < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (rd == 0) break;
+        n += (size_t)rd;
+    }
+    close(fd);
+
+    if (!ok) {
+        std::free(b);
+        return false;
+    }
+    b[n] = 0;
+    it->buf = b;
+    it->n = n;
+    return true;
+}
+
+#endif
+
+static void worker(FileReader* r) {
+    for (;;) {
+        size_t idx;
+        {
+            std::unique_lock<std::mutex> lk(r->mu);
+            r->can_read.wait(lk, [&] {
+                return r->stopping || r->next_index >= r->count || r->next_index < r->consumed + r->depth;
+            });
+            if (r->stopping || r->next_index >= r->count) return;
+            idx = r->next_index++;
+        }
+
+        ReadItem it;
+        std::memset(&it, 0, sizeof(it));
+        it.index = idx;
+        it.ok = read_whole(r->paths[idx], r->max_bytes, &it);
+
+        std::lock_guard<std::mutex> lk(r->mu);
+        ReadSlot* s = &r->slots[idx % r->depth];
+        s->item = it;
+        s->ready = true;
+        r->can_take.notify_all();
+    }
+}
+
+FileReader* file_reader_start(const char* const* paths, size_t count, size_t threads, size_t depth, size_t max_bytes) {
+    if (threads == 0) threads = 1;
+    if (depth < threads) depth = threads;
+
+    FileReader* r = new FileReader();
+    r->paths = paths;
+    r->count = count;
+    r->depth = depth;
+    r->max_bytes = max_bytes;
+    r->next_index = 0;
+    r->consumed = 0;
+    r->stopping = false;
+    r->slots = (ReadSlot*)std::calloc(depth, sizeof(ReadSlot));
+    r->workers = new std::thread[threads];
+    r->nworkers = threads;
+    if (!r->slots) {
+        r->nworkers = 0;
+        file_reader_stop(r);
+        return nullptr;
+    }
+    for (size_t i = 0; i < threads; ++i) r->workers[i] = std::thread(worker, r);
+    return r;
+}
+
+bool file_reader_next(FileReader* r, ReadItem* item) {
+    std::unique_lock<std::mutex> lk(r->mu);
+    if (r->consumed >= r->count) return false;
+    ReadSlot* s = &r->slots[r->consumed % r->depth];
+    r->can_take.wait(lk, [&] { return s->ready; });
+    *item = s->item;
+    s->ready = false;
+    r->consumed++;
+    r->can_read.notify_all();
+    return true;
+}
+
+void file_reader_stop(FileReader* r) {
+    if (!r) return;
+    {
+        std::lock_guard<std::mutex> lk(r->mu);
+        r->stopping = true;
+        r->can_read.notify_all();
+    }
+    for (size_t i = 0; i < r->nworkers; ++i) r->workers[i].join();
+    if (r->slots) {
+        for (size_t i = 0; i < r->depth; ++i) {
+            if (r->slots[i].ready) std::free(r->slots[i].item.buf);
+        }
+    }
+    std::free(r->slots);
+    delete[] r->workers;
+    delete r;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+
+// Reads a list of files on a pool of threads, keeping up to `depth` files
+// in flight, and hands them back in list order. Files larger than
+// max_bytes are not loaded (buf is null, large is set) so the caller can
+// stream them instead.
+struct FileReader;
+
+struct ReadItem {
+    size_t index;
+    unsigned char* buf;
+    size_t n;
+    bool ok;
+    bool large;
+};
+
+static const size_t FILE_READER_MAX_BYTES = (size_t)64 << 20;
+
+FileReader* file_reader_start(const char* const* paths, size_t count, size_t threads, size_t depth, size_t max_bytes);
+
+// Blocks until the next file in order is read; false after the last one.
+// The caller owns item->buf and frees it with std::free.
+bool file_reader_next(FileReader* r, ReadItem* item);
+
+void file_reader_stop(FileReader* r);
@@ -0,0 +1,368 @@
+#include "file_scan.h"
+#include "paths.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+static const size_t ARENA_BLOCK = (size_t)1 << 20;
+static const size_t SCAN_MAX_THREADS = 8;
+
+// Path strings live in per-worker bump blocks that never move, so entries can
+// point into them until the scan is over.
+struct ArenaBlock {
+    ArenaBlock* prev;
+    size_t used;
+    size_t cap;
+};
+
+static char* arena_alloc(ArenaBlock** head, size_t n) {
+    ArenaBlock* b = *head;
+    if (!b || b->used + n > b->cap) {
+        size_t cap = (n > ARENA_BLOCK ? n : ARENA_BLOCK);
+        ArenaBlock* nb = (ArenaBlock*)std::malloc(sizeof(ArenaBlock) + cap);
+        if (!nb) return nullptr;
+        nb->prev = b;
+        nb->used = 0;
+        nb->cap = cap;
+        *head = nb;
+        b = nb;
+    }
+    char* p = (char*)(b + 1) + b->used;
+    b->used += n;
+    return p;
+}
+
+static void arena_free(ArenaBlock* b) {
+    while (b) {
+        ArenaBlock* p = b->prev;
+        std::free(b);
+        b = p;
+    }
+}
+
+// "a" + SEP + "b", or just "b" when a is empty.
+static char* arena_join(ArenaBlock** arena, const char* a, const char* b) {
+    size_t la = std::strlen(a), lb = std::strlen(b);
+    char* p = arena_alloc(arena, la + lb + 2);
+    if (!p) return nullptr;
+    size_t k = 0;
+    if (la) {
+        std::memcpy(p, a, la);
+        p[la] = PATH_SEP;
+        k = la + 1;
+    }
+    std::memcpy(p + k, b, lb + 1);
+    return p;
+}
+
+struct ScanList {
+    ScanEntry* a;
+    size_t n;
+    size_t cap;
+    ArenaBlock* arena;
+};
+
+struct DirTask {
+    const char* full;
+    const char* rel;
+};
+
+struct Scan {
+    const char* ext;
+    bool recursive;
+
+    DirTask* stack;
+    size_t n;
+    size_t cap;
+    size_t busy;
+    bool failed;
+
+    std::mutex mu;
+    std::condition_variable cv;
+};
+
+static bool is_dot_dir(const char* name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+static char lower_ascii(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + 32) : c;
+}
+
+static bool ends_with_ext_ci(const char* s, const char* ext) {
+    size_t n = std::strlen(s), m = std::strlen(ext);
+    if (n < m + 1 || s[n - m - 1] != '.') return false;
+    for (size_t i = 0; i < m; ++i) {
+        if (lower_ascii(s[n - m + i]) != ext[i]) return false;
+    }
+    return true;
+}
+
+static bool scan_push_dir(Scan* s, const char* full, const char* rel) {
+    std::lock_guard<std::mutex> lk(s->mu);
+    if (s->n == s->cap) {
+        size_t nc = (s->cap == 0 ? 256 : s->cap * 2);
+        DirTask* ns = (DirTask*)std::realloc(s->stack, nc * sizeof(DirTask));
+        if (!ns) return false;
+        s->stack = ns;
+        s->cap = nc;
+    }
+    s->stack[s->n++] = {full, rel};
+    s->cv.notify_one();
+    return true;
+}
+
+static bool list_push(ScanList* l, const DirTask* t, const char* name, uint64_t size, uint64_t inode) {
+    if (l->n == l->cap) {
+        size_t nc = (l->cap == 0 ? 1024 : l->cap * 2);
+        ScanEntry* na = (ScanEntry*)std::realloc(l->a, nc * sizeof(ScanEntry));
+        if (!na) return false;
+        l->a = na;
+        l->cap = nc;
+    }
+    const char* full = arena_join(&l->arena, t->full, name);
+    const char* rel = arena_join(&l->arena, t->rel, name);
+    if (!full || !rel) return false;
+    l->a[l->n++] = {full, rel, size, inode};
+    return true;
+}
+
+static bool push_subdir(Scan* s, ScanList* l, const DirTask* t, const char* name) {
+    const char* full = arena_join(&l->arena, t->full, name);
+    const char* rel = arena_join(&l->arena, t->rel, name);
+    if (!full || !rel) return false;
+    return scan_push_dir(s, full, rel);
+}
+
+#ifdef _WIN32
+
+static bool read_dir(Scan* s, ScanList* l, const DirTask* t) {
+    size_t dl = std::strlen(t->full);
+    char* pattern = (char*)std::malloc(dl + 3);
+    if (!pattern) return false;
+    std::memcpy(pattern, t->full, dl);
+    std::memcpy(pattern + dl, "\\*", 3);
+
+    WIN32_FIND_DATAA ffd;
+    HANDLE h = FindFirstFileExA(pattern, FindExInfoBasic, &ffd, FindExSearchNameMatch, nullptr,
+                                FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) {
+        std::fprintf(stderr, "FindFirstFileExA failed for: %s\n", pattern);
+        std::free(pattern);
+        return false;
+    }
+    std::free(pattern);
+
+    bool ok = true;
+    do {
+        const char* name = ffd.cFileName;
+        if (is_dot_dir(name)) continue;
+        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (s->recursive && !push_subdir(s, l, t, name)) { ok = false; break; }
+            continue;
+        }
+        if (!ends_with_ext_ci(name, s->ext)) continue;
+        uint64_t size = ((uint64_t)ffd.nFileSizeHigh << 32) | (uint64_t)ffd.nFileSizeLow;
+        if (!list_push(l, t, name, size, 0)) { ok = false; break; }
+    } while (FindNextFileA(h, &ffd));
+
+    FindClose(h);
+    return ok;
+}
+
+#else
+
+// d_type tells files from directories without a stat call; only matching
+// files (for their size) and DT_UNKNOWN entries need fstatat. Symlinks to
+// matching files are listed like files; linked directories are not entered.
+static bool on_dirent(Scan* s, ScanList* l, const DirTask* t, int dfd,
+                      const char* name, unsigned char type, uint64_t inode) {
+    if (is_dot_dir(name)) return true;
+    bool is_dir = (type == DT_DIR);
+    bool is_reg = (type == DT_REG || type == DT_LNK);
+    bool match = ends_with_ext_ci(name, s->ext);
+    if (type != DT_UNKNOWN && !is_dir && !is_reg) return true;
+    if (is_dir && !s->recursive) return true;
+    if (is_reg && !match) return true;
+
+    uint64_t size = 0;
+    if (type == DT_UNKNOWN || is_reg) {
+        struct stat st;
+        int flags = (type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW);
+        if (fstatat(dfd, name, &st, flags) != 0) return true;
+        if (type == DT_LNK && S_ISDIR(st.st_mode)) return true;
+        is_dir = S_ISDIR(st.st_mode);
+        is_reg = S_ISREG(st.st_mode);
+        size = (uint64_t)st.st_size;
+        inode = (uint64_t)st.st_ino;
+    }
+    if (is_dir) return !s->recursive || push_subdir(s, l, t, name);
+    if (is_reg && match) return list_push(l, t, name, size, inode);
+    return true;
+}
+
+#ifdef __linux__
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+static bool read_dir(Scan* s, ScanList* l, const DirTask* t) {
+    int dfd = open(t->full, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        std::fprintf(stderr, "open failed for: %s\n", t->full);
+        return false;
+    }
+
+    alignas(8) char buf[1 << 15];
+    bool ok = true;
+    while (ok) {
+        long got = syscall(SYS_getdents64, dfd, buf, sizeof(buf));
+        if (got < 0) {
+            std::fprintf(stderr, "getdents64 failed for: %s\n", t->full);
+            ok = false;
+            break;
+        }
+        if (got == 0) break;
+        for (long off = 0; off < got && ok;) {
+            const LinuxDirent64* d = (const LinuxDirent64*)(buf + off);
+            off += d->d_reclen;
+            ok = on_dirent(s, l, t, dfd, d->d_name, d->d_type, d->d_ino);
+        }
+    }
+    close(dfd);
+    return ok;
+}
+
+#else
+
+static bool read_dir(Scan* s, ScanList* l, const DirTask* t) {
+    int dfd = open(t->full, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* d = (dfd >= 0 ? fdopendir(dfd) : nullptr);
+    if (!d) {
+        if (dfd >= 0) close(dfd);
+        std::fprintf(stderr, "opendir failed for: %s\n", t->full);
+        return false;
+    }
+    bool ok = true;
+    while (ok) {
+        struct dirent* e = readdir(d);
+        if (!e) break;
+        ok = on_dirent(s, l, t, dfd, e->d_name, e->d_type, (uint64_t)e->d_ino);
+    }
+    closedir(d);
+    return ok;
+}
+
+#endif
+#endif
+
+static void scan_worker(Scan* s, ScanList* l) {
+    for (;;) {
+        DirTask t;
+        {
+            std::unique_lock<std::mutex> lk(s->mu);
+            s->cv.wait(lk, [&] { return s->n > 0 || s->busy == 0 || s->failed; });
+            if (s->n == 0 || s->failed) {
+                s->cv.notify_all();
+                return;
+            }
+            t = s->stack[--s->n];
+            s->busy++;
+        }
+        bool ok = read_dir(s, l, &t);
+        std::lock_guard<std::mutex> lk(s->mu);
+        s->busy--;
+        if (!ok) s->failed = true;
+        if (s->failed || (s->busy == 0 && s->n == 0)) s->cv.notify_all();
+    }
+}
+
+bool scan_files(const char* root_dir, const char* ext, bool recursive, size_t threads,
+                ScanOrder order, scan_batch_callback_t cb, void* user) {
+    if (!root_dir || !ext || !cb) return false;
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+        if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+    }
+    if (!recursive) threads = 1;
+
+    Scan s;
+    s.ext = ext;
+    s.recursive = recursive;
+    s.stack = nullptr;
+    s.n = 0;
+    s.cap = 0;
+    s.busy = 0;
+    s.failed = false;
+
+    ScanList* lists = (ScanList*)std::calloc(threads, sizeof(ScanList));
+    if (!lists) return false;
+
+    bool ok = scan_push_dir(&s, root_dir, "");
+    if (ok) {
+        std::thread* pool = new std::thread[threads - 1];
+        for (size_t i = 1; i < threads; ++i) pool[i - 1] = std::thread(scan_worker, &s, &lists[i]);
+        scan_worker(&s, &lists[0]);
+        for (size_t i = 1; i < threads; ++i) pool[i - 1].join();
+        delete[] pool;
+        ok = !s.failed;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < threads; ++i) total += lists[i].n;
+    ScanEntry* all = (ok ? (ScanEntry*)std::malloc((total + 1) * sizeof(ScanEntry)) : nullptr);
+    if (all) {
+        size_t k = 0;
+        for (size_t i = 0; i < threads; ++i) {
+            if (lists[i].n) std::memcpy(all + k, lists[i].a, lists[i].n * sizeof(ScanEntry));
+            k += lists[i].n;
+        }
+        if (order == SCAN_BY_INODE) {
+            std::sort(all, all + total, [](const ScanEntry& a, const ScanEntry& b) {
+                if (a.inode != b.inode) return a.inode < b.inode;
+                return std::strcmp(a.rel_path, b.rel_path) < 0;
+            });
+        } else {
+            std::sort(all, all + total, [](const ScanEntry& a, const ScanEntry& b) {
+                return std::strcmp(a.rel_path, b.rel_path) < 0;
+            });
+        }
+        for (size_t i = 0; i < total; i += SCAN_BATCH) {
+            size_t m = (total - i < SCAN_BATCH ? total - i : SCAN_BATCH);
+            if (!cb(all + i, m, user)) break;
+        }
+    } else {
+        ok = false;
+    }
+
+    std::free(all);
+    for (size_t i = 0; i < threads; ++i) {
+        std::free(lists[i].a);
+        arena_free(lists[i].arena);
+    }
+    std::free(lists);
+    std::free(s.stack);
+    return ok;
+}
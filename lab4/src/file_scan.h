@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+struct ScanEntry {
+    const char* full_path;
+    const char* rel_path;
+    uint64_t size;
+    uint64_t inode;
+};
+
+enum ScanOrder {
+    SCAN_BY_INODE,
+    SCAN_BY_PATH
+};
+
+static const size_t SCAN_BATCH = 4096;
+
+// Receives consecutive slices of the sorted result; returning false stops
+// the scan. The strings stay valid only for the duration of the call.
+typedef bool (*scan_batch_callback_t)(const ScanEntry* batch, size_t n, void* user);
+
+// Lists regular files under root_dir whose name ends with "." + ext (ASCII,
+// case-insensitive; ext given in lowercase). With recursive set the
+// subdirectories are walked by `threads` workers (0 = one per core, up to 8).
+// SCAN_BY_INODE sorts by inode, then by relative path; where the platform has
+// no cheap file id (Windows) inode is 0 and this is path order.
+bool scan_files(const char* root_dir, const char* ext, bool recursive, size_t threads,
+                ScanOrder order, scan_batch_callback_t cb, void* user);
@@ -1,18 +1,63 @@
 #include "win_files.h"
 #include "tokenize.h"
+#include "stem_cache.h"
+#include "term_ids.h"
+#include "file_reader.h"
+#include "paths.h"
+#include <cinttypes>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cstdint>
 #include <chrono>
 
+// One row of the previous run's meta TSV, for --incremental.
+struct PrevRow {
+    char* line;
+    char* rel_path;
+    char* tok_file;
+    uint64_t bytes_in;
+    uint64_t mtime;
+    bool has_mtime;
+    bool seen;
+};
+
+struct PrevMeta {
+    char* mode;
+    PrevRow* rows;
+    size_t n;
+    size_t cap;
+    uint32_t* tab;
+    size_t tab_cap;
+};
+
+struct DocEntry {
+    char* full_path;
+    char* rel_path;
+    uint64_t mtime;
+    PrevRow* prev;
+    bool skip;
+};
+
 struct Ctx {
     const char* out_dir;
     FILE* meta;
-    unsigned long long total_docs;
-    unsigned long long total_tokens;
-    unsigned long long total_token_chars;
-    unsigned long long total_bytes;
-    bool do_stem;
+    uint64_t total_docs;
+    uint64_t total_tokens;
+    uint64_t total_token_chars;
+    uint64_t total_bytes;
+    uint64_t total_write_calls;
+    uint64_t total_bytes_out;
+    StemMode stem;
+    TermIds* ids;
+    PrevMeta* prev;
+    uint64_t skipped;
+    uint64_t updated;
+    uint64_t added;
+    DocEntry* docs;
+    size_t docs_n;
+    size_t docs_cap;
+    bool oom;
     std::chrono::steady_clock::time_point t0;
 };
 
@@ -37,23 +82,179 @@ static void hex16(char out[17], uint64_t v) {
     out[16] = 0;
 }
 
-static void join_path(char* out, size_t out_sz, const char* a, const char* b) {
-    std::snprintf(out, out_sz, "%s\\%s", a, b);
+static char* dup_str(const char* s, size_t n) {
+    char* p = (char*)std::malloc(n + 1);
+    if (!p) return nullptr;
+    std::memcpy(p, s, n);
+    p[n] = 0;
+    return p;
+}
+
+static PrevRow* prev_find(const PrevMeta* pm, const char* rel_path) {
+    if (!pm || pm->tab_cap == 0) return nullptr;
+    size_t mask = pm->tab_cap - 1;
+    size_t pos = (size_t)fnv1a64(rel_path) & mask;
+    while (pm->tab[pos]) {
+        PrevRow* r = &pm->rows[pm->tab[pos] - 1];
+        if (std::strcmp(r->rel_path, rel_path) == 0) return r;
+        pos = (pos + 1) & mask;
+    }
+    return nullptr;
+}
+
+// Loads rows "doc_path tok_file tokens chars bytes_in [mtime]" and the
+// "#tokenize ..." mode line before them. A missing file means a first run;
+// rows without mtime (older runs) never match.
+static bool prev_load(PrevMeta* pm, const char* path) {
+    std::memset(pm, 0, sizeof(*pm));
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return true;
+
+    char line[16384];
+    bool ok = true;
+    bool header = true;
+    while (ok && std::fgets(line, sizeof(line), f)) {
+        size_t len = std::strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+        if (line[0] == '#') {
+            if (!pm->mode && !(pm->mode = dup_str(line, len))) ok = false;
+            continue;
+        }
+        if (header) { header = false; continue; }
+
+        char* col[6] = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+        int nc = 0;
+        char* copy = dup_str(line, len);
+        if (!copy) { ok = false; break; }
+        char* p = copy;
+        while (nc < 6) {
+            col[nc++] = p;
+            char* t = std::strchr(p, '\t');
+            if (!t) break;
+            *t = 0;
+            p = t + 1;
+        }
+        if (nc < 5) { std::free(copy); continue; }
+
+        if (pm->n == pm->cap) {
+            size_t ncap = (pm->cap == 0 ? 4096 : pm->cap * 2);
+            PrevRow* nr = (PrevRow*)std::realloc(pm->rows, ncap * sizeof(PrevRow));
+            if (!nr) { std::free(copy); ok = false; break; }
+            pm->rows = nr;
+            pm->cap = ncap;
+        }
+        PrevRow* r = &pm->rows[pm->n++];
+        r->line = dup_str(line, len);
+        r->rel_path = col[0];
+        r->tok_file = col[1];
+        r->bytes_in = std::strtoull(col[4], nullptr, 10);
+        r->has_mtime = (nc >= 6);
+        r->mtime = (r->has_mtime ? std::strtoull(col[5], nullptr, 10) : 0);
+        r->seen = false;
+        if (!r->line) ok = false;
+    }
+    std::fclose(f);
+    if (!ok) return false;
+
+    pm->tab_cap = 16;
+    while (pm->tab_cap < pm->n * 2) pm->tab_cap <<= 1;
+    pm->tab = (uint32_t*)std::calloc(pm->tab_cap, sizeof(uint32_t));
+    if (!pm->tab) return false;
+    size_t mask = pm->tab_cap - 1;
+    for (size_t i = 0; i < pm->n; ++i) {
+        size_t pos = (size_t)fnv1a64(pm->rows[i].rel_path) & mask;
+        while (pm->tab[pos]) pos = (pos + 1) & mask;
+        pm->tab[pos] = (uint32_t)i + 1;
+    }
+    return true;
+}
+
+static void prev_free(PrevMeta* pm) {
+    std::free(pm->mode);
+    for (size_t i = 0; i < pm->n; ++i) {
+        std::free(pm->rows[i].line);
+        std::free(pm->rows[i].rel_path);
+    }
+    std::free(pm->rows);
+    std::free(pm->tab);
+    std::memset(pm, 0, sizeof(*pm));
+}
+
+// Deletes every output the previous run listed and forgets its rows, for a
+// run that cannot reuse them. Returns how many files were removed.
+static uint64_t prev_drop(PrevMeta* pm, const char* out_dir) {
+    uint64_t removed = 0;
+    for (size_t k = 0; k < pm->n; ++k) {
+        char old_path[520];
+        join_path(old_path, sizeof(old_path), out_dir, pm->rows[k].tok_file);
+        if (remove_file(old_path)) removed++;
+    }
+    prev_free(pm);
+    return removed;
+}
+
+static bool ends_with(const char* s, const char* suffix) {
+    size_t n = std::strlen(s), m = std::strlen(suffix);
+    return n >= m && std::strcmp(s + n - m, suffix) == 0;
 }
 
 static void on_file(const char* full_path, const char* rel_path, void* user) {
     Ctx* ctx = (Ctx*)user;
+    if (ctx->docs_n == ctx->docs_cap) {
+        size_t nc = (ctx->docs_cap == 0 ? 4096 : ctx->docs_cap * 2);
+        DocEntry* nd = (DocEntry*)std::realloc(ctx->docs, nc * sizeof(DocEntry));
+        if (!nd) { ctx->oom = true; return; }
+        ctx->docs = nd;
+        ctx->docs_cap = nc;
+    }
+    DocEntry* d = &ctx->docs[ctx->docs_n];
+    d->full_path = dup_str(full_path, std::strlen(full_path));
+    d->rel_path = dup_str(rel_path, std::strlen(rel_path));
+    d->mtime = 0;
+    d->prev = nullptr;
+    d->skip = false;
+    if (!d->full_path || !d->rel_path) {
+        std::free(d->full_path);
+        std::free(d->rel_path);
+        ctx->oom = true;
+        return;
+    }
+    ctx->docs_n++;
+}
+
+// Decides from size and mtime whether the previous output can be kept.
+static void check_unchanged(Ctx* ctx, DocEntry* d) {
+    uint64_t size = 0;
+    if (!file_stat(d->full_path, &size, &d->mtime)) { size = 0; d->mtime = 0; }
+
+    PrevRow* prev = prev_find(ctx->prev, d->rel_path);
+    d->prev = prev;
+    if (!prev) return;
+    prev->seen = true;
+
+    char old_path[520];
+    join_path(old_path, sizeof(old_path), ctx->out_dir, prev->tok_file);
+    uint64_t osz, omt;
+    d->skip = (prev->has_mtime && d->mtime != 0 && prev->mtime == d->mtime && prev->bytes_in == size &&
+               ends_with(prev->tok_file, ctx->ids ? ".tid" : ".tok") && file_stat(old_path, &osz, &omt));
+}
 
-    uint64_t h = fnv1a64(rel_path);
+static void process_doc(Ctx* ctx, const DocEntry* d, const ReadItem* in) {
+    uint64_t h = fnv1a64(d->rel_path);
     char hex[17];
     hex16(hex, h);
 
     char out_name[260];
-    std::snprintf(out_name, sizeof(out_name), "%s.tok", hex);
+    std::snprintf(out_name, sizeof(out_name), "%s.%s", hex, ctx->ids ? "tid" : "tok");
 
     char out_path[520];
     join_path(out_path, sizeof(out_path), ctx->out_dir, out_name);
 
+    if (!in->ok) {
+        std::fprintf(stderr, "[err] cannot read: %s\n", d->full_path);
+        return;
+    }
+
     FILE* fout = std::fopen(out_path, "wb");
     if (!fout) {
         std::fprintf(stderr, "[err] cannot open output: %s\n", out_path);
@@ -61,61 +262,174 @@ static void on_file(const char* full_path, const char* rel_path, void* user) {
     }
 
     TokenizeStats st;
-    bool ok = tokenize_file_to_stream_ex(full_path, fout, &st, ctx->do_stem);
+    bool ok;
+    if (in->large) {
+        ok = (ctx->ids ? tokenize_file_to_ids_ex(d->full_path, fout, &st, ctx->stem, ctx->ids)
+                       : tokenize_file_to_stream_ex(d->full_path, fout, &st, ctx->stem));
+    } else {
+        ok = tokenize_buffer_ex(in->buf, in->n, fout, &st, ctx->stem, ctx->ids);
+    }
     std::fclose(fout);
 
     if (!ok) {
-        std::fprintf(stderr, "[err] tokenize failed: %s\n", full_path);
+        std::fprintf(stderr, "[err] tokenize failed: %s\n", d->full_path);
         return;
     }
 
-    std::fprintf(ctx->meta, "%s\t%s\t%I64u\t%I64u\t%I64u\n",
-                 rel_path, out_name,
-                 (unsigned long long)st.tokens_out,
-                 (unsigned long long)st.token_chars_sum,
-                 (unsigned long long)st.bytes_in);
+    std::fprintf(ctx->meta, "%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+                 d->rel_path, out_name,
+                 (uint64_t)st.tokens_out,
+                 (uint64_t)st.token_chars_sum,
+                 (uint64_t)st.bytes_in,
+                 (uint64_t)d->mtime);
+    if (d->prev) ctx->updated++;
+    else ctx->added++;
 
     ctx->total_docs++;
     ctx->total_tokens += st.tokens_out;
     ctx->total_token_chars += st.token_chars_sum;
     ctx->total_bytes += st.bytes_in;
+    ctx->total_write_calls += st.write_calls;
+    ctx->total_bytes_out += st.bytes_out;
 
     if (ctx->total_docs % 1000ULL == 0ULL) {
         auto now = std::chrono::steady_clock::now();
         double sec = std::chrono::duration<double>(now - ctx->t0).count();
         double kb = (double)ctx->total_bytes / 1024.0;
         double kbps = (sec > 0.0 ? (kb / sec) : 0.0);
-        std::fprintf(stderr, "[prog] docs=%I64u tokens=%I64u bytes=%I64u time=%.3fs speed=%.2f KB/s\n",
+        std::fprintf(stderr, "[prog] docs=%" PRIu64 " tokens=%" PRIu64 " bytes=%" PRIu64 " time=%.3fs speed=%.2f KB/s\n",
                      ctx->total_docs, ctx->total_tokens, ctx->total_bytes, sec, kbps);
     }
 }
 
+// Skipped documents keep their old meta row; the rest are read ahead by a
+// FileReader pool and tokenized here in enumeration order.
+static bool process_docs(Ctx* ctx, size_t read_threads) {
+    const char** paths = (const char**)std::malloc((ctx->docs_n + 1) * sizeof(const char*));
+    if (!paths) return false;
+    size_t nread = 0;
+    for (size_t k = 0; k < ctx->docs_n; ++k) {
+        DocEntry* d = &ctx->docs[k];
+        check_unchanged(ctx, d);
+        if (!d->skip) paths[nread++] = d->full_path;
+    }
+
+    FileReader* fr = file_reader_start(paths, nread, read_threads, 4 * read_threads + 16, FILE_READER_MAX_BYTES);
+    if (!fr) { std::free(paths); return false; }
+
+    bool ok = true;
+    for (size_t k = 0; k < ctx->docs_n; ++k) {
+        const DocEntry* d = &ctx->docs[k];
+        if (d->skip) {
+            std::fprintf(ctx->meta, "%s\n", d->prev->line);
+            ctx->skipped++;
+            continue;
+        }
+        ReadItem it;
+        if (!file_reader_next(fr, &it)) {
+            std::fprintf(stderr, "[err] file reader stopped early at: %s\n", d->full_path);
+            ok = false;
+            break;
+        }
+        process_doc(ctx, d, &it);
+        std::free(it.buf);
+    }
+
+    file_reader_stop(fr);
+    std::free(paths);
+    return ok;
+}
+
 static void usage() {
     std::fprintf(stderr,
         "Usage:\n"
         "  tokenize.exe <input_root_dir> <out_tokens_dir> <meta_out_tsv>\n"
-        "  tokenize.exe --stem <input_root_dir> <out_tokens_dir> <meta_out_tsv>\n");
+        "  tokenize.exe --stem <input_root_dir> <out_tokens_dir> <meta_out_tsv>\n"
+        "  tokenize.exe --stem=simple|snowball <input_root_dir> <out_tokens_dir> <meta_out_tsv>\n"
+        "Options (before the directories):\n"
+        "  --tid   write varint term-id streams (.tid) and <out_tokens_dir>\\terms.dict instead of .tok\n"
+        "  --incremental  reuse outputs listed in the existing <meta_out_tsv> whose size and mtime\n"
+        "                 are unchanged, and delete outputs of documents that disappeared\n"
+        "                 (everything is rebuilt if --stem or --tid differ from that run)\n"
+        "  --read-threads=N  files read ahead in parallel (default 4)\n");
 }
 
 int main(int argc, char** argv) {
-    bool do_stem = false;
+    StemMode stem = STEM_NONE;
     const char* root_dir = nullptr;
     const char* out_dir  = nullptr;
     const char* meta_out = nullptr;
 
-    if (argc == 4) {
-        root_dir = argv[1];
-        out_dir  = argv[2];
-        meta_out = argv[3];
-    } else if (argc == 5 && std::strcmp(argv[1], "--stem") == 0) {
-        do_stem = true;
-        root_dir = argv[2];
-        out_dir  = argv[3];
-        meta_out = argv[4];
-    } else {
+    bool tid = false;
+    bool incremental = false;
+    size_t read_threads = 4;
+
+    int ai = 1;
+    for (; ai < argc && std::strncmp(argv[ai], "--", 2) == 0; ++ai) {
+        if (std::strcmp(argv[ai], "--stem") == 0) {
+            stem = STEM_SIMPLE;
+        } else if (std::strncmp(argv[ai], "--stem=", 7) == 0) {
+            if (!parse_stem_mode(argv[ai] + 7, &stem)) {
+                usage();
+                return 2;
+            }
+        } else if (std::strcmp(argv[ai], "--tid") == 0) {
+            tid = true;
+        } else if (std::strcmp(argv[ai], "--incremental") == 0) {
+            incremental = true;
+        } else if (std::strncmp(argv[ai], "--read-threads=", 15) == 0) {
+            int v = std::atoi(argv[ai] + 15);
+            if (v < 1 || v > 256) {
+                usage();
+                return 2;
+            }
+            read_threads = (size_t)v;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - ai != 3) {
         usage();
         return 2;
     }
+    root_dir = argv[ai];
+    out_dir  = argv[ai + 1];
+    meta_out = argv[ai + 2];
+
+    // The first meta line records the options the outputs were made with;
+    // outputs of a run with other ones cannot be reused.
+    char mode_line[64];
+    std::snprintf(mode_line, sizeof(mode_line), "#tokenize stem=%s format=%s", stem_mode_name(stem), tid ? "tid" : "tok");
+
+    PrevMeta prev;
+    std::memset(&prev, 0, sizeof(prev));
+    if (incremental && !prev_load(&prev, meta_out)) {
+        std::fprintf(stderr, "[err] cannot read previous meta: %s\n", meta_out);
+        return 1;
+    }
+    char dict_path[520];
+    join_path(dict_path, sizeof(dict_path), out_dir, TERM_IDS_DICT_NAME);
+
+    uint64_t removed = 0;
+    if (prev.n > 0 && (!prev.mode || std::strcmp(prev.mode, mode_line) != 0)) {
+        std::fprintf(stderr, "Incremental: options differ from the previous run (%s), rebuilding\n",
+                     prev.mode ? prev.mode + 1 : "not recorded");
+        if (!tid) remove_file(dict_path);
+        removed += prev_drop(&prev, out_dir);
+    }
+
+    // Skipped .tid files keep their ids, so an incremental run extends the
+    // existing dictionary instead of starting a new one.
+    TermIds ids;
+    if (tid) {
+        bool have = (incremental && prev.n > 0 && term_ids_load(&ids, dict_path));
+        if (!have) {
+            if (incremental && prev.n > 0) term_ids_free(&ids);
+            if (!term_ids_init(&ids)) return 1;
+            if (incremental) removed += prev_drop(&prev, out_dir);
+        }
+    }
 
     if (!ensure_dir_exists("out")) return 1;
     if (!ensure_dir_exists(out_dir)) return 1;
@@ -123,7 +437,8 @@ int main(int argc, char** argv) {
     FILE* meta = std::fopen(meta_out, "wb");
     if (!meta) return 1;
 
-    std::fprintf(meta, "doc_path\ttok_file\ttokens_count\ttoken_chars\tbytes_in\n");
+    std::fprintf(meta, "%s\n", mode_line);
+    std::fprintf(meta, "doc_path\ttok_file\ttokens_count\ttoken_chars\tbytes_in\tmtime\n");
 
     Ctx ctx;
     ctx.out_dir = out_dir;
@@ -132,27 +447,83 @@ int main(int argc, char** argv) {
     ctx.total_tokens = 0;
     ctx.total_token_chars = 0;
     ctx.total_bytes = 0;
-    ctx.do_stem = do_stem;
+    ctx.total_write_calls = 0;
+    ctx.total_bytes_out = 0;
+    ctx.stem = stem;
+    ctx.ids = (tid ? &ids : nullptr);
+    ctx.prev = (incremental ? &prev : nullptr);
+    ctx.skipped = 0;
+    ctx.updated = 0;
+    ctx.added = 0;
+    ctx.docs = nullptr;
+    ctx.docs_n = 0;
+    ctx.docs_cap = 0;
+    ctx.oom = false;
     ctx.t0 = std::chrono::steady_clock::now();
 
-    bool ok = list_txt_files(root_dir, on_file, &ctx);
+    bool ok = list_txt_files(root_dir, on_file, &ctx) && !ctx.oom;
+    if (ok) ok = process_docs(&ctx, read_threads);
     std::fclose(meta);
+    for (size_t k = 0; k < ctx.docs_n; ++k) {
+        std::free(ctx.docs[k].full_path);
+        std::free(ctx.docs[k].rel_path);
+    }
+    std::free(ctx.docs);
 
     if (!ok) return 1;
 
+    for (size_t k = 0; k < prev.n; ++k) {
+        if (prev.rows[k].seen) continue;
+        char old_path[520];
+        join_path(old_path, sizeof(old_path), out_dir, prev.rows[k].tok_file);
+        if (remove_file(old_path)) removed++;
+    }
+    prev_free(&prev);
+
+    uint64_t dict_bytes = 0;
+    if (tid) {
+        if (!term_ids_save(&ids, dict_path)) {
+            std::fprintf(stderr, "[err] cannot write dictionary: %s\n", dict_path);
+            return 1;
+        }
+        dict_bytes = (uint64_t)(ids.pool_len + ids.size);
+    }
+
     auto t1 = std::chrono::steady_clock::now();
     double sec = std::chrono::duration<double>(t1 - ctx.t0).count();
     double kb = (double)ctx.total_bytes / 1024.0;
     double kbps = (sec > 0.0 ? (kb / sec) : 0.0);
     double avg_tok_len = (ctx.total_tokens > 0 ? (double)ctx.total_token_chars / (double)ctx.total_tokens : 0.0);
     double tok_per_kb = (kb > 0.0 ? (double)ctx.total_tokens / kb : 0.0);
+    double tok_per_sec = (sec > 0.0 ? (double)ctx.total_tokens / sec : 0.0);
 
-    std::fprintf(stderr, "Done. docs=%I64u tokens=%I64u bytes=%I64u token_chars=%I64u\n",
+    std::fprintf(stderr, "Done. docs=%" PRIu64 " tokens=%" PRIu64 " bytes=%" PRIu64 " token_chars=%" PRIu64 "\n",
                  ctx.total_docs, ctx.total_tokens, ctx.total_bytes, ctx.total_token_chars);
+    if (incremental) {
+        std::fprintf(stderr, "Incremental: skipped=%" PRIu64 " updated=%" PRIu64 " added=%" PRIu64 " removed=%" PRIu64 "\n",
+                     ctx.skipped, ctx.updated, ctx.added, removed);
+    }
     std::fprintf(stderr, "Time: %.6f s\n", sec);
     std::fprintf(stderr, "Avg token length: %.4f chars\n", avg_tok_len);
     std::fprintf(stderr, "Speed: %.2f KB/s\n", kbps);
     std::fprintf(stderr, "Tokens per KB: %.2f\n", tok_per_kb);
+    std::fprintf(stderr, "Tokens per second: %.0f\n", tok_per_sec);
+    std::fprintf(stderr, "Output bytes: %" PRIu64 "\n", ctx.total_bytes_out);
+    if (tid) {
+        std::fprintf(stderr, "Term dictionary: terms=%" PRIu64 " bytes=%" PRIu64 "\n",
+                     (uint64_t)ids.size, dict_bytes);
+        term_ids_free(&ids);
+    }
+    std::fprintf(stderr, "Write calls: %" PRIu64 " (%.1f tokens per call)\n", ctx.total_write_calls,
+                 (ctx.total_write_calls > 0 ? (double)ctx.total_tokens / (double)ctx.total_write_calls : 0.0));
+
+    if (stem != STEM_NONE) {
+        StemCacheStats cs;
+        stem_cache_stats(&cs);
+        double hit_rate = (cs.lookups > 0 ? 100.0 * (double)cs.hits / (double)cs.lookups : 0.0);
+        std::fprintf(stderr, "Stem cache (%s): lookups=%" PRIu64 " hits=%" PRIu64 " hit_rate=%.2f%% inserts=%" PRIu64 " evictions=%" PRIu64 "\n",
+                     stem_mode_name(stem), cs.lookups, cs.hits, hit_rate, cs.inserts, cs.evictions);
+    }
 
     return 0;
 }
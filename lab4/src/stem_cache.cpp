@@ -0,0 +1,86 @@
+#include "stem_cache.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// A slot is the zero-padded surface form with its length in byte 30 and the
+// stem length in byte 31, so lookups compare four words instead of calling
+// memcmp.
+struct StemSlot {
+    uint64_t w[4];
+};
+
+static const uint64_t STEM_LEN_MASK = ~(0xFFULL << 56);
+
+// Direct-mapped: a colliding form simply replaces the previous one, which
+// keeps the table bounded and leaves the frequent forms resident.
+struct StemCache {
+    StemSlot* slots;
+    StemMode mode;
+    StemCacheStats st;
+
+    ~StemCache() { std::free(slots); }
+};
+
+static thread_local StemCache g_cache;
+
+static uint64_t hash_key(const uint64_t w[4]) {
+    const uint64_t K = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = (w[0] * K) ^ (w[1] * 0xC2B2AE3D27D4EB4FULL);
+    h ^= (w[2] ^ w[3]) * 0x165667B19E3779F9ULL;
+    h *= K;
+    return h ^ (h >> 32);
+}
+
+void stem_apply_cached(StemMode mode, unsigned char* tok, size_t* len) {
+    if (mode == STEM_NONE || !tok || !len) return;
+    size_t n = *len;
+    if (n == 0 || n > STEM_CACHE_KEY_MAX) {
+        stem_apply(mode, tok, len);
+        return;
+    }
+
+    StemCache* c = &g_cache;
+    if (!c->slots || c->mode != mode) {
+        if (!c->slots) {
+            c->slots = (StemSlot*)std::calloc(STEM_CACHE_SLOTS, sizeof(StemSlot));
+            if (!c->slots) {
+                stem_apply(mode, tok, len);
+                return;
+            }
+        } else {
+            std::memset(c->slots, 0, STEM_CACHE_SLOTS * sizeof(StemSlot));
+        }
+        c->mode = mode;
+    }
+
+    uint64_t key[4] = {0, 0, 0, 0};
+    std::memcpy(key, tok, n);
+    key[3] |= (uint64_t)n << 48;
+
+    c->st.lookups++;
+    StemSlot* e = &c->slots[hash_key(key) & (STEM_CACHE_SLOTS - 1)];
+    if (e->w[0] == key[0] && e->w[1] == key[1] && e->w[2] == key[2] &&
+        (e->w[3] & STEM_LEN_MASK) == key[3]) {
+        c->st.hits++;
+        *len = (size_t)(e->w[3] >> 56);
+        return;
+    }
+
+    stem_apply(mode, tok, len);
+
+    // A stem that rewrote bytes (snowball turns 'ё' into 'е') is not a
+    // prefix of the surface form and cannot be described by a length.
+    if (std::memcmp(key, tok, *len) != 0) return;
+
+    if (e->w[3]) c->st.evictions++;
+    c->st.inserts++;
+    e->w[0] = key[0];
+    e->w[1] = key[1];
+    e->w[2] = key[2];
+    e->w[3] = key[3] | ((uint64_t)*len << 56);
+}
+
+void stem_cache_stats(StemCacheStats* out) {
+    if (out) *out = g_cache.st;
+}
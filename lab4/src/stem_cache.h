@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "stem_ru.h"
+
+struct StemCacheStats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t evictions;
+};
+
+// Same result as stem_apply, memoized in a bounded per-thread table keyed by
+// the surface form. Tokens longer than STEM_CACHE_KEY_MAX bytes bypass it.
+void stem_apply_cached(StemMode mode, unsigned char* tok, size_t* len);
+
+// Counters of the calling thread's cache.
+void stem_cache_stats(StemCacheStats* out);
+
+static const size_t STEM_CACHE_KEY_MAX = 30;
+static const size_t STEM_CACHE_SLOTS = (size_t)1 << 15;
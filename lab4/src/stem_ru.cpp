@@ -1,87 +1,95 @@
-#include "stem_ru.h"
-#include <cstring>
-
-static bool has_digit_ascii(const unsigned char* s, size_t n) {
-    for (size_t i = 0; i < n; ++i) {
-        if (s[i] >= '0' && s[i] <= '9') return true;
-    }
-    return false;
-}
-
-static bool looks_cyrillic_utf8(const unsigned char* s, size_t n) {
-    for (size_t i = 0; i + 1 < n; ++i) {
-        if (s[i] == 0xD0 || s[i] == 0xD1) return true;
-    }
-    return false;
-}
-
-static bool ends_with(const unsigned char* s, size_t n, const char* suf) {
-    size_t m = std::strlen(suf);  
-    if (m == 0 || m > n) return false;
-    return std::memcmp(s + (n - m), suf, m) == 0;
-}
-
-
-static const size_t MIN_STEM_BYTES = 6;
-
-void stem_ru_utf8(unsigned char* tok, size_t* len) {
-    if (!tok || !len) return;
-    size_t n = *len;
-    if (n < MIN_STEM_BYTES) return;
-
-    if (has_digit_ascii(tok, n)) return;
-
-    if (!looks_cyrillic_utf8(tok, n)) return;
-
-    if (n >= 4) {
-        const unsigned char* end = tok + (n - 4);
-        if (end[0] == 0xD1 && end[1] == 0x81 && end[2] == 0xD1 && (end[3] == 0x8F || end[3] == 0x8C)) {
-            if (n - 4 >= MIN_STEM_BYTES) {
-                n -= 4;
-            }
-        }
-    }
-
-    static const char* suffixes[] = {
-        "иями", "ями", "ами",
-        "ыми", "ими",
-        "ого", "его",
-        "ому", "ему",
-        "ыми", "ими",
-        "ых", "их",
-        "ах", "ях",
-        "ов", "ев",
-        "ом", "ем",
-        "ам", "ям",
-        "ую", "юю",
-        "ая", "яя",
-        "ое", "ее",
-        "ый", "ий",
-        "ые", "ие",
-        "а", "я", "о", "е", "ы", "и", "у", "ю"
-    };
-
-    for (size_t k = 0; k < sizeof(suffixes)/sizeof(suffixes[0]); ++k) {
-        const char* suf = suffixes[k];
-        size_t m = std::strlen(suf);
-        if (m == 0 || m > n) continue;
-        if (ends_with(tok, n, suf)) {
-            if (n - m >= MIN_STEM_BYTES) {
-                n -= m;
-            }
-            break;
-        }
-    }
-
-    if (n >= 2) {
-        unsigned char b0 = tok[n - 2];
-        unsigned char b1 = tok[n - 1];
-        if (b0 == 0xD1 && (b1 == 0x8C || b1 == 0x8A)) {
-            if (n - 2 >= MIN_STEM_BYTES) {
-                n -= 2;
-            }
-        }
-    }
-
-    *len = n;
-}
+#include "stem_ru.h"
+#include "suffix_trie.h"
+#include <cstring>
+
+static bool has_digit_ascii(const unsigned char* s, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] >= '0' && s[i] <= '9') return true;
+    }
+    return false;
+}
+
+static bool looks_cyrillic_utf8(const unsigned char* s, size_t n) {
+    for (size_t i = 0; i + 1 < n; ++i) {
+        if (s[i] == 0xD0 || s[i] == 0xD1) return true;
+    }
+    return false;
+}
+
+static const size_t MIN_STEM_BYTES = 6;
+
+static constexpr SuffixRule SUFFIXES[] = {
+    {"иями", 1}, {"ями", 1}, {"ами", 1},
+    {"ыми", 1}, {"ими", 1},
+    {"ого", 1}, {"его", 1},
+    {"ому", 1}, {"ему", 1},
+    {"ых", 1}, {"их", 1},
+    {"ах", 1}, {"ях", 1},
+    {"ов", 1}, {"ев", 1},
+    {"ом", 1}, {"ем", 1},
+    {"ам", 1}, {"ям", 1},
+    {"ую", 1}, {"юю", 1},
+    {"ая", 1}, {"яя", 1},
+    {"ое", 1}, {"ее", 1},
+    {"ый", 1}, {"ий", 1},
+    {"ые", 1}, {"ие", 1},
+    {"а", 1}, {"я", 1}, {"о", 1}, {"е", 1}, {"ы", 1}, {"и", 1}, {"у", 1}, {"ю", 1}
+};
+
+static constexpr auto SUFFIXES_TRIE = SUFFIX_TRIE(SUFFIXES);
+static_assert(SUFFIXES_TRIE.ok, "suffix trie overflow");
+
+void stem_ru_utf8(unsigned char* tok, size_t* len) {
+    if (!tok || !len) return;
+    size_t n = *len;
+    if (n < MIN_STEM_BYTES) return;
+
+    if (has_digit_ascii(tok, n)) return;
+
+    if (!looks_cyrillic_utf8(tok, n)) return;
+
+    if (n >= 4) {
+        const unsigned char* end = tok + (n - 4);
+        if (end[0] == 0xD1 && end[1] == 0x81 && end[2] == 0xD1 && (end[3] == 0x8F || end[3] == 0x8C)) {
+            if (n - 4 >= MIN_STEM_BYTES) {
+                n -= 4;
+            }
+        }
+    }
+
+    size_t m = SUFFIXES_TRIE.longest(SUFFIXES_TRIE.walk(tok, n, 0), 0);
+    if (m > 0 && n - m >= MIN_STEM_BYTES) {
+        n -= m;
+    }
+
+    if (n >= 2) {
+        unsigned char b0 = tok[n - 2];
+        unsigned char b1 = tok[n - 1];
+        if (b0 == 0xD1 && (b1 == 0x8C || b1 == 0x8A)) {
+            if (n - 2 >= MIN_STEM_BYTES) {
+                n -= 2;
+            }
+        }
+    }
+
+    *len = n;
+}
+
+void stem_apply(StemMode mode, unsigned char* tok, size_t* len) {
+    if (mode == STEM_SIMPLE) stem_ru_utf8(tok, len);
+    else if (mode == STEM_SNOWBALL) stem_ru_snowball_utf8(tok, len);
+}
+
+bool parse_stem_mode(const char* s, StemMode* out) {
+    if (!s || !out) return false;
+    if (std::strcmp(s, "none") == 0) { *out = STEM_NONE; return true; }
+    if (std::strcmp(s, "simple") == 0) { *out = STEM_SIMPLE; return true; }
+    if (std::strcmp(s, "snowball") == 0) { *out = STEM_SNOWBALL; return true; }
+    return false;
+}
+
+const char* stem_mode_name(StemMode mode) {
+    if (mode == STEM_SIMPLE) return "simple";
+    if (mode == STEM_SNOWBALL) return "snowball";
+    return "none";
+}
@@ -0,0 +1,226 @@
+#include "stem_ru.h"
+#include "suffix_trie.h"
+#include <cstring>
+
+// Snowball Russian stemmer (snowballstem.org, russian.sbl) on UTF-8 bytes.
+// All step-1 endings live in one trie; the tag bit says which among() list a
+// suffix belongs to. "1" groups must be preceded by 'а' or 'я'. Bit 0 is
+// unused so that 0 can mean "no list".
+
+enum : unsigned {
+    PG1 = 1,
+    PG2,
+    ADJ,
+    PART1,
+    PART2,
+    REFL,
+    VERB1,
+    VERB2,
+    NOUN
+};
+
+#define T(bit) (uint16_t)(1u << (bit))
+
+static constexpr SuffixRule STEP1[] = {
+    {"в", T(PG1)}, {"вши", T(PG1)}, {"вшись", T(PG1)},
+    {"ив", T(PG2)}, {"ивши", T(PG2)}, {"ившись", T(PG2)},
+    {"ыв", T(PG2)}, {"ывши", T(PG2)}, {"ывшись", T(PG2)},
+
+    {"ее", T(ADJ)}, {"ие", T(ADJ)}, {"ые", T(ADJ)}, {"ое", T(ADJ)}, {"ими", T(ADJ)}, {"ыми", T(ADJ)},
+    {"ей", T(ADJ)}, {"ий", T(ADJ)}, {"ый", T(ADJ)}, {"ой", T(ADJ)}, {"ем", T(ADJ)}, {"им", T(ADJ)},
+    {"ым", T(ADJ)}, {"ом", T(ADJ)}, {"его", T(ADJ)}, {"ого", T(ADJ)}, {"ему", T(ADJ)}, {"ому", T(ADJ)},
+    {"их", T(ADJ)}, {"ых", T(ADJ)}, {"ую", T(ADJ)}, {"юю", T(ADJ)}, {"ая", T(ADJ)}, {"яя", T(ADJ)},
+    {"ою", T(ADJ)}, {"ею", T(ADJ)},
+
+    {"ем", T(PART1)}, {"нн", T(PART1)}, {"вш", T(PART1)}, {"ющ", T(PART1)}, {"щ", T(PART1)},
+    {"ивш", T(PART2)}, {"ывш", T(PART2)}, {"ующ", T(PART2)},
+
+    {"ся", T(REFL)}, {"сь", T(REFL)},
+
+    {"ла", T(VERB1)}, {"на", T(VERB1)}, {"ете", T(VERB1)}, {"йте", T(VERB1)}, {"ли", T(VERB1)}, {"й", T(VERB1)},
+    {"л", T(VERB1)}, {"ем", T(VERB1)}, {"н", T(VERB1)}, {"ло", T(VERB1)}, {"но", T(VERB1)}, {"ет", T(VERB1)},
+    {"ют", T(VERB1)}, {"ны", T(VERB1)}, {"ть", T(VERB1)}, {"ешь", T(VERB1)}, {"нно", T(VERB1)},
+    {"ила", T(VERB2)}, {"ыла", T(VERB2)}, {"ена", T(VERB2)}, {"ейте", T(VERB2)}, {"уйте", T(VERB2)}, {"ите", T(VERB2)},
+    {"или", T(VERB2)}, {"ыли", T(VERB2)}, {"ей", T(VERB2)}, {"уй", T(VERB2)}, {"ил", T(VERB2)}, {"ыл", T(VERB2)},
+    {"им", T(VERB2)}, {"ым", T(VERB2)}, {"ен", T(VERB2)}, {"ило", T(VERB2)}, {"ыло", T(VERB2)}, {"ено", T(VERB2)},
+    {"ят", T(VERB2)}, {"ует", T(VERB2)}, {"уют", T(VERB2)}, {"ит", T(VERB2)}, {"ыт", T(VERB2)}, {"ены", T(VERB2)},
+    {"ить", T(VERB2)}, {"ыть", T(VERB2)}, {"ишь", T(VERB2)}, {"ую", T(VERB2)}, {"ю", T(VERB2)},
+
+    {"а", T(NOUN)}, {"ев", T(NOUN)}, {"ов", T(NOUN)}, {"ие", T(NOUN)}, {"ье", T(NOUN)}, {"е", T(NOUN)},
+    {"иями", T(NOUN)}, {"ями", T(NOUN)}, {"ами", T(NOUN)}, {"еи", T(NOUN)}, {"ии", T(NOUN)}, {"и", T(NOUN)},
+    {"ией", T(NOUN)}, {"ей", T(NOUN)}, {"ой", T(NOUN)}, {"ий", T(NOUN)}, {"й", T(NOUN)}, {"иям", T(NOUN)},
+    {"ям", T(NOUN)}, {"ием", T(NOUN)}, {"ем", T(NOUN)}, {"ам", T(NOUN)}, {"ом", T(NOUN)}, {"о", T(NOUN)},
+    {"у", T(NOUN)}, {"ах", T(NOUN)}, {"иях", T(NOUN)}, {"ях", T(NOUN)}, {"ы", T(NOUN)}, {"ь", T(NOUN)},
+    {"ию", T(NOUN)}, {"ью", T(NOUN)}, {"ю", T(NOUN)}, {"ия", T(NOUN)}, {"ья", T(NOUN)}, {"я", T(NOUN)}
+};
+
+static constexpr auto STEP1_TRIE = SUFFIX_TRIE(STEP1);
+static_assert(STEP1_TRIE.ok, "snowball suffix trie overflow");
+
+#undef T
+
+struct VowelTable {
+    bool v[128];
+};
+
+static constexpr VowelTable make_vowel_table() {
+    VowelTable t{};
+    const char* vowels = "аеиоуыэюя";
+    for (size_t i = 0; vowels[i]; i += 2) {
+        unsigned char b0 = (unsigned char)vowels[i];
+        unsigned char b1 = (unsigned char)vowels[i + 1];
+        t.v[((b0 & 1) << 6) | (b1 & 0x3F)] = true;
+    }
+    return t;
+}
+
+static constexpr VowelTable VOWELS = make_vowel_table();
+
+// Advances *i past one character, replacing 'ё' with 'е' in place.
+static bool next_is_vowel(unsigned char* s, size_t n, size_t* i) {
+    size_t p = *i;
+    unsigned char b0 = s[p];
+    if ((b0 & 0xFE) == 0xD0 && p + 1 < n) {
+        if (b0 == 0xD1 && s[p + 1] == 0x91) {
+            s[p] = b0 = 0xD0;
+            s[p + 1] = 0xB5;
+        }
+        *i = p + 2;
+        return VOWELS.v[((b0 & 1) << 6) | (s[p + 1] & 0x3F)];
+    }
+    if ((b0 & 0xE0) == 0xC0) p += 2;
+    else if ((b0 & 0xF0) == 0xE0) p += 3;
+    else if ((b0 & 0xF8) == 0xF0) p += 4;
+    else p += 1;
+    *i = (p < n ? p : n);
+    return false;
+}
+
+// pos is the start of a matched ending; true if 'а' or 'я' precedes it inside RV.
+static bool after_a_ya(const unsigned char* s, size_t pos, size_t rv) {
+    if (pos < rv + 2) return false;
+    const unsigned char* p = s + pos - 2;
+    return (p[0] == 0xD0 && p[1] == 0xB0) || (p[0] == 0xD1 && p[1] == 0x8F);
+}
+
+static bool ends_with_lit(const unsigned char* s, size_t n, size_t lim, const char* lit, size_t m) {
+    return n >= lim + m && std::memcmp(s + n - m, lit, m) == 0;
+}
+
+// Strips the longest ending from the "plain" or "after_a" list (tag bits);
+// the latter only when preceded by 'а' or 'я'.
+static bool strip(uint32_t v, unsigned plain, unsigned after_a,
+                  const unsigned char* s, size_t* n, size_t rv) {
+    size_t m1 = STEP1_TRIE.longest(v, plain);
+    size_t m2 = (after_a ? STEP1_TRIE.longest(v, after_a) : 0);
+    if (m1 >= m2) {
+        if (m1 == 0) return false;
+        *n -= m1;
+        return true;
+    }
+    if (!after_a_ya(s, *n - m2, rv)) return false;
+    *n -= m2;
+    return true;
+}
+
+static size_t lowest_bit(uint64_t x) {
+    return (size_t)__builtin_ctzll(x);
+}
+
+// Fast path for all-Cyrillic tokens of up to 60 letters: build a vowel bit
+// mask and find RV/R2 with bit operations instead of a branchy scan. Bits at
+// and past the end are set in both masks, so every search stops by bit 63.
+static bool mark_regions_cyr(unsigned char* s, size_t n, size_t* rv, size_t* r2) {
+    if ((n & 1) || n > 120) return false;
+    size_t L = n / 2;
+    uint64_t vm = 0;
+    for (size_t j = 0; j < L; ++j) {
+        unsigned char b0 = s[2 * j], b1 = s[2 * j + 1];
+        if ((b0 & 0xFE) != 0xD0) return false;
+        if (b0 == 0xD1 && b1 == 0x91) {
+            s[2 * j] = b0 = 0xD0;
+            s[2 * j + 1] = b1 = 0xB5;
+        }
+        vm |= (uint64_t)VOWELS.v[((b0 & 1) << 6) | (b1 & 0x3F)] << j;
+    }
+    uint64_t tail = ~0ULL << L;
+    uint64_t cm = ~vm;
+    vm |= tail;
+
+    size_t a = lowest_bit(vm);
+    size_t b = lowest_bit(cm & (~0ULL << (a + 1)));
+    size_t c = lowest_bit(vm & (~0ULL << (b + 1)));
+    size_t d = lowest_bit(cm & (~0ULL << (c + 1)));
+    *rv = 2 * (a + 1 < L ? a + 1 : L);
+    *r2 = 2 * (d + 1 < L ? d + 1 : L);
+    return true;
+}
+
+static void mark_regions(unsigned char* s, size_t n, size_t* rv, size_t* r2) {
+    if (mark_regions_cyr(s, n, rv, r2)) return;
+    size_t i = 0;
+    while (i < n && !next_is_vowel(s, n, &i)) {}
+    *rv = i;
+    while (i < n && next_is_vowel(s, n, &i)) {}
+    while (i < n && !next_is_vowel(s, n, &i)) {}
+    while (i < n && next_is_vowel(s, n, &i)) {}
+    *r2 = i;
+    while (i < n) next_is_vowel(s, n, &i);
+}
+
+void stem_ru_snowball_utf8(unsigned char* tok, size_t* len) {
+    if (!tok || !len) return;
+    size_t n = *len;
+
+    size_t rv = n, r2 = n;
+    mark_regions(tok, n, &rv, &r2);
+    if (rv >= n) return;
+
+    uint32_t v = STEP1_TRIE.walk(tok, n, rv);
+
+    if (!strip(v, PG2, PG1, tok, &n, rv)) {
+        size_t m = STEP1_TRIE.longest(v, REFL);
+        if (m > 0) {
+            n -= m;
+            v = STEP1_TRIE.walk(tok, n, rv);
+        }
+        if (strip(v, ADJ, 0, tok, &n, rv)) {
+            v = STEP1_TRIE.walk(tok, n, rv);
+            strip(v, PART2, PART1, tok, &n, rv);
+        } else if (!strip(v, VERB2, VERB1, tok, &n, rv)) {
+            strip(v, NOUN, 0, tok, &n, rv);
+        }
+    }
+
+    if (ends_with_lit(tok, n, rv, "и", 2)) n -= 2;
+
+    if (n < rv + 2) {
+        *len = n;
+        return;
+    }
+
+    unsigned char last = tok[n - 1];
+    if (tok[n - 2] == 0xD1 && (last == 0x82 || last == 0x8C)) {
+        if (ends_with_lit(tok, n, r2, "ость", 8)) n -= 8;
+        else if (ends_with_lit(tok, n, r2, "ост", 6)) n -= 6;
+        if (n < rv + 2) {
+            *len = n;
+            return;
+        }
+        last = tok[n - 1];
+    }
+
+    unsigned char lead = tok[n - 2];
+    if (lead == 0xD1 && last == 0x8C) {
+        n -= 2;
+    } else if (lead == 0xD0 && last == 0xBD) {
+        if (ends_with_lit(tok, n, rv, "нн", 4)) n -= 2;
+    } else if ((lead == 0xD0 && last == 0xB5) || (lead == 0xD1 && last == 0x88)) {
+        if (ends_with_lit(tok, n, rv, "ейше", 8)) n -= 8;
+        else if (ends_with_lit(tok, n, rv, "ейш", 6)) n -= 6;
+        else lead = 0;
+        if (lead && ends_with_lit(tok, n, rv, "нн", 4)) n -= 2;
+    }
+
+    *len = n;
+}
@@ -0,0 +1,51 @@
+#include "token_writer.h"
+#include <cstdlib>
+
+struct WriterBuf {
+    unsigned char* p;
+
+    ~WriterBuf() { std::free(p); }
+};
+
+static thread_local WriterBuf g_buf;
+
+bool token_writer_open(TokenWriter* w, FILE* out) {
+    w->out = out;
+    w->buf = nullptr;
+    w->len = 0;
+    w->cap = 0;
+    w->write_calls = 0;
+    w->bytes_out = 0;
+    w->ok = false;
+    if (!out) return false;
+
+    if (!g_buf.p) {
+        g_buf.p = (unsigned char*)std::malloc(TOKEN_WRITER_BUF);
+        if (!g_buf.p) return false;
+    }
+    w->buf = g_buf.p;
+    w->cap = TOKEN_WRITER_BUF;
+    w->ok = true;
+    return true;
+}
+
+bool token_writer_flush(TokenWriter* w) {
+    if (!w->ok) return false;
+    if (w->len == 0) return true;
+    w->write_calls++;
+    w->bytes_out += w->len;
+    size_t wr = std::fwrite(w->buf, 1, w->len, w->out);
+    if (wr != w->len) {
+        w->ok = false;
+        return false;
+    }
+    w->len = 0;
+    return true;
+}
+
+bool token_writer_close(TokenWriter* w) {
+    bool ok = token_writer_flush(w);
+    w->buf = nullptr;
+    w->cap = 0;
+    return ok;
+}
@@ -49,6 +49,14 @@ bool utf8_decode_one(const unsigned char* s, size_t n, size_t* used, uint32_t* c
     return false;
 }
 
+// Bytes a sequence starting with b0 should span; 1 for ASCII and stray bytes.
+size_t utf8_seq_len(unsigned char b0) {
+    if ((b0 & 0xE0) == 0xC0) return 2;
+    if ((b0 & 0xF0) == 0xE0) return 3;
+    if ((b0 & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
 size_t utf8_encode_one(uint32_t cp, unsigned char out[4]) {
     if (cp <= 0x7F) {
         out[0] = (unsigned char)cp;
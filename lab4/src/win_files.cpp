@@ -1,8 +1,17 @@
 #include "win_files.h"
-#include <windows.h>
+#include "file_scan.h"
 #include <cstdio>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
 bool ensure_dir_exists(const char* path) {
     if (!path || !path[0]) return false;
     DWORD attr = GetFileAttributesA(path);
@@ -12,67 +21,57 @@ bool ensure_dir_exists(const char* path) {
     return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
 }
 
-static bool is_dot_dir(const char* name) {
-    if (!name) return false;
-    return (name[0] == '.' && name[1] == 0) || (name[0] == '.' && name[1] == '.' && name[2] == 0);
+// mtime is the raw last-write FILETIME; it is only compared for equality.
+bool file_stat(const char* path, uint64_t* size, uint64_t* mtime) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &fad)) return false;
+    *size = ((uint64_t)fad.nFileSizeHigh << 32) | (uint64_t)fad.nFileSizeLow;
+    *mtime = ((uint64_t)fad.ftLastWriteTime.dwHighDateTime << 32) | (uint64_t)fad.ftLastWriteTime.dwLowDateTime;
+    return true;
 }
 
-static bool ends_with_txt_ci(const char* s) {
-    if (!s) return false;
-    size_t n = std::strlen(s);
-    if (n < 4) return false;
-    if (s[n-4] != '.') return false;
-    char a = s[n-3], b = s[n-2], c = s[n-1];
-    return ( (a=='t'||a=='T') && (b=='x'||b=='X') && (c=='t'||c=='T') );
+bool remove_file(const char* path) {
+    return DeleteFileA(path) != 0;
 }
 
-static void join_path(char* out, size_t out_sz, const char* a, const char* b) {
-    std::snprintf(out, out_sz, "%s\\%s", a, b);
-}
-
-static bool list_rec(const char* root, const char* dir, const char* rel_prefix, file_callback_t cb, void* user) {
-    char pattern[MAX_PATH];
-    std::snprintf(pattern, sizeof(pattern), "%s\\*", dir);
-
-    WIN32_FIND_DATAA ffd;
-    HANDLE h = FindFirstFileA(pattern, &ffd);
-    if (h == INVALID_HANDLE_VALUE) {
-        std::fprintf(stderr, "FindFirstFileA failed for: %s\n", pattern);
-        return false;
-    }
-
-    bool ok = true;
-    do {
-        const char* name = ffd.cFileName;
-        if (is_dot_dir(name)) continue;
+#else
 
-        char full[MAX_PATH];
-        join_path(full, sizeof(full), dir, name);
-
-        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            char next_rel[MAX_PATH];
-            if (rel_prefix && rel_prefix[0]) std::snprintf(next_rel, sizeof(next_rel), "%s\\%s", rel_prefix, name);
-            else std::snprintf(next_rel, sizeof(next_rel), "%s", name);
-
-            if (!list_rec(root, full, next_rel, cb, user)) { ok = false; break; }
-            continue;
-        }
+bool ensure_dir_exists(const char* path) {
+    if (!path || !path[0]) return false;
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) return true;
+    if (mkdir(path, 0777) == 0) return true;
+    return (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+}
 
-        if (!ends_with_txt_ci(name)) continue;
+// mtime is in nanoseconds since the epoch; it is only compared for equality.
+bool file_stat(const char* path, uint64_t* size, uint64_t* mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+    *mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+    return true;
+}
 
-        char rel[MAX_PATH];
-        if (rel_prefix && rel_prefix[0]) std::snprintf(rel, sizeof(rel), "%s\\%s", rel_prefix, name);
-        else std::snprintf(rel, sizeof(rel), "%s", name);
+bool remove_file(const char* path) {
+    return unlink(path) == 0;
+}
 
-        cb(full, rel, user);
+#endif
 
-    } while (FindNextFileA(h, &ffd));
+struct ShimCtx {
+    file_callback_t cb;
+    void* user;
+};
 
-    FindClose(h);
-    return ok;
+static bool shim_batch(const ScanEntry* batch, size_t n, void* user) {
+    ShimCtx* c = (ShimCtx*)user;
+    for (size_t i = 0; i < n; ++i) c->cb(batch[i].full_path, batch[i].rel_path, c->user);
+    return true;
 }
 
 bool list_txt_files(const char* root_dir, file_callback_t cb, void* user) {
     if (!root_dir || !cb) return false;
-    return list_rec(root_dir, root_dir, "", cb, user);
+    ShimCtx c = {cb, user};
+    return scan_files(root_dir, "txt", true, 0, SCAN_BY_INODE, shim_batch, &c);
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 
 typedef void (*file_callback_t)(const char* full_path, const char* rel_path, void* user);
 
 bool list_txt_files(const char* root_dir, file_callback_t cb, void* user);
 bool ensure_dir_exists(const char* path);
+bool file_stat(const char* path, uint64_t* size, uint64_t* mtime);
+bool remove_file(const char* path);
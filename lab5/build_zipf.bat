@@ -5,7 +5,7 @@ if not exist bin mkdir bin
 if not exist out mkdir out
 
 g++ -O2 -std=c++17 -Wall -Wextra ^
-  src\main.cpp src\win_files.cpp src\freq.cpp ^
+  src\main.cpp src\win_files.cpp src\file_scan.cpp src\freq.cpp src\approx.cpp src\term_counter.cpp src\term_ids.cpp ^
   -o bin\zipf.exe
 
 if errorlevel 1 (
@@ -13,5 +13,14 @@ if errorlevel 1 (
   exit /b 1
 )
 
-echo Build OK: bin\zipf.exe
+g++ -O2 -std=c++17 -Wall -Wextra ^
+  src\index_zipf.cpp src\win_files.cpp src\file_scan.cpp src\freq.cpp src\term_counter.cpp src\term_ids.cpp ^
+  -o bin\index_zipf.exe
+
+if errorlevel 1 (
+  echo Build failed.
+  exit /b 1
+)
+
+echo Build OK: bin\zipf.exe bin\index_zipf.exe
 endlocal
@@ -5,5 +5,6 @@ if not exist out mkdir out
 
 bin\zipf.exe out\tokens out\zipf_raw.tsv out\terms_raw.tsv
 bin\zipf.exe out\stem_tokens out\zipf_stem.tsv out\terms_stem.tsv
+if exist ..\lab6\index\index.bin bin\index_zipf.exe ..\lab6\index\index.bin out\zipf_index.tsv out\terms_index.tsv
 
 endlocal
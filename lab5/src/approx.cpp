@@ -0,0 +1,256 @@
+#include "approx.h"
+#include "tok_lines.h"
+#include "win_files.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static size_t pow2_at_least(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// The sketch rows use h1 + r*h2 over a remixed hash (Kirsch-Mitzenmacher),
+// so one term hash per token serves every row.
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+size_t approx_bytes(const ApproxConfig* cfg) {
+    size_t k = cfg->top_k;
+    return k * sizeof(ApproxSlot) + k * sizeof(uint32_t) + pow2_at_least(2 * k) * sizeof(uint32_t) +
+           cfg->cm_depth * pow2_at_least(cfg->cm_width) * sizeof(uint64_t);
+}
+
+bool approx_init(ApproxCounter* a, const ApproxConfig* cfg) {
+    std::memset(a, 0, sizeof(*a));
+    if (cfg->top_k == 0 || cfg->top_k >= 0xFFFFFFFFu || cfg->cm_width == 0 || cfg->cm_depth == 0) return false;
+    a->cfg = *cfg;
+    a->cfg.cm_width = pow2_at_least(cfg->cm_width);
+    a->map_cap = pow2_at_least(2 * cfg->top_k);
+    a->slots = (ApproxSlot*)std::malloc(cfg->top_k * sizeof(ApproxSlot));
+    a->heap = (uint32_t*)std::malloc(cfg->top_k * sizeof(uint32_t));
+    a->map = (uint32_t*)std::calloc(a->map_cap, sizeof(uint32_t));
+    a->cm = (uint64_t*)std::calloc(a->cfg.cm_depth * a->cfg.cm_width, sizeof(uint64_t));
+    if (!a->slots || !a->heap || !a->map || !a->cm) {
+        approx_free(a);
+        return false;
+    }
+    return true;
+}
+
+void approx_free(ApproxCounter* a) {
+    std::free(a->slots);
+    std::free(a->heap);
+    std::free(a->map);
+    std::free(a->cm);
+    std::memset(a, 0, sizeof(*a));
+}
+
+double approx_eps(const ApproxCounter* a) {
+    return std::exp(1.0) / (double)a->cfg.cm_width;
+}
+
+double approx_delta(const ApproxCounter* a) {
+    return std::exp(-(double)a->cfg.cm_depth);
+}
+
+static uint64_t cm_query(const ApproxCounter* a, uint64_t h) {
+    uint64_t m = mix64(h);
+    uint64_t h1 = m, h2 = (m >> 32) | 1;
+    size_t mask = a->cfg.cm_width - 1;
+    uint64_t est = UINT64_MAX;
+    for (size_t r = 0; r < a->cfg.cm_depth; ++r) {
+        uint64_t v = a->cm[r * a->cfg.cm_width + ((h1 + r * h2) & mask)];
+        if (v < est) est = v;
+    }
+    return est;
+}
+
+static void cm_add(ApproxCounter* a, uint64_t h) {
+    uint64_t m = mix64(h);
+    uint64_t h1 = m, h2 = (m >> 32) | 1;
+    size_t mask = a->cfg.cm_width - 1;
+    for (size_t r = 0; r < a->cfg.cm_depth; ++r) a->cm[r * a->cfg.cm_width + ((h1 + r * h2) & mask)]++;
+}
+
+static void heap_set(ApproxCounter* a, size_t pos, uint32_t slot) {
+    a->heap[pos] = slot;
+    a->slots[slot].heap_pos = (uint32_t)pos;
+}
+
+static void sift_down(ApproxCounter* a, size_t pos) {
+    size_t n = a->used;
+    uint32_t slot = a->heap[pos];
+    uint64_t c = a->slots[slot].count;
+    for (;;) {
+        size_t l = 2 * pos + 1;
+        if (l >= n) break;
+        size_t m = l;
+        if (l + 1 < n && a->slots[a->heap[l + 1]].count < a->slots[a->heap[l]].count) m = l + 1;
+        if (a->slots[a->heap[m]].count >= c) break;
+        heap_set(a, pos, a->heap[m]);
+        pos = m;
+    }
+    heap_set(a, pos, slot);
+}
+
+static void sift_up(ApproxCounter* a, size_t pos) {
+    uint32_t slot = a->heap[pos];
+    uint64_t c = a->slots[slot].count;
+    while (pos > 0) {
+        size_t p = (pos - 1) / 2;
+        if (a->slots[a->heap[p]].count <= c) break;
+        heap_set(a, pos, a->heap[p]);
+        pos = p;
+    }
+    heap_set(a, pos, slot);
+}
+
+// Map slot holding `slot`, or the empty slot where (s, n, h) would go.
+static size_t map_find(const ApproxCounter* a, const unsigned char* s, size_t n, uint64_t h, bool* found) {
+    size_t mask = a->map_cap - 1;
+    size_t pos = (size_t)h & mask;
+    while (uint32_t v = a->map[pos]) {
+        const ApproxSlot* sl = &a->slots[v - 1];
+        if (sl->hash == h && sl->len == n && std::memcmp(sl->term, s, n) == 0) {
+            *found = true;
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+    *found = false;
+    return pos;
+}
+
+// Linear-probing delete with backward shift, so no tombstones pile up.
+static void map_erase(ApproxCounter* a, size_t pos) {
+    size_t mask = a->map_cap - 1;
+    size_t i = pos;
+    a->map[i] = 0;
+    for (size_t j = (i + 1) & mask; a->map[j]; j = (j + 1) & mask) {
+        size_t home = (size_t)a->slots[a->map[j] - 1].hash & mask;
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        a->map[i] = a->map[j];
+        a->map[j] = 0;
+        i = j;
+    }
+}
+
+void approx_add(ApproxCounter* a, const unsigned char* s, size_t n, uint64_t h) {
+    a->total_tokens++;
+    cm_add(a, h);
+    if (n > APPROX_MAX_TERM) {
+        a->long_terms++;
+        return;
+    }
+
+    bool found;
+    size_t pos = map_find(a, s, n, h, &found);
+    if (found) {
+        ApproxSlot* sl = &a->slots[a->map[pos] - 1];
+        sl->count++;
+        sift_down(a, sl->heap_pos);
+        return;
+    }
+
+    uint32_t slot;
+    uint64_t base = 0;
+    if (a->used < a->cfg.top_k) {
+        slot = (uint32_t)a->used++;
+        a->heap[a->used - 1] = slot;
+        a->slots[slot].heap_pos = (uint32_t)(a->used - 1);
+    } else {
+        slot = a->heap[0];
+        ApproxSlot* old = &a->slots[slot];
+        bool f2;
+        map_erase(a, map_find(a, old->term, old->len, old->hash, &f2));
+        base = old->count;
+        pos = map_find(a, s, n, h, &found);
+    }
+
+    ApproxSlot* sl = &a->slots[slot];
+    sl->hash = h;
+    sl->count = base + 1;
+    sl->err = base;
+    sl->len = (uint32_t)n;
+    std::memcpy(sl->term, s, n);
+    a->map[pos] = slot + 1;
+    if (base == 0) sift_up(a, sl->heap_pos);
+    else sift_down(a, sl->heap_pos);
+}
+
+bool approx_add_file(ApproxCounter* a, const char* tok_path) {
+    MappedFile mf;
+    if (!map_file(tok_path, &mf)) return false;
+    bool ok = for_each_tok_line(mf.data, mf.size, [&](const unsigned char* t, size_t len, uint64_t h) {
+        approx_add(a, t, len, h);
+        return true;
+    });
+    unmap_file(&mf);
+    return ok;
+}
+
+std::vector<ApproxRow> approx_top(const ApproxCounter* a) {
+    uint64_t slack = (uint64_t)std::ceil(approx_eps(a) * (double)a->total_tokens);
+    std::vector<ApproxRow> rows;
+    rows.reserve(a->used);
+    for (size_t i = 0; i < a->used; ++i) {
+        const ApproxSlot* sl = &a->slots[i];
+        uint64_t cm = cm_query(a, sl->hash);
+        ApproxRow r;
+        r.term = sl->term;
+        r.len = sl->len;
+        r.upper = (cm < sl->count ? cm : sl->count);
+        r.lower = sl->count - sl->err;
+        if (cm > slack && cm - slack > r.lower) r.lower = cm - slack;
+        if (r.lower > r.upper) r.lower = r.upper;
+        r.freq = r.upper;
+        rows.push_back(r);
+    }
+    std::sort(rows.begin(), rows.end(), [](const ApproxRow& x, const ApproxRow& y) {
+        if (x.freq != y.freq) return x.freq > y.freq;
+        size_t m = (x.len < y.len ? x.len : y.len);
+        int c = std::memcmp(x.term, y.term, m);
+        if (c != 0) return c < 0;
+        return x.len < y.len;
+    });
+    return rows;
+}
+
+bool save_terms_approx_tsv(const char* path, const std::vector<ApproxRow>& rows) {
+    FILE* out = std::fopen(path, "wb");
+    if (!out) return false;
+    std::fprintf(out, "term\tcount\tlower\tupper\n");
+    for (const ApproxRow& r : rows) {
+        std::fwrite(r.term, 1, r.len, out);
+        std::fprintf(out, "\t%llu\t%llu\t%llu\n",
+                     (unsigned long long)r.freq, (unsigned long long)r.lower, (unsigned long long)r.upper);
+    }
+    std::fclose(out);
+    return true;
+}
+
+bool save_zipf_approx_tsv(const char* path, const std::vector<ApproxRow>& rows) {
+    FILE* out = std::fopen(path, "wb");
+    if (!out) return false;
+    std::fprintf(out, "rank\tfrequency\tlower\tupper\n");
+    for (size_t i = 0; i < rows.size(); ++i) {
+        std::fprintf(out, "%llu\t%llu\t%llu\t%llu\n",
+                     (unsigned long long)(i + 1ULL),
+                     (unsigned long long)rows[i].freq,
+                     (unsigned long long)rows[i].lower,
+                     (unsigned long long)rows[i].upper);
+    }
+    std::fclose(out);
+    return true;
+}
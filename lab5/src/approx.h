@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded-memory term frequencies for corpora whose vocabulary does not fit:
+// Space-Saving keeps the top_k heaviest terms, a Count-Min sketch of
+// cm_depth x cm_width counters answers point queries for them. Memory is
+// fixed at init and does not grow with the corpus.
+//
+// Bounds for a reported term with Space-Saving count c and error e:
+//   c - e <= true <= c                 (always)
+//   true <= cm                         (always)
+//   true >= cm - eps*N, eps = e/width  (with probability 1 - e^-depth)
+// Every term with frequency above N/top_k is among the reported ones. Terms
+// longer than APPROX_MAX_TERM bytes only go to the sketch and N.
+struct ApproxConfig {
+    size_t top_k;
+    size_t cm_width;
+    size_t cm_depth;
+};
+
+static const size_t APPROX_MAX_TERM = 96;
+
+struct ApproxSlot {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t err;
+    uint32_t heap_pos;
+    uint32_t len;
+    unsigned char term[APPROX_MAX_TERM];
+};
+
+struct ApproxCounter {
+    ApproxConfig cfg;
+
+    ApproxSlot* slots;
+    size_t used;
+    uint32_t* heap;
+    uint32_t* map;
+    size_t map_cap;
+
+    uint64_t* cm;
+
+    uint64_t total_tokens;
+    uint64_t long_terms;
+};
+
+struct ApproxRow {
+    const unsigned char* term;
+    size_t len;
+    uint64_t freq;
+    uint64_t lower;
+    uint64_t upper;
+};
+
+bool approx_init(ApproxCounter* a, const ApproxConfig* cfg);
+void approx_add(ApproxCounter* a, const unsigned char* s, size_t n, uint64_t h);
+bool approx_add_file(ApproxCounter* a, const char* tok_path);
+void approx_free(ApproxCounter* a);
+
+size_t approx_bytes(const ApproxConfig* cfg);
+double approx_eps(const ApproxCounter* a);
+double approx_delta(const ApproxCounter* a);
+
+// Reported terms by estimated frequency (descending, ties by term bytes).
+std::vector<ApproxRow> approx_top(const ApproxCounter* a);
+
+bool save_terms_approx_tsv(const char* path, const std::vector<ApproxRow>& rows);
+bool save_zipf_approx_tsv(const char* path, const std::vector<ApproxRow>& rows);
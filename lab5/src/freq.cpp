@@ -1,52 +1,259 @@
 #include "freq.h"
+#include "win_files.h"
+#include "paths.h"
+#include "tok_lines.h"
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
-static bool read_line(FILE* f, std::string& out) {
-    out.clear();
-    int c;
-    while ((c = std::fgetc(f)) != EOF) {
-        if (c == '\r') continue;
-        if (c == '\n') break;
-        out.push_back((char)c);
-    }
-    if (c == EOF && out.empty()) return false;
-    return true;
+bool freq_init(FreqResult& fr) {
+    fr.total_tokens = 0;
+    return term_counter_init(&fr.terms);
+}
+
+void freq_free(FreqResult& fr) {
+    term_counter_free(&fr.terms);
 }
 
 bool freq_add_file(FreqResult& fr, const char* tok_path) {
-    FILE* f = std::fopen(tok_path, "rb");
-    if (!f) return false;
-
-    std::string line;
-    while (read_line(f, line)) {
-        if (line.empty()) continue;
-        auto it = fr.term2cnt.find(line);
-        if (it == fr.term2cnt.end()) fr.term2cnt.emplace(line, 1ULL);
-        else it->second += 1ULL;
+    MappedFile mf;
+    if (!map_file(tok_path, &mf)) return false;
+
+    TermCounter* tc = &fr.terms;
+    uint64_t tokens = 0;
+    bool ok = for_each_tok_line(mf.data, mf.size, [&](const unsigned char* t, size_t len, uint64_t h) {
+        tokens++;
+        return term_counter_add_hashed(tc, t, len, h, 1ULL, nullptr);
+    });
+    fr.total_tokens += tokens;
+
+    unmap_file(&mf);
+    return ok;
+}
+
+static const size_t FREQ_SHARDS = 64;
+
+static size_t shard_of(uint64_t h) {
+    return (size_t)(((h >> 32) * FREQ_SHARDS) >> 32);
+}
+
+struct CountWorker {
+    FreqResult fr;
+    std::vector<uint32_t> first_file;
+    std::vector<uint32_t> by_shard[FREQ_SHARDS];
+    uint64_t files_ok;
+    uint64_t files_fail;
+    bool ok;
+};
+
+// Terms of one hash shard from all workers. first[id] is the smallest
+// (file index << 32 | worker-local id) seen for the term: files are handed
+// out in increasing order and each goes to one worker, so this key orders
+// terms exactly as a serial pass over `paths` would first meet them.
+struct MergeShard {
+    TermCounter terms;
+    std::vector<uint64_t> first;
+    bool ok;
+};
+
+struct FirstSeen {
+    uint64_t key;
+    uint32_t shard;
+    uint32_t id;
+};
+
+static void count_files(CountWorker* w, const std::vector<std::string>* paths, std::atomic<size_t>* next) {
+    for (;;) {
+        size_t i = next->fetch_add(1);
+        if (i >= paths->size()) break;
+        if (freq_add_file(w->fr, (*paths)[i].c_str())) w->files_ok++;
+        else w->files_fail++;
+        w->first_file.resize(w->fr.terms.size, (uint32_t)i);
+    }
+    const TermCounter* t = &w->fr.terms;
+    for (size_t id = 0; id < t->size; ++id) w->by_shard[shard_of(t->hash[id])].push_back((uint32_t)id);
+}
+
+static void merge_shard(MergeShard* m, size_t shard, CountWorker* workers, size_t nw) {
+    m->ok = term_counter_init(&m->terms);
+    for (size_t k = 0; k < nw && m->ok; ++k) {
+        const TermCounter* t = &workers[k].fr.terms;
+        for (uint32_t id : workers[k].by_shard[shard]) {
+            uint32_t sid;
+            size_t n;
+            const unsigned char* s = term_counter_str(t, id, &n);
+            if (!term_counter_add_hashed(&m->terms, s, n, t->hash[id], t->count[id], &sid)) {
+                m->ok = false;
+                break;
+            }
+            uint64_t key = ((uint64_t)workers[k].first_file[id] << 32) | id;
+            if (sid == m->first.size()) m->first.push_back(key);
+            else if (key < m->first[sid]) m->first[sid] = key;
+        }
+    }
+}
+
+bool freq_add_files_parallel(FreqResult& fr, const std::vector<std::string>& paths, size_t threads,
+                             FreqFileStats* st) {
+    if (threads == 0) threads = 1;
+    CountWorker* workers = new CountWorker[threads];
+    bool ok = true;
+    for (size_t k = 0; k < threads; ++k) {
+        workers[k].files_ok = 0;
+        workers[k].files_fail = 0;
+        if (!freq_init(workers[k].fr)) ok = false;
+    }
+
+    if (ok) {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+        for (size_t k = 0; k < threads; ++k) pool.emplace_back(count_files, &workers[k], &paths, &next);
+        for (auto& th : pool) th.join();
+
+        MergeShard* shards = new MergeShard[FREQ_SHARDS];
+        std::atomic<size_t> next_shard(0);
+        pool.clear();
+        for (size_t k = 0; k < threads; ++k) {
+            pool.emplace_back([&] {
+                for (size_t sh; (sh = next_shard.fetch_add(1)) < FREQ_SHARDS;) merge_shard(&shards[sh], sh, workers, threads);
+            });
+        }
+        for (auto& th : pool) th.join();
+
+        std::vector<FirstSeen> order;
+        for (size_t sh = 0; sh < FREQ_SHARDS; ++sh) {
+            if (!shards[sh].ok) ok = false;
+            for (size_t id = 0; id < shards[sh].first.size(); ++id) {
+                order.push_back({shards[sh].first[id], (uint32_t)sh, (uint32_t)id});
+            }
+        }
+        std::sort(order.begin(), order.end(), [](const FirstSeen& a, const FirstSeen& b) { return a.key < b.key; });
+
+        for (size_t i = 0; i < order.size() && ok; ++i) {
+            const TermCounter* t = &shards[order[i].shard].terms;
+            uint32_t id = order[i].id;
+            size_t n;
+            const unsigned char* s = term_counter_str(t, id, &n);
+            ok = term_counter_add_hashed(&fr.terms, s, n, t->hash[id], t->count[id], nullptr);
+        }
+        for (size_t sh = 0; sh < FREQ_SHARDS; ++sh) term_counter_free(&shards[sh].terms);
+        delete[] shards;
+    }
+
+    for (size_t k = 0; k < threads; ++k) {
+        fr.total_tokens += workers[k].fr.total_tokens;
+        if (st) {
+            st->files_ok += workers[k].files_ok;
+            st->files_fail += workers[k].files_fail;
+        }
+        freq_free(workers[k].fr);
+    }
+    delete[] workers;
+    return ok;
+}
+
+static TidDir* tid_dir_for(TidCounter& tc, const char* tid_path) {
+    const char* slash = nullptr;
+    for (const char* p = tid_path; *p; ++p) {
+        if (*p == '\\' || *p == '/') slash = p;
+    }
+    std::string dir = (slash ? std::string(tid_path, (size_t)(slash - tid_path)) : std::string("."));
+
+    for (size_t i = tc.dirs.size(); i > 0; --i) {
+        if (tc.dirs[i - 1]->dir == dir) return tc.dirs[i - 1];
+    }
+
+    char dict_path[1024];
+    join_path(dict_path, sizeof(dict_path), dir.c_str(), TERM_IDS_DICT_NAME);
+    TidDir* d = new TidDir();
+    d->dir = dir;
+    if (!term_ids_load(&d->ids, dict_path)) {
+        std::fprintf(stderr, "Cannot load term dictionary: %s\n", dict_path);
+        term_ids_free(&d->ids);
+        delete d;
+        return nullptr;
+    }
+    d->counts.assign(d->ids.size, 0);
+    tc.dirs.push_back(d);
+    return d;
+}
+
+bool freq_add_tid_file(FreqResult& fr, TidCounter& tc, const char* tid_path) {
+    TidDir* d = tid_dir_for(tc, tid_path);
+    if (!d) return false;
+
+    MappedFile mf;
+    if (!map_file(tid_path, &mf)) return false;
+
+    const unsigned char* s = mf.data;
+    size_t n = mf.size, pos = 0;
+    uint64_t* counts = d->counts.data();
+    size_t terms = d->counts.size();
+    uint32_t id;
+    bool ok = true;
+    while (varint_get(s, n, &pos, &id)) {
+        if (id >= terms) { ok = false; break; }
+        counts[id] += 1ULL;
         fr.total_tokens += 1ULL;
     }
+    unmap_file(&mf);
+    return ok && pos == n;
+}
 
-    std::fclose(f);
-    return true;
+// Folds per-directory id counts into fr.terms, keyed by term text.
+bool freq_merge_tid(FreqResult& fr, TidCounter& tc) {
+    bool ok = true;
+    for (TidDir* d : tc.dirs) {
+        for (size_t id = 0; id < d->counts.size() && ok; ++id) {
+            if (d->counts[id] == 0) continue;
+            size_t n;
+            const unsigned char* s = term_ids_str(&d->ids, (uint32_t)id, &n);
+            ok = term_counter_add(&fr.terms, s, n, d->counts[id]);
+        }
+        term_ids_free(&d->ids);
+        delete d;
+    }
+    tc.dirs.clear();
+    return ok;
 }
 
+// LSD radix sort on count bytes, descending. A pass whose byte is the same
+// for every count is skipped, so typical counts take two or three passes.
 std::vector<uint64_t> freq_sorted_counts_desc(const FreqResult& fr) {
-    std::vector<uint64_t> v;
-    v.reserve(fr.term2cnt.size());
-    for (const auto& kv : fr.term2cnt) v.push_back(kv.second);
-    std::sort(v.begin(), v.end(), [](uint64_t a, uint64_t b){ return a > b; });
-    return v;
+    size_t n = fr.terms.size;
+    std::vector<uint64_t> a(fr.terms.count, fr.terms.count + n);
+    std::vector<uint64_t> b(n);
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t hist[256] = {0};
+        for (size_t i = 0; i < n; ++i) hist[255 - ((a[i] >> shift) & 0xFF)]++;
+        bool trivial = false;
+        for (size_t d = 0; d < 256; ++d) {
+            if (hist[d] == n) trivial = true;
+        }
+        if (trivial) continue;
+        size_t pos = 0;
+        for (size_t d = 0; d < 256; ++d) {
+            size_t c = hist[d];
+            hist[d] = pos;
+            pos += c;
+        }
+        for (size_t i = 0; i < n; ++i) b[hist[255 - ((a[i] >> shift) & 0xFF)]++] = a[i];
+        a.swap(b);
+    }
+    return a;
 }
 
 bool save_terms_tsv(const char* path, const FreqResult& fr) {
     FILE* out = std::fopen(path, "wb");
     if (!out) return false;
     std::fprintf(out, "term\tcount\n");
-    for (const auto& kv : fr.term2cnt) {
-        std::fwrite(kv.first.data(), 1, kv.first.size(), out);
-        std::fprintf(out, "\t%llu\n", (unsigned long long)kv.second);
+    for (size_t id = 0; id < fr.terms.size; ++id) {
+        size_t n;
+        const unsigned char* s = term_counter_str(&fr.terms, (uint32_t)id, &n);
+        std::fwrite(s, 1, n, out);
+        std::fprintf(out, "\t%llu\n", (unsigned long long)fr.terms.count[id]);
     }
     std::fclose(out);
     return true;
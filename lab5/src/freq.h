@@ -2,15 +2,42 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
-#include <unordered_map>
 #include <vector>
+#include "term_ids.h"
+#include "term_counter.h"
 
 struct FreqResult {
-    std::unordered_map<std::string, uint64_t> term2cnt;
+    TermCounter terms;
     uint64_t total_tokens;
 };
 
+// Counts for .tid files sharing one terms.dict (one tokenizer output dir).
+struct TidDir {
+    std::string dir;
+    TermIds ids;
+    std::vector<uint64_t> counts;
+};
+
+struct TidCounter {
+    std::vector<TidDir*> dirs;
+};
+
+bool freq_init(FreqResult& fr);
+void freq_free(FreqResult& fr);
 bool freq_add_file(FreqResult& fr, const char* tok_path);
+struct FreqFileStats {
+    uint64_t files_ok;
+    uint64_t files_fail;
+};
+
+// Counts .tok files on `threads` workers, each into a private table, then
+// merges the tables in 64 hash shards in parallel. fr must be empty; the
+// result, including the first-seen term order, equals counting `paths`
+// serially with freq_add_file.
+bool freq_add_files_parallel(FreqResult& fr, const std::vector<std::string>& paths, size_t threads,
+                             FreqFileStats* st);
+bool freq_add_tid_file(FreqResult& fr, TidCounter& tc, const char* tid_path);
+bool freq_merge_tid(FreqResult& fr, TidCounter& tc);
 std::vector<uint64_t> freq_sorted_counts_desc(const FreqResult& fr);
 bool save_terms_tsv(const char* path, const FreqResult& fr);
 bool save_zipf_tsv(const char* path, const std::vector<uint64_t>& counts_desc);
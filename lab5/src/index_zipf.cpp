@@ -0,0 +1,120 @@
+#include "win_files.h"
+#include "freq.h"
+#include <cstdio>
+#include <cstring>
+
+// Dictionary entries written by lab6 indexer.exe with this flag carry the
+// collection frequency in their last u32.
+static const uint32_t IDX_FLAG_CF = 0x4;
+
+static uint32_t rd_u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t rd_u64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static void usage() {
+    std::fprintf(stderr,
+        "Usage:\n"
+        "  index_zipf.exe <index_bin> <out_zipf_tsv> <out_terms_tsv>\n"
+        "  Builds the zipf/terms tables from the collection frequencies stored in the\n"
+        "  dictionary of an index.bin (lab6 indexer.exe), without reading any tokens.\n"
+        "Example:\n"
+        "  index_zipf.exe ..\\lab6\\index\\index.bin out\\zipf_index.tsv out\\terms_index.tsv\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        usage();
+        return 2;
+    }
+    const char* index_path = argv[1];
+    const char* out_zipf = argv[2];
+    const char* out_terms = argv[3];
+
+    MappedFile mf;
+    if (!map_file(index_path, &mf)) {
+        std::fprintf(stderr, "Cannot open index: %s\n", index_path);
+        return 1;
+    }
+    const unsigned char* b = mf.data;
+    size_t n = mf.size;
+    if (n < 128 || std::memcmp(b, "MAIIRIDX", 8) != 0) {
+        std::fprintf(stderr, "Not an index file: %s\n", index_path);
+        unmap_file(&mf);
+        return 1;
+    }
+    uint32_t version = rd_u32(b + 8);
+    uint32_t flags = rd_u32(b + 12);
+    if (version != 2 || !(flags & IDX_FLAG_CF)) {
+        std::fprintf(stderr, "Index has no collection frequencies (version=%u flags=0x%x); rebuild it with indexer.exe\n",
+                     version, flags);
+        unmap_file(&mf);
+        return 1;
+    }
+    uint64_t terms_count = rd_u64(b + 24);
+    uint64_t dict_offset = rd_u64(b + 32);
+    uint64_t dict_bytes = rd_u64(b + 40);
+    uint64_t total_tokens = rd_u64(b + 80);
+    if (dict_offset > n || dict_bytes > n - dict_offset) {
+        std::fprintf(stderr, "Corrupt index header: %s\n", index_path);
+        unmap_file(&mf);
+        return 1;
+    }
+
+    FreqResult fr;
+    if (!freq_init(fr)) {
+        std::fprintf(stderr, "Out of memory\n");
+        unmap_file(&mf);
+        return 1;
+    }
+    fr.total_tokens = total_tokens;
+
+    uint64_t off = dict_offset, end = dict_offset + dict_bytes;
+    uint64_t saturated = 0;
+    bool ok = true;
+    for (uint64_t i = 0; i < terms_count && ok; ++i) {
+        if (end - off < 4) { ok = false; break; }
+        uint32_t len = rd_u32(b + off);
+        if (end - off < 4ULL + len + 16ULL) { ok = false; break; }
+        const unsigned char* term = b + off + 4;
+        uint32_t cf = rd_u32(b + off + 4 + len + 12);
+        if (cf == 0xFFFFFFFFu) saturated++;
+        ok = term_counter_add(&fr.terms, term, len, cf);
+        off += 4ULL + len + 16ULL;
+    }
+    unmap_file(&mf);
+    if (!ok) {
+        std::fprintf(stderr, "Corrupt dictionary in: %s\n", index_path);
+        freq_free(fr);
+        return 1;
+    }
+
+    auto counts = freq_sorted_counts_desc(fr);
+    if (!save_terms_tsv(out_terms, fr)) {
+        std::fprintf(stderr, "Cannot write terms file: %s\n", out_terms);
+        freq_free(fr);
+        return 1;
+    }
+    if (!save_zipf_tsv(out_zipf, counts)) {
+        std::fprintf(stderr, "Cannot write zipf file: %s\n", out_zipf);
+        freq_free(fr);
+        return 1;
+    }
+
+    std::fprintf(stderr, "Done. unique_terms=%zu total_tokens=%llu\n",
+                 fr.terms.size, (unsigned long long)fr.total_tokens);
+    if (saturated) {
+        std::fprintf(stderr, "Warning: %llu terms have frequencies above 2^32-1 and are clipped\n",
+                     (unsigned long long)saturated);
+    }
+
+    freq_free(fr);
+    return 0;
+}
@@ -1,10 +1,18 @@
 #include "win_files.h"
 #include "freq.h"
+#include "approx.h"
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
 
 struct Ctx {
     FreqResult* fr;
+    TidCounter* tc;
+    std::vector<std::string>* paths;
     unsigned long long files_ok;
     unsigned long long files_fail;
 };
@@ -12,50 +20,176 @@ struct Ctx {
 static void on_tok(const char* full_path, const char* rel_path, void* user) {
     (void)rel_path;
     Ctx* ctx = (Ctx*)user;
-    if (freq_add_file(*ctx->fr, full_path)) ctx->files_ok++;
+    if (ctx->paths) {
+        ctx->paths->push_back(full_path);
+        return;
+    }
+    bool ok = (ctx->tc ? freq_add_tid_file(*ctx->fr, *ctx->tc, full_path) : freq_add_file(*ctx->fr, full_path));
+    if (ok) ctx->files_ok++;
     else ctx->files_fail++;
     if ((ctx->files_ok + ctx->files_fail) % 2000ULL == 0ULL) {
         std::fprintf(stderr, "[prog] files=%llu ok=%llu fail=%llu terms=%zu tokens=%llu\n",
                      (unsigned long long)(ctx->files_ok + ctx->files_fail),
                      (unsigned long long)ctx->files_ok,
                      (unsigned long long)ctx->files_fail,
-                     ctx->fr->term2cnt.size(),
+                     ctx->fr->terms.size,
                      (unsigned long long)ctx->fr->total_tokens);
     }
 }
 
+struct ApproxCtx {
+    ApproxCounter* ac;
+    unsigned long long files_ok;
+    unsigned long long files_fail;
+};
+
+static void on_tok_approx(const char* full_path, const char* rel_path, void* user) {
+    (void)rel_path;
+    ApproxCtx* ctx = (ApproxCtx*)user;
+    if (approx_add_file(ctx->ac, full_path)) ctx->files_ok++;
+    else ctx->files_fail++;
+}
+
+static int run_approx(const char* tokens_root, const char* out_zipf, const char* out_terms, const ApproxConfig* cfg) {
+    ApproxCounter ac;
+    if (!approx_init(&ac, cfg)) {
+        std::fprintf(stderr, "Cannot allocate approximate counters (%zu bytes)\n", approx_bytes(cfg));
+        return 1;
+    }
+
+    ApproxCtx ctx = {&ac, 0, 0};
+    if (!list_tok_files_rec(tokens_root, on_tok_approx, &ctx)) {
+        std::fprintf(stderr, "Failed to enumerate token files in: %s\n", tokens_root);
+        approx_free(&ac);
+        return 1;
+    }
+
+    std::vector<ApproxRow> rows = approx_top(&ac);
+    if (!save_terms_approx_tsv(out_terms, rows)) {
+        std::fprintf(stderr, "Cannot write terms file: %s\n", out_terms);
+        approx_free(&ac);
+        return 1;
+    }
+    if (!save_zipf_approx_tsv(out_zipf, rows)) {
+        std::fprintf(stderr, "Cannot write zipf file: %s\n", out_zipf);
+        approx_free(&ac);
+        return 1;
+    }
+
+    uint64_t n = ac.total_tokens;
+    uint64_t ss_err = (ac.used == ac.cfg.top_k ? ac.slots[ac.heap[0]].count : 0);
+    std::fprintf(stderr, "Done. files_ok=%llu files_fail=%llu reported_terms=%zu total_tokens=%llu\n",
+                 ctx.files_ok, ctx.files_fail, rows.size(), (unsigned long long)n);
+    std::fprintf(stderr, "Approx: memory=%zu bytes top_k=%zu cm=%zux%zu long_terms=%llu\n",
+                 approx_bytes(&ac.cfg), ac.cfg.top_k, ac.cfg.cm_depth, ac.cfg.cm_width,
+                 (unsigned long long)ac.long_terms);
+    std::fprintf(stderr, "Bounds: space-saving overcount <= %llu (every term above N/k=%llu is listed); "
+                 "count-min overcount <= %.0f (eps=%.3g) with probability %.6f\n",
+                 (unsigned long long)ss_err, (unsigned long long)(n / ac.cfg.top_k),
+                 std::ceil(approx_eps(&ac) * (double)n), approx_eps(&ac), 1.0 - approx_delta(&ac));
+
+    approx_free(&ac);
+    return 0;
+}
+
 static void usage() {
     std::fprintf(stderr,
         "Usage:\n"
         "  zipf.exe <tokens_root_dir> <out_zipf_tsv> <out_terms_tsv>\n"
+        "  zipf.exe --tid <tid_root_dir> <out_zipf_tsv> <out_terms_tsv>\n"
+        "  (--tid reads .tid files and the terms.dict next to them, see tokenize.exe --tid)\n"
+        "  --threads=N counts .tok files on N threads (default: one per core, up to 8)\n"
+        "  --approx keeps only the top-K terms (Space-Saving) and a Count-Min sketch in fixed\n"
+        "           memory; the outputs get lower/upper bound columns. Sizes:\n"
+        "           --top-k=K (default 10000) --cm-width=W (default 262144) --cm-depth=D (default 4)\n"
         "Example:\n"
         "  zipf.exe out\\tokens out\\zipf_raw.tsv out\\terms_raw.tsv\n"
         "  zipf.exe out\\stem_tokens out\\zipf_stem.tsv out\\terms_stem.tsv\n");
 }
 
 int main(int argc, char** argv) {
-    if (argc != 4) {
+    bool tid = false;
+    size_t threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > 8) threads = 8;
+
+    bool approx = false;
+    ApproxConfig acfg = {10000, (size_t)1 << 18, 4};
+
+    int ai = 1;
+    while (ai < argc && std::strncmp(argv[ai], "--", 2) == 0) {
+        if (std::strcmp(argv[ai], "--tid") == 0) {
+            tid = true;
+        } else if (std::strncmp(argv[ai], "--threads=", 10) == 0) {
+            int v = std::atoi(argv[ai] + 10);
+            if (v < 1 || v > 256) {
+                usage();
+                return 2;
+            }
+            threads = (size_t)v;
+        } else if (std::strcmp(argv[ai], "--approx") == 0) {
+            approx = true;
+        } else if (std::strncmp(argv[ai], "--top-k=", 8) == 0) {
+            acfg.top_k = (size_t)std::strtoull(argv[ai] + 8, nullptr, 10);
+        } else if (std::strncmp(argv[ai], "--cm-width=", 11) == 0) {
+            acfg.cm_width = (size_t)std::strtoull(argv[ai] + 11, nullptr, 10);
+        } else if (std::strncmp(argv[ai], "--cm-depth=", 11) == 0) {
+            acfg.cm_depth = (size_t)std::strtoull(argv[ai] + 11, nullptr, 10);
+        } else {
+            usage();
+            return 2;
+        }
+        ai++;
+    }
+    if (argc - ai != 3) {
         usage();
         return 2;
     }
 
-    const char* tokens_root = argv[1];
-    const char* out_zipf = argv[2];
-    const char* out_terms = argv[3];
+    const char* tokens_root = argv[ai];
+    const char* out_zipf = argv[ai + 1];
+    const char* out_terms = argv[ai + 2];
+
+    if (approx) {
+        if (tid || acfg.top_k == 0 || acfg.cm_width == 0 || acfg.cm_depth == 0 || acfg.cm_depth > 32) {
+            usage();
+            return 2;
+        }
+        return run_approx(tokens_root, out_zipf, out_terms, &acfg);
+    }
 
     FreqResult fr;
-    fr.total_tokens = 0;
+    if (!freq_init(fr)) {
+        std::fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    TidCounter tc;
+    std::vector<std::string> paths;
+    bool parallel = (!tid && threads > 1);
 
     Ctx ctx;
     ctx.fr = &fr;
+    ctx.tc = (tid ? &tc : nullptr);
+    ctx.paths = (parallel ? &paths : nullptr);
     ctx.files_ok = 0;
     ctx.files_fail = 0;
 
-    bool ok = list_tok_files_rec(tokens_root, on_tok, &ctx);
+    bool ok = (tid ? list_tid_files_rec(tokens_root, on_tok, &ctx) : list_tok_files_rec(tokens_root, on_tok, &ctx));
     if (!ok) {
         std::fprintf(stderr, "Failed to enumerate token files in: %s\n", tokens_root);
         return 1;
     }
+    if (tid) freq_merge_tid(fr, tc);
+    if (parallel) {
+        FreqFileStats fs = {0, 0};
+        if (!freq_add_files_parallel(fr, paths, threads, &fs)) {
+            std::fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        ctx.files_ok = fs.files_ok;
+        ctx.files_fail = fs.files_fail;
+    }
 
     auto counts = freq_sorted_counts_desc(fr);
 
@@ -71,8 +205,9 @@ int main(int argc, char** argv) {
     std::fprintf(stderr, "Done. files_ok=%llu files_fail=%llu unique_terms=%zu total_tokens=%llu\n",
                  (unsigned long long)ctx.files_ok,
                  (unsigned long long)ctx.files_fail,
-                 fr.term2cnt.size(),
+                 fr.terms.size,
                  (unsigned long long)fr.total_tokens);
 
+    freq_free(fr);
     return 0;
 }
@@ -0,0 +1,91 @@
+#include "term_counter.h"
+#include <cstdlib>
+#include <cstring>
+
+bool term_counter_init(TermCounter* t) {
+    std::memset(t, 0, sizeof(*t));
+    return term_table_init(&t->index, (size_t)1 << 16);
+}
+
+// Pool records are (u32 len, u32 id, bytes); the index maps terms to record
+// offsets, so a hit reads one record and then the count.
+static const size_t REC_HDR = 8;
+
+static uint32_t rec_u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static bool add_term(TermCounter* t, const unsigned char* s, size_t n, uint64_t h, uint64_t by) {
+    if (t->size == t->ids_cap) {
+        size_t nc = (t->ids_cap == 0 ? 65536 : t->ids_cap * 2);
+        uint64_t* nh = (uint64_t*)std::realloc(t->hash, nc * sizeof(uint64_t));
+        if (!nh) return false;
+        t->hash = nh;
+        uint32_t* no = (uint32_t*)std::realloc(t->off, nc * sizeof(uint32_t));
+        if (!no) return false;
+        t->off = no;
+        uint32_t* nl = (uint32_t*)std::realloc(t->len, nc * sizeof(uint32_t));
+        if (!nl) return false;
+        t->len = nl;
+        uint64_t* nn = (uint64_t*)std::realloc(t->count, nc * sizeof(uint64_t));
+        if (!nn) return false;
+        t->count = nn;
+        t->ids_cap = nc;
+    }
+    if (t->pool_len + REC_HDR + n > t->pool_cap) {
+        size_t nc = (t->pool_cap == 0 ? (1u << 20) : t->pool_cap);
+        while (nc < t->pool_len + REC_HDR + n) nc *= 2;
+        unsigned char* np = (unsigned char*)std::realloc(t->pool, nc);
+        if (!np) return false;
+        t->pool = np;
+        t->pool_cap = nc;
+    }
+    uint32_t hdr[2] = {(uint32_t)n, (uint32_t)t->size};
+    std::memcpy(t->pool + t->pool_len, hdr, REC_HDR);
+    if (n > 0) std::memcpy(t->pool + t->pool_len + REC_HDR, s, n);
+    t->hash[t->size] = h;
+    t->off[t->size] = (uint32_t)(t->pool_len + REC_HDR);
+    t->len[t->size] = (uint32_t)n;
+    t->count[t->size] = by;
+    t->pool_len += REC_HDR + n;
+    t->size++;
+    return true;
+}
+
+bool term_counter_add_hashed(TermCounter* t, const unsigned char* s, size_t n, uint64_t h, uint64_t by,
+                             uint32_t* out_id) {
+    const unsigned char* pool = t->pool;
+    const uint64_t* hashes = t->hash;
+    if (!term_table_reserve(&t->index, t->size + 1,
+                            [&](uint32_t rec) { return hashes[rec_u32(pool + rec + 4)]; })) {
+        return false;
+    }
+    if (t->pool_len + REC_HDR + n > 0xFFFFFFFFULL) return false;
+
+    uint32_t new_rec = (uint32_t)t->pool_len;
+    uint32_t rec = term_table_find_or_insert(&t->index, h, new_rec, [&](uint32_t r) {
+        return rec_u32(pool + r) == (uint32_t)n && std::memcmp(pool + r + REC_HDR, s, n) == 0;
+    });
+    uint32_t id;
+    if (rec == new_rec) {
+        id = (uint32_t)t->size;
+        if (!add_term(t, s, n, h, by)) return false;
+    } else {
+        id = rec_u32(pool + rec + 4);
+        t->count[id] += by;
+    }
+    if (out_id) *out_id = id;
+    return true;
+}
+
+void term_counter_free(TermCounter* t) {
+    term_table_free(&t->index);
+    std::free(t->hash);
+    std::free(t->off);
+    std::free(t->len);
+    std::free(t->count);
+    std::free(t->pool);
+    std::memset(t, 0, sizeof(*t));
+}
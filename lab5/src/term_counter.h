@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "term_table.h"
+
+// Term -> count table for zipf. A TermTable maps term bytes to ids, which
+// follow first appearance; per-id arrays hold the hash, the term's place in a
+// single bump pool and its count.
+struct TermCounter {
+    TermTable index;
+
+    uint64_t* hash;
+    uint32_t* off;
+    uint32_t* len;
+    uint64_t* count;
+    size_t size;
+    size_t ids_cap;
+
+    unsigned char* pool;
+    size_t pool_len;
+    size_t pool_cap;
+};
+
+bool term_counter_init(TermCounter* t);
+// out_id, when not null, receives the term's id.
+bool term_counter_add_hashed(TermCounter* t, const unsigned char* s, size_t n, uint64_t h, uint64_t by,
+                             uint32_t* out_id);
+void term_counter_free(TermCounter* t);
+
+inline bool term_counter_add(TermCounter* t, const unsigned char* s, size_t n, uint64_t by) {
+    return term_counter_add_hashed(t, s, n, term_hash(s, n), by, nullptr);
+}
+inline const unsigned char* term_counter_str(const TermCounter* t, uint32_t id, size_t* n) {
+    *n = t->len[id];
+    return t->pool + t->off[id];
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TERM_TABLE_SSE2 1
+#endif
+
+// Term hash, eight bytes per step; a partial last word is zero-padded and
+// the length goes in at the end, so a scanner can hash a line as it looks
+// for its end (see tok_lines.h). The final mix spreads every input bit over
+// both halves, since TermTable takes its tag from the low bits and the group
+// from the high ones.
+static const uint64_t TERM_HASH_SEED = 0x243F6A8885A308D3ULL;
+static const uint64_t TERM_HASH_MUL = 0x9E3779B97F4A7C15ULL;
+
+inline uint64_t term_hash_step(uint64_t h, uint64_t w) {
+    h = (h ^ w) * TERM_HASH_MUL;
+    return h ^ (h >> 29);
+}
+
+inline uint64_t term_hash_finish(uint64_t h, size_t n) {
+    h = (h ^ (uint64_t)n) * TERM_HASH_MUL;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t term_hash(const unsigned char* s, size_t n) {
+    uint64_t h = TERM_HASH_SEED;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, s + i, 8);
+        h = term_hash_step(h, w);
+    }
+    if (i < n) {
+        uint64_t w = 0;
+        std::memcpy(&w, s + i, n - i);
+        h = term_hash_step(h, w);
+    }
+    return term_hash_finish(h, n);
+}
+
+// Hash index from terms to 32-bit handles, laid out like a Swiss table: slots
+// come in groups of 16, each group holding 16 control bytes (TERM_TABLE_EMPTY,
+// or the low 7 bits of the hash) followed by the 16 handles, so one probe is
+// one or two cache lines. The control bytes are compared with the tag in one
+// SSE2 step and the term itself is only looked at on a tag match. Terms live
+// with the caller, which passes an equality test for handles; there is no
+// removal, only clear.
+struct TermGroup {
+    uint8_t ctrl[16];
+    uint32_t ids[16];
+};
+
+struct TermTable {
+    TermGroup* groups;
+    size_t cap;
+    size_t size;
+};
+
+static const uint8_t TERM_TABLE_EMPTY = 0x80;
+static const size_t TERM_TABLE_GROUP = 16;
+
+inline void term_table_clear(TermTable* t) {
+    for (size_t g = 0; g < t->cap / TERM_TABLE_GROUP; ++g) {
+        std::memset(t->groups[g].ctrl, TERM_TABLE_EMPTY, TERM_TABLE_GROUP);
+    }
+    t->size = 0;
+}
+
+inline bool term_table_init(TermTable* t, size_t cap) {
+    size_t c = TERM_TABLE_GROUP;
+    while (c < cap) c *= 2;
+    t->groups = (TermGroup*)std::malloc(c / TERM_TABLE_GROUP * sizeof(TermGroup));
+    if (!t->groups) return false;
+    t->cap = c;
+    term_table_clear(t);
+    return true;
+}
+
+inline void term_table_free(TermTable* t) {
+    std::free(t->groups);
+    std::memset(t, 0, sizeof(*t));
+}
+
+// Bit i set where group byte i equals b.
+inline uint32_t term_table_match(const uint8_t* g, uint8_t b) {
+#ifdef TERM_TABLE_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i*)g);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)b)));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < TERM_TABLE_GROUP; ++i) m |= (uint32_t)(g[i] == b) << i;
+    return m;
+#endif
+}
+
+inline size_t term_table_group(const TermTable* t, uint64_t h) {
+    return (size_t)(h >> 32) & ((t->cap / TERM_TABLE_GROUP) - 1);
+}
+
+// Triangular probing over a power-of-two number of groups visits each once.
+inline size_t term_table_next(const TermTable* t, size_t g, size_t step) {
+    return (g + step) & ((t->cap / TERM_TABLE_GROUP) - 1);
+}
+
+inline void term_table_put(TermTable* t, TermGroup* g, uint32_t empty_mask, uint64_t h, uint32_t id) {
+    unsigned i = (unsigned)__builtin_ctz(empty_mask);
+    g->ctrl[i] = (uint8_t)(h & 0x7F);
+    g->ids[i] = id;
+    t->size++;
+}
+
+// Returns the handle under hash h for which eq(handle) holds; otherwise
+// stores new_id and returns it. The caller makes room first with
+// term_table_reserve.
+template <typename Eq>
+inline uint32_t term_table_find_or_insert(TermTable* t, uint64_t h, uint32_t new_id, Eq eq) {
+    uint8_t tag = (uint8_t)(h & 0x7F);
+    size_t gi = term_table_group(t, h);
+    for (size_t step = 1;; ++step) {
+        TermGroup* g = &t->groups[gi];
+        for (uint32_t m = term_table_match(g->ctrl, tag); m; m &= m - 1) {
+            uint32_t id = g->ids[__builtin_ctz(m)];
+            if (eq(id)) return id;
+        }
+        uint32_t e = term_table_match(g->ctrl, TERM_TABLE_EMPTY);
+        if (e) {
+            term_table_put(t, g, e, h, new_id);
+            return new_id;
+        }
+        gi = term_table_next(t, gi, step);
+    }
+}
+
+// Grows the table (load factor 7/8) so that `need` handles fit; hash_of(id)
+// gives back the hash each handle was inserted with.
+template <typename HashOf>
+inline bool term_table_reserve(TermTable* t, size_t need, HashOf hash_of) {
+    if (need * 8 <= t->cap * 7) return true;
+    size_t nc = t->cap * 2;
+    while (need * 8 > nc * 7) nc *= 2;
+
+    TermTable old = *t;
+    if (!term_table_init(t, nc)) {
+        *t = old;
+        return false;
+    }
+    for (size_t og = 0; og < old.cap / TERM_TABLE_GROUP; ++og) {
+        const TermGroup* src = &old.groups[og];
+        for (size_t i = 0; i < TERM_TABLE_GROUP; ++i) {
+            if (src->ctrl[i] == TERM_TABLE_EMPTY) continue;
+            uint64_t h = hash_of(src->ids[i]);
+            size_t gi = term_table_group(t, h);
+            for (size_t step = 1;; ++step) {
+                TermGroup* g = &t->groups[gi];
+                uint32_t e = term_table_match(g->ctrl, TERM_TABLE_EMPTY);
+                if (e) {
+                    term_table_put(t, g, e, h, src->ids[i]);
+                    break;
+                }
+                gi = term_table_next(t, gi, step);
+            }
+        }
+    }
+    term_table_free(&old);
+    return true;
+}
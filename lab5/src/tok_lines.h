@@ -0,0 +1,60 @@
+#pragma once
+#include "term_counter.h"
+#include <cstring>
+#include <vector>
+
+// Calls fn(term, len, hash) for every non-empty line of a .tok buffer. Lines
+// are hashed eight bytes at a time while the newline is found with a
+// zero-byte test on the same words, so terms go to the table straight from
+// the buffer. '\r' anywhere in a line is dropped, as the old fgetc reader
+// did. Stops and returns false when fn does.
+template <typename Fn>
+bool for_each_tok_line(const unsigned char* s, size_t n, Fn fn) {
+    bool has_cr = (n > 0 && std::memchr(s, '\r', n) != nullptr);
+    std::vector<unsigned char> tmp;
+    size_t i = 0;
+    while (i < n) {
+        size_t start = i;
+        uint64_t h = TERM_HASH_SEED;
+        while (i + 8 <= n) {
+            uint64_t w;
+            std::memcpy(&w, s + i, 8);
+            uint64_t x = w ^ 0x0A0A0A0A0A0A0A0AULL;
+            uint64_t z = (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+            if (!z) {
+                h = term_hash_step(h, w);
+                i += 8;
+                continue;
+            }
+            size_t k = (size_t)__builtin_ctzll(z) >> 3;
+            if (k > 0) h = term_hash_step(h, w & (~0ULL >> (64 - 8 * k)));
+            i += k;
+            break;
+        }
+        if (i + 8 > n && (i == n || s[i] != '\n')) {
+            const unsigned char* nl = (const unsigned char*)std::memchr(s + i, '\n', n - i);
+            size_t e = (nl ? (size_t)(nl - s) : n);
+            if (e > i) {
+                uint64_t w = 0;
+                std::memcpy(&w, s + i, e - i);
+                h = term_hash_step(h, w);
+            }
+            i = e;
+        }
+        size_t len = i - start;
+        h = term_hash_finish(h, len);
+        ++i;
+        if (len == 0) continue;
+        if (has_cr && std::memchr(s + start, '\r', len)) {
+            tmp.clear();
+            for (size_t k = start; k < start + len; ++k) {
+                if (s[k] != '\r') tmp.push_back(s[k]);
+            }
+            if (tmp.empty()) continue;
+            if (!fn(tmp.data(), tmp.size(), term_hash(tmp.data(), tmp.size()))) return false;
+            continue;
+        }
+        if (!fn(s + start, len, h)) return false;
+    }
+    return true;
+}
@@ -1,8 +1,19 @@
 #include "win_files.h"
-#include <windows.h>
+#include "file_scan.h"
 #include <cstdio>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
 bool ensure_dir_exists(const char* path) {
     if (!path || !path[0]) return false;
     DWORD attr = GetFileAttributesA(path);
@@ -12,66 +23,88 @@ bool ensure_dir_exists(const char* path) {
     return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
 }
 
-static bool is_dot_dir(const char* name) {
-    if (!name) return false;
-    return (name[0]=='.' && name[1]==0) || (name[0]=='.' && name[1]=='.' && name[2]==0);
-}
+bool map_file(const char* path, MappedFile* mf) {
+    std::memset(mf, 0, sizeof(*mf));
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(h, &sz)) { CloseHandle(h); return false; }
+    if (sz.QuadPart == 0) { CloseHandle(h); return true; }
 
-static void join_path(char* out, size_t out_sz, const char* a, const char* b) {
-    std::snprintf(out, out_sz, "%s\\%s", a, b);
-}
+    HANDLE m = CreateFileMappingA(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) { CloseHandle(h); return false; }
+    void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!p) { CloseHandle(m); CloseHandle(h); return false; }
 
-static bool ends_with_tok_ci(const char* s) {
-    if (!s) return false;
-    size_t n = std::strlen(s);
-    if (n < 4) return false;
-    if (s[n-4] != '.') return false;
-    char a = s[n-3], b = s[n-2], c = s[n-1];
-    return ( (a=='t'||a=='T') && (b=='o'||b=='O') && (c=='k'||c=='K') );
+    mf->data = (const unsigned char*)p;
+    mf->size = (size_t)sz.QuadPart;
+    mf->handle = h;
+    mf->mapping = m;
+    return true;
 }
 
-static bool rec(const char* root, const char* dir, const char* rel_prefix, file_callback_t cb, void* user) {
-    char pattern[MAX_PATH];
-    std::snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+void unmap_file(MappedFile* mf) {
+    if (mf->data) UnmapViewOfFile(mf->data);
+    if (mf->mapping) CloseHandle((HANDLE)mf->mapping);
+    if (mf->handle) CloseHandle((HANDLE)mf->handle);
+    std::memset(mf, 0, sizeof(*mf));
+}
 
-    WIN32_FIND_DATAA ffd;
-    HANDLE h = FindFirstFileA(pattern, &ffd);
-    if (h == INVALID_HANDLE_VALUE) {
-        std::fprintf(stderr, "FindFirstFileA failed for: %s\n", pattern);
-        return false;
-    }
+#else
 
-    bool ok = true;
-    do {
-        const char* name = ffd.cFileName;
-        if (is_dot_dir(name)) continue;
+bool ensure_dir_exists(const char* path) {
+    if (!path || !path[0]) return false;
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) return true;
+    if (mkdir(path, 0777) == 0) return true;
+    return (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+}
 
-        char full[MAX_PATH];
-        join_path(full, sizeof(full), dir, name);
+bool map_file(const char* path, MappedFile* mf) {
+    std::memset(mf, 0, sizeof(*mf));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return false; }
+    if (st.st_size == 0) { close(fd); return true; }
 
-        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            char next_rel[MAX_PATH];
-            if (rel_prefix && rel_prefix[0]) std::snprintf(next_rel, sizeof(next_rel), "%s\\%s", rel_prefix, name);
-            else std::snprintf(next_rel, sizeof(next_rel), "%s", name);
-            if (!rec(root, full, next_rel, cb, user)) { ok = false; break; }
-            continue;
-        }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
 
-        if (!ends_with_tok_ci(name)) continue;
+    mf->data = (const unsigned char*)p;
+    mf->size = (size_t)st.st_size;
+    return true;
+}
 
-        char rel[MAX_PATH];
-        if (rel_prefix && rel_prefix[0]) std::snprintf(rel, sizeof(rel), "%s\\%s", rel_prefix, name);
-        else std::snprintf(rel, sizeof(rel), "%s", name);
+void unmap_file(MappedFile* mf) {
+    if (mf->data) munmap((void*)mf->data, mf->size);
+    std::memset(mf, 0, sizeof(*mf));
+}
 
-        cb(full, rel, user);
+#endif
 
-    } while (FindNextFileA(h, &ffd));
+struct ShimCtx {
+    file_callback_t cb;
+    void* user;
+};
 
-    FindClose(h);
-    return ok;
+static bool shim_batch(const ScanEntry* batch, size_t n, void* user) {
+    ShimCtx* c = (ShimCtx*)user;
+    for (size_t i = 0; i < n; ++i) c->cb(batch[i].full_path, batch[i].rel_path, c->user);
+    return true;
 }
 
 bool list_tok_files_rec(const char* root_dir, file_callback_t cb, void* user) {
     if (!root_dir || !cb) return false;
-    return rec(root_dir, root_dir, "", cb, user);
+    ShimCtx c = {cb, user};
+    return scan_files(root_dir, "tok", true, 0, SCAN_BY_INODE, shim_batch, &c);
+}
+
+bool list_tid_files_rec(const char* root_dir, file_callback_t cb, void* user) {
+    if (!root_dir || !cb) return false;
+    ShimCtx c = {cb, user};
+    return scan_files(root_dir, "tid", true, 0, SCAN_BY_INODE, shim_batch, &c);
 }
@@ -1,7 +1,20 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 
 typedef void (*file_callback_t)(const char* full_path, const char* rel_path, void* user);
 
 bool ensure_dir_exists(const char* path);
 bool list_tok_files_rec(const char* root_dir, file_callback_t cb, void* user);
+bool list_tid_files_rec(const char* root_dir, file_callback_t cb, void* user);
+
+// Read-only view of a whole file. Empty files map to data == nullptr.
+struct MappedFile {
+    const unsigned char* data;
+    size_t size;
+    void* handle;
+    void* mapping;
+};
+
+bool map_file(const char* path, MappedFile* mf);
+void unmap_file(MappedFile* mf);
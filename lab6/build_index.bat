@@ -5,7 +5,9 @@ if not exist bin mkdir bin
 if not exist index mkdir index
 
 g++ -O2 -std=c++17 -Wall -Wextra ^
-  src\indexer.cpp src\win_files.cpp ^
+  src\indexer.cpp src\win_files.cpp src\file_scan.cpp ^
+  src\tokenize.cpp src\utf8.cpp src\stem_ru.cpp src\stem_ru_snowball.cpp src\stem_cache.cpp src\token_writer.cpp src\term_ids.cpp src\file_reader.cpp src\index_out.cpp ^
+  src\segments.cpp src\seg_merge.cpp src\index_merge.cpp src\roaring.cpp src\doc_order.cpp ^
   -o bin\indexer.exe
 
 if errorlevel 1 (
@@ -13,5 +15,15 @@ if errorlevel 1 (
   exit /b 1
 )
 
-echo Build OK: bin\indexer.exe
+g++ -O2 -std=c++17 -Wall -Wextra ^
+  src\index_merge_main.cpp src\index_merge.cpp src\index_out.cpp src\segments.cpp src\roaring.cpp ^
+  src\doc_order.cpp ^
+  -o bin\index_merge.exe
+
+if errorlevel 1 (
+  echo Build failed.
+  exit /b 1
+)
+
+echo Build OK: bin\indexer.exe bin\index_merge.exe
 endlocal
@@ -0,0 +1,8 @@
+@echo off
+setlocal
+
+if not exist index mkdir index
+
+bin\indexer.exe --stem=simple --add-raw corpus\ruwiki\docs corpus\ruwiki\meta.tsv --add-raw corpus\ru_wikisource\docs corpus\ru_wikisource\meta.tsv index\index.bin
+
+endlocal
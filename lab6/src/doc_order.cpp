@@ -0,0 +1,286 @@
+#include "doc_order.h"
+#include "index_merge.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+bool parse_doc_order(const char* s, DocOrder* out) {
+    if (!s || !out) return false;
+    if (std::strcmp(s, "none") == 0) { *out = ORDER_NONE; return true; }
+    if (std::strcmp(s, "url") == 0) { *out = ORDER_URL; return true; }
+    if (std::strcmp(s, "title") == 0) { *out = ORDER_TITLE; return true; }
+    if (std::strcmp(s, "bp") == 0) { *out = ORDER_BP; return true; }
+    return false;
+}
+
+const char* doc_order_name(DocOrder how) {
+    if (how == ORDER_URL) return "url";
+    if (how == ORDER_TITLE) return "title";
+    if (how == ORDER_BP) return "bp";
+    return "none";
+}
+
+static uint32_t count_docs(const char* const* in, size_t k, bool* ok) {
+    uint64_t docs = 0;
+    *ok = true;
+    for (size_t i = 0; *ok && i < k; ++i) {
+        IndexHeader h;
+        if (!index_read_header(in[i], &h)) *ok = false;
+        else docs += h.docs_count;
+    }
+    if (docs > 0xFFFFFFFFULL) *ok = false;
+    return (uint32_t)docs;
+}
+
+// Sort keys of every doc: (source, page) and, for ORDER_TITLE, the title.
+struct DocKeys {
+    uint32_t docs;
+    bool titles;
+    bool ok;
+    uint64_t* url;
+    uint64_t* title_off;
+    uint32_t* title_len;
+    unsigned char* pool;
+    size_t pool_len;
+    size_t pool_cap;
+};
+
+static void on_doc(void* ctx, uint32_t id, uint32_t source, uint32_t page, const unsigned char* title,
+                   uint32_t title_len) {
+    DocKeys* k = (DocKeys*)ctx;
+    uint32_t d = id - 1;
+    if (!k->ok || d >= k->docs) {
+        k->ok = false;
+        return;
+    }
+    k->url[d] = ((uint64_t)source << 32) | page;
+    if (!k->titles) return;
+    if (k->pool_len + title_len > k->pool_cap) {
+        size_t nc = (k->pool_cap ? k->pool_cap * 2 : (size_t)1 << 20);
+        while (nc < k->pool_len + title_len) nc *= 2;
+        unsigned char* np = (unsigned char*)std::realloc(k->pool, nc);
+        if (!np) {
+            k->ok = false;
+            return;
+        }
+        k->pool = np;
+        k->pool_cap = nc;
+    }
+    std::memcpy(k->pool + k->pool_len, title, title_len);
+    k->title_off[d] = k->pool_len;
+    k->title_len[d] = title_len;
+    k->pool_len += title_len;
+}
+
+// URL and title orders: a sort of the docs by key, ties kept in id order.
+static bool order_by_key(const char* const* in, size_t k, uint32_t docs, bool titles, uint32_t* order) {
+    DocKeys keys;
+    std::memset(&keys, 0, sizeof(keys));
+    keys.docs = docs;
+    keys.titles = titles;
+    keys.ok = true;
+    keys.url = (uint64_t*)std::malloc(((size_t)docs + 1) * sizeof(uint64_t));
+    if (titles) {
+        keys.title_off = (uint64_t*)std::malloc(((size_t)docs + 1) * sizeof(uint64_t));
+        keys.title_len = (uint32_t*)std::malloc(((size_t)docs + 1) * sizeof(uint32_t));
+    }
+    uint32_t* perm = (uint32_t*)std::malloc(((size_t)docs + 1) * sizeof(uint32_t));
+    bool ok = keys.url && perm && (!titles || (keys.title_off && keys.title_len));
+    if (ok) ok = index_scan_docs(in, k, on_doc, &keys) && keys.ok;
+    if (ok) {
+        for (uint32_t i = 0; i < docs; ++i) perm[i] = i;
+        if (titles) {
+            std::sort(perm, perm + docs, [&](uint32_t a, uint32_t b) {
+                uint32_t la = keys.title_len[a], lb = keys.title_len[b];
+                int c = std::memcmp(keys.pool + keys.title_off[a], keys.pool + keys.title_off[b], la < lb ? la : lb);
+                if (c != 0) return c < 0;
+                if (la != lb) return la < lb;
+                return a < b;
+            });
+        } else {
+            std::sort(perm, perm + docs, [&](uint32_t a, uint32_t b) {
+                if (keys.url[a] != keys.url[b]) return keys.url[a] < keys.url[b];
+                return a < b;
+            });
+        }
+        for (uint32_t p = 0; p < docs; ++p) order[perm[p]] = p;
+    }
+    std::free(keys.url);
+    std::free(keys.title_off);
+    std::free(keys.title_len);
+    std::free(keys.pool);
+    std::free(perm);
+    return ok;
+}
+
+// The doc-term graph as a forward index: the terms of doc d are
+// adj[off[d], off[d + 1]). Terms in a single doc cannot get closer to
+// anything and are left out.
+struct BpGraph {
+    uint32_t docs;
+    uint32_t terms;
+    uint64_t* off;
+    uint32_t* adj;
+    uint64_t* pos;
+    bool fill;
+};
+
+static void on_term(void* ctx, const uint32_t* ids, uint32_t n) {
+    BpGraph* g = (BpGraph*)ctx;
+    if (n < 2) return;
+    if (g->fill) {
+        for (uint32_t i = 0; i < n; ++i) g->adj[g->pos[ids[i] - 1]++] = g->terms;
+    } else {
+        for (uint32_t i = 0; i < n; ++i) g->off[ids[i]]++;
+    }
+    g->terms++;
+}
+
+static const uint32_t BP_LEAF = 16;
+static const int BP_ITERS = 20;
+
+struct BpGain {
+    float gain;
+    uint32_t doc;
+};
+
+struct BpRun {
+    const BpGraph* g;
+    // h[x] = x * log2(x + 1), for x <= docs + 1.
+    const double* h;
+    uint32_t* all;
+    BpGain* gains;
+    // Per-thread term degrees in the two halves: deg + 2 * terms * i.
+    uint32_t* deg;
+};
+
+// Gain of moving doc from a half of nf docs whose term degrees are df to
+// one of nt docs with degrees dt: the drop in
+//   sum over terms of  a * log2(nf / (a + 1)) + b * log2(nt / (b + 1)),
+// the log-gap cost of a term in a docs of one half and b of the other.
+static float move_gain(const BpRun* r, uint32_t doc, const uint32_t* df, const uint32_t* dt, double bias) {
+    const double* h = r->h;
+    uint64_t e0 = r->g->off[doc], e1 = r->g->off[doc + 1];
+    double s = bias * (double)(e1 - e0);
+    for (uint64_t e = e0; e < e1; ++e) {
+        uint32_t t = r->g->adj[e], a = df[t], b = dt[t];
+        s += (h[b + 1] - h[b]) - (h[a] - h[a - 1]);
+    }
+    return (float)s;
+}
+
+static void add_degrees(const BpGraph* g, uint32_t doc, uint32_t* deg, int by) {
+    for (uint64_t e = g->off[doc]; e < g->off[doc + 1]; ++e) deg[g->adj[e]] += by;
+}
+
+static bool gain_greater(const BpGain& a, const BpGain& b) {
+    if (a.gain != b.gain) return a.gain > b.gain;
+    return a.doc < b.doc;
+}
+
+// Bisects docs[0, n) into halves, then each half again; slot is the first
+// of the par threads (and degree arrays) this range may use.
+static void bp_split(const BpRun* r, uint32_t* docs, uint32_t n, unsigned slot, unsigned par) {
+    if (n <= BP_LEAF) return;
+    const BpGraph* g = r->g;
+    uint32_t* d1 = r->deg + 2ULL * g->terms * slot;
+    uint32_t* d2 = d1 + g->terms;
+    uint32_t n1 = n / 2, n2 = n - n1;
+    BpGain* gl = r->gains + (docs - r->all);
+    BpGain* gr = gl + n1;
+    double bias = std::log2((double)n1) - std::log2((double)n2);
+
+    for (uint32_t i = 0; i < n; ++i) add_degrees(g, docs[i], i < n1 ? d1 : d2, 1);
+    for (int it = 0; it < BP_ITERS; ++it) {
+        for (uint32_t i = 0; i < n1; ++i) gl[i] = {move_gain(r, docs[i], d1, d2, bias), docs[i]};
+        for (uint32_t i = 0; i < n2; ++i) gr[i] = {move_gain(r, docs[n1 + i], d2, d1, -bias), docs[n1 + i]};
+        std::sort(gl, gl + n1, gain_greater);
+        std::sort(gr, gr + n2, gain_greater);
+        uint32_t s = 0;
+        while (s < n1 && gl[s].gain + gr[s].gain > 0) s++;
+        if (s == 0) break;
+        for (uint32_t i = 0; i < s; ++i) {
+            add_degrees(g, gl[i].doc, d1, -1);
+            add_degrees(g, gl[i].doc, d2, 1);
+            add_degrees(g, gr[i].doc, d2, -1);
+            add_degrees(g, gr[i].doc, d1, 1);
+        }
+        for (uint32_t i = 0; i < n1; ++i) docs[i] = (i < s ? gr[i].doc : gl[i].doc);
+        for (uint32_t i = 0; i < n2; ++i) docs[n1 + i] = (i < s ? gl[i].doc : gr[i].doc);
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint64_t e = g->off[docs[i]]; e < g->off[docs[i] + 1]; ++e) d1[g->adj[e]] = d2[g->adj[e]] = 0;
+    }
+
+    if (par > 1) {
+        unsigned half = par / 2;
+        std::thread left(bp_split, r, docs, n1, slot + par - half, half);
+        bp_split(r, docs + n1, n2, slot, par - half);
+        left.join();
+    } else {
+        bp_split(r, docs, n1, slot, 1);
+        bp_split(r, docs + n1, n2, slot, 1);
+    }
+}
+
+static bool order_bp(const char* const* in, size_t k, uint32_t docs, unsigned threads, uint32_t* order) {
+    if (threads < 1) threads = 1;
+    BpGraph g;
+    std::memset(&g, 0, sizeof(g));
+    g.docs = docs;
+    g.off = (uint64_t*)std::calloc((size_t)docs + 1, sizeof(uint64_t));
+    bool ok = g.off && index_scan_postings(in, k, on_term, &g);
+    if (ok) {
+        for (uint32_t d = 0; d < docs; ++d) g.off[d + 1] += g.off[d];
+        g.adj = (uint32_t*)std::malloc((g.off[docs] + 1) * sizeof(uint32_t));
+        g.pos = (uint64_t*)std::malloc(((size_t)docs + 1) * sizeof(uint64_t));
+        ok = g.adj && g.pos;
+    }
+    if (ok) {
+        std::memcpy(g.pos, g.off, (size_t)docs * sizeof(uint64_t));
+        g.terms = 0;
+        g.fill = true;
+        ok = index_scan_postings(in, k, on_term, &g);
+    }
+
+    BpRun r;
+    std::memset(&r, 0, sizeof(r));
+    double* h = nullptr;
+    if (ok) {
+        r.g = &g;
+        h = (double*)std::malloc(((size_t)docs + 2) * sizeof(double));
+        r.all = (uint32_t*)std::malloc(((size_t)docs + 1) * sizeof(uint32_t));
+        r.gains = (BpGain*)std::malloc(((size_t)docs + 1) * sizeof(BpGain));
+        r.deg = (uint32_t*)std::calloc(2ULL * g.terms * threads + 1, sizeof(uint32_t));
+        ok = h && r.all && r.gains && r.deg;
+    }
+    if (ok) {
+        for (uint32_t x = 0; x <= docs + 1; ++x) h[x] = x * std::log2((double)x + 1.0);
+        r.h = h;
+        for (uint32_t d = 0; d < docs; ++d) r.all[d] = d;
+        bp_split(&r, r.all, docs, 0, threads);
+        for (uint32_t p = 0; p < docs; ++p) order[r.all[p]] = p;
+    }
+    std::free(g.off);
+    std::free(g.adj);
+    std::free(g.pos);
+    std::free(h);
+    std::free(r.all);
+    std::free(r.gains);
+    std::free(r.deg);
+    return ok;
+}
+
+bool doc_order_compute(const char* const* in, size_t k, DocOrder how, unsigned threads, uint32_t* order) {
+    bool ok;
+    uint32_t docs = count_docs(in, k, &ok);
+    if (!ok) return false;
+    if (how == ORDER_URL) return order_by_key(in, k, docs, false, order);
+    if (how == ORDER_TITLE) return order_by_key(in, k, docs, true, order);
+    if (how == ORDER_BP) return order_bp(in, k, docs, threads, order);
+    for (uint32_t d = 0; d < docs; ++d) order[d] = d;
+    return true;
+}
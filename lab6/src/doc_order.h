@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Doc-id reordering before postings are written. Ids follow file enumeration
+// order by default; giving similar docs nearby ids makes postings denser,
+// which shrinks gap-coded lists and turns more hybrid chunks into bitmaps
+// and runs.
+//   ORDER_URL    by source, then page id (docs of one source stay together)
+//   ORDER_TITLE  by title bytes
+//   ORDER_BP     recursive graph bisection over the doc-term graph: each
+//                range is split in two halves, and docs are swapped between
+//                them while that lowers the estimated cost of coding the
+//                gaps of every term's postings in both halves.
+enum DocOrder {
+    ORDER_NONE = 0,
+    ORDER_URL,
+    ORDER_TITLE,
+    ORDER_BP
+};
+
+bool parse_doc_order(const char* s, DocOrder* out);
+const char* doc_order_name(DocOrder how);
+
+// Computes order[i], the new 0-based position of doc i + 1 of in[0, k) as
+// index_merge numbers them (order holds that many entries), for
+// index_merge's order argument. BP runs its top levels on up to threads
+// threads.
+bool doc_order_compute(const char* const* in, size_t k, DocOrder how, unsigned threads, uint32_t* order);
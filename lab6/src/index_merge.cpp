@@ -0,0 +1,631 @@
+#include "index_merge.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static uint32_t rd_u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t rd_u64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+static bool seek64(FILE* f, uint64_t off) {
+#ifdef _WIN32
+    return _fseeki64(f, (long long)off, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)off, SEEK_SET) == 0;
+#endif
+}
+
+static const size_t MERGE_IO_BUF = (size_t)1 << 20;
+
+bool index_read_header(const char* path, IndexHeader* h) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+    unsigned char b[128];
+    bool ok = (std::fread(b, 1, 128, f) == 128);
+    std::fclose(f);
+    if (!ok || std::memcmp(b, "MAIIRIDX", 8) != 0 || rd_u32(b + 8) != 2) return false;
+    h->flags = rd_u32(b + 12);
+    h->docs_count = rd_u64(b + 16);
+    h->terms_count = rd_u64(b + 24);
+    h->dict_offset = rd_u64(b + 32);
+    h->dict_bytes = rd_u64(b + 40);
+    h->postings_offset = rd_u64(b + 48);
+    h->postings_bytes = rd_u64(b + 56);
+    h->docs_offset = rd_u64(b + 64);
+    h->docs_bytes = rd_u64(b + 72);
+    h->total_tokens = rd_u64(b + 80);
+    h->doc_base = (h->flags & IDX_FLAG_SEGMENT) ? rd_u64(b + 88) : 0;
+    h->stem = (h->flags & IDX_FLAG_STEM) ? rd_u32(b + 96) : 0;
+    return h->docs_count <= 0xFFFFFFFFULL;
+}
+
+// One input, read front to back through three handles: dictionary entries,
+// postings (in dictionary order) and doc records.
+struct MergeReader {
+    FILE* dict;
+    FILE* post;
+    FILE* docs;
+
+    IndexHeader h;
+    uint32_t shift;
+    bool dirty;
+    uint32_t* ids;
+    unsigned char* chunk;
+
+    uint64_t terms_read;
+    uint64_t post_pos;
+    unsigned char* term;
+    uint32_t len;
+    uint32_t cap;
+    uint64_t p_off;
+    uint32_t df;
+    uint32_t cf;
+};
+
+static FILE* open_at(const char* path, uint64_t off) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return nullptr;
+    std::setvbuf(f, nullptr, _IOFBF, MERGE_IO_BUF);
+    if (!seek64(f, off)) {
+        std::fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+static void reader_close(MergeReader* r) {
+    if (r->dict) std::fclose(r->dict);
+    if (r->post) std::fclose(r->post);
+    if (r->docs) std::fclose(r->docs);
+    std::free(r->term);
+    std::free(r->ids);
+    std::free(r->chunk);
+    std::memset(r, 0, sizeof(*r));
+}
+
+// Loads the next dictionary entry; *has is false past the last one.
+static bool reader_next(MergeReader* r, bool* has) {
+    *has = false;
+    if (r->terms_read == r->h.terms_count) return true;
+    unsigned char b[16];
+    if (std::fread(b, 1, 4, r->dict) != 4) return false;
+    uint32_t len = rd_u32(b);
+    if (len > r->cap) {
+        uint32_t nc = (r->cap ? r->cap : 64);
+        while (nc < len) nc *= 2;
+        unsigned char* nt = (unsigned char*)std::realloc(r->term, nc);
+        if (!nt) return false;
+        r->term = nt;
+        r->cap = nc;
+    }
+    if (std::fread(r->term, 1, len, r->dict) != len) return false;
+    if (std::fread(b, 1, 16, r->dict) != 16) return false;
+    r->len = len;
+    r->p_off = rd_u64(b);
+    r->df = rd_u32(b + 8);
+    r->cf = rd_u32(b + 12);
+    r->terms_read++;
+    *has = true;
+    return true;
+}
+
+static bool reader_open(MergeReader* r, const char* path, uint32_t first_id, const Tombstones* del) {
+    std::memset(r, 0, sizeof(*r));
+    if (!index_read_header(path, &r->h)) return false;
+    uint32_t in_base = (uint32_t)r->h.doc_base;
+    r->shift = first_id - 1 - in_base;
+    r->dirty = del && tombstones_count(del, in_base + 1, in_base + (uint32_t)r->h.docs_count + 1) > 0;
+
+    r->dict = open_at(path, r->h.dict_offset);
+    r->post = open_at(path, r->h.postings_offset);
+    r->docs = open_at(path, r->h.docs_offset + 8 + 8 * r->h.docs_count);
+    if (r->h.flags & IDX_FLAG_ROARING) {
+        r->ids = (uint32_t*)std::malloc(65536 * sizeof(uint32_t));
+        r->chunk = (unsigned char*)std::malloc(RC_CHUNK_MAX);
+        if (!r->ids || !r->chunk) return false;
+    }
+    return r->dict && r->post && r->docs;
+}
+
+// Reads the next n <= 1024 ids of an array-coded term into buf.
+static bool read_ids(MergeReader* r, uint32_t* buf, uint32_t n) {
+    if (std::fread(buf, 4, n, r->post) != n) return false;
+    r->post_pos += 4ULL * n;
+    return true;
+}
+
+// Reads the next chunk of a hybrid-coded term into r->ids; *n gets its size.
+static bool read_chunk(MergeReader* r, uint32_t left, uint32_t* n) {
+    RoaringChunk c;
+    if (std::fread(r->chunk, 1, RC_CHUNK_HEAD, r->post) != RC_CHUNK_HEAD) return false;
+    if (!roaring_chunk_head(r->chunk, &c)) return false;
+    size_t b = roaring_data_bytes(c.type, c.n);
+    if (std::fread(r->chunk + RC_CHUNK_HEAD, 1, b, r->post) != b) return false;
+    r->post_pos += RC_CHUNK_HEAD + b;
+    if (roaring_chunk_card(&c, r->chunk + RC_CHUNK_HEAD) > left) return false;
+    *n = roaring_chunk_decode(&c, r->chunk + RC_CHUNK_HEAD, r->ids);
+    return true;
+}
+
+// Hands the current term's postings of live docs to put(ids, n), already
+// moved to output ids.
+template <typename Put>
+static bool reader_postings(MergeReader* r, const Tombstones* del, Put put) {
+    if (r->post_pos != r->p_off) {
+        if (!seek64(r->post, r->h.postings_offset + r->p_off)) return false;
+        r->post_pos = r->p_off;
+    }
+    uint32_t arr[1024];
+    uint32_t left = r->df;
+    while (left > 0) {
+        uint32_t* buf = arr;
+        uint32_t n = (left < 1024 ? left : 1024);
+        if (r->ids) {
+            buf = r->ids;
+            if (!read_chunk(r, left, &n)) return false;
+        } else if (!read_ids(r, buf, n)) {
+            return false;
+        }
+        left -= n;
+        uint32_t k = n;
+        if (r->dirty) {
+            k = 0;
+            for (uint32_t i = 0; i < n; ++i) {
+                if (!tombstones_has(del, buf[i])) buf[k++] = buf[i];
+            }
+        }
+        if (r->shift) {
+            for (uint32_t i = 0; i < k; ++i) buf[i] += r->shift;
+        }
+        if (k) put(buf, k);
+    }
+    return true;
+}
+
+// Reads the next doc record: the 16-byte head into b (the id still the
+// input's) and the title into *title, grown as needed.
+static bool read_doc(MergeReader* r, unsigned char* b, unsigned char** title, size_t* cap) {
+    if (std::fread(b, 1, 16, r->docs) != 16) return false;
+    uint32_t id = rd_u32(b), tl = rd_u32(b + 12);
+    if (id - (uint32_t)r->h.doc_base - 1 >= r->h.docs_count) return false;
+    if (tl > *cap) {
+        unsigned char* nt = (unsigned char*)std::realloc(*title, tl);
+        if (!nt) return false;
+        *title = nt;
+        *cap = tl;
+    }
+    return std::fread(*title, 1, tl, r->docs) == tl;
+}
+
+// Heap order: term bytes, then input index, so inputs sharing a term come
+// out in doc-id order.
+static bool reader_less(const MergeReader* rs, uint32_t a, uint32_t b) {
+    uint32_t m = (rs[a].len < rs[b].len ? rs[a].len : rs[b].len);
+    int c = std::memcmp(rs[a].term, rs[b].term, m);
+    if (c != 0) return c < 0;
+    if (rs[a].len != rs[b].len) return rs[a].len < rs[b].len;
+    return a < b;
+}
+
+static void heap_down(uint32_t* h, size_t n, size_t i, const MergeReader* rs) {
+    for (;;) {
+        size_t l = 2 * i + 1, m = i;
+        if (l < n && reader_less(rs, h[l], h[m])) m = l;
+        if (l + 1 < n && reader_less(rs, h[l + 1], h[m])) m = l + 1;
+        if (m == i) return;
+        uint32_t t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+// Walks the union of the inputs' dictionaries in term order from their
+// current entries; for every term on(same, m) gets the inputs holding it, in
+// input order, and then they move on.
+template <typename On>
+static bool merge_terms(MergeReader* rs, uint32_t k, uint32_t* heap, uint32_t* same, On on) {
+    size_t n = 0;
+    for (uint32_t i = 0; i < k; ++i) {
+        if (rs[i].terms_read > 0) heap[n++] = i;
+    }
+    for (size_t i = n / 2; i-- > 0;) heap_down(heap, n, i, rs);
+
+    while (n > 0) {
+        size_t m = 0;
+        same[m++] = heap[0];
+        heap[0] = heap[--n];
+        heap_down(heap, n, 0, rs);
+        while (n > 0 && rs[heap[0]].len == rs[same[0]].len &&
+               std::memcmp(rs[heap[0]].term, rs[same[0]].term, rs[same[0]].len) == 0) {
+            same[m++] = heap[0];
+            heap[0] = heap[--n];
+            heap_down(heap, n, 0, rs);
+        }
+
+        if (!on(same, m)) return false;
+
+        for (size_t j = 0; j < m; ++j) {
+            bool has;
+            if (!reader_next(&rs[same[j]], &has)) return false;
+            if (!has) continue;
+            size_t i = n++;
+            heap[i] = same[j];
+            while (i > 0 && reader_less(rs, heap[i], heap[(i - 1) / 2])) {
+                uint32_t t = heap[i]; heap[i] = heap[(i - 1) / 2]; heap[(i - 1) / 2] = t;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+    return true;
+}
+
+// Positions every dictionary handle on its first entry; an empty input has
+// terms_read == 0 afterwards and stays out of the merge.
+static bool rewind_dicts(MergeReader* rs, uint32_t k) {
+    for (uint32_t i = 0; i < k; ++i) {
+        if (!seek64(rs[i].dict, rs[i].h.dict_offset)) return false;
+        rs[i].terms_read = 0;
+        bool has;
+        if (!reader_next(&rs[i], &has)) return false;
+    }
+    return true;
+}
+
+static uint32_t cf_u32(uint64_t cf) {
+    return cf > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)cf;
+}
+
+// Doc renumbering: output id first + i becomes first + order[i]. buf holds
+// one term's postings while they are renumbered and sorted.
+struct Renumber {
+    const uint32_t* order;
+    uint32_t first;
+    uint32_t docs;
+    uint32_t* buf;
+};
+
+// Hands a merged term's live postings to put(ids, n) in output id order:
+// straight from the inputs, or renumbered and sorted when rn is set.
+template <typename Put>
+static bool term_postings(MergeReader* rs, const uint32_t* sm, size_t m, const Tombstones* del,
+                          const Renumber* rn, Put put) {
+    if (!rn) {
+        for (size_t j = 0; j < m; ++j) {
+            if (!reader_postings(&rs[sm[j]], del, put)) return false;
+        }
+        return true;
+    }
+    uint32_t n = 0;
+    bool bad = false;
+    for (size_t j = 0; j < m; ++j) {
+        bool rd = reader_postings(&rs[sm[j]], del, [&](const uint32_t* ids, size_t c) {
+            for (size_t i = 0; i < c; ++i) {
+                uint32_t d = ids[i] - rn->first;
+                if (d >= rn->docs || n == rn->docs) {
+                    bad = true;
+                    return;
+                }
+                rn->buf[n++] = rn->first + rn->order[d];
+            }
+        });
+        if (!rd || bad) return false;
+    }
+    std::sort(rn->buf, rn->buf + n);
+    if (n) put(rn->buf, n);
+    return true;
+}
+
+// Two passes like the indexer's final merge: the first sizes the dictionary
+// and the postings (reading postings only where deletions can drop some or
+// hybrid containers are to be built), the second writes them. The cf of a
+// term is the inputs' sum; postings carry no frequencies, so deleted docs
+// are not taken out of it.
+static bool merge_write(MergeReader* rs, uint32_t k, const Tombstones* del, const Renumber* rn,
+                        IndexOut* out, IndexHeader* hdr) {
+    bool hybrid = (hdr->flags & IDX_FLAG_ROARING) != 0;
+    RoaringEnc enc;
+    std::memset(&enc, 0, sizeof(enc));
+    uint32_t* heap = (uint32_t*)std::malloc(((size_t)k + 1) * sizeof(uint32_t));
+    uint32_t* same = (uint32_t*)std::malloc(((size_t)k + 1) * sizeof(uint32_t));
+    bool ok = (heap && same) && (!hybrid || roaring_enc_init(&enc)) && rewind_dicts(rs, k);
+
+    uint64_t terms = 0, dict_bytes = 0, postings_bytes = 0;
+    if (ok) {
+        ok = merge_terms(rs, k, heap, same, [&](const uint32_t* sm, size_t m) {
+            uint64_t df = 0, bytes = 0;
+            auto sized = [&](const unsigned char*, size_t b) { bytes += b; };
+            if (hybrid) {
+                bool rd = term_postings(rs, sm, m, del, rn, [&](const uint32_t* ids, size_t n) {
+                    df += n;
+                    roaring_enc_add(&enc, ids, n, sized);
+                });
+                if (!rd) return false;
+                roaring_enc_flush(&enc, sized);
+            } else {
+                for (size_t j = 0; j < m; ++j) {
+                    MergeReader* r = &rs[sm[j]];
+                    if (!r->dirty) {
+                        df += r->df;
+                        continue;
+                    }
+                    if (!reader_postings(r, del, [&](const uint32_t*, size_t n) { df += n; })) return false;
+                }
+            }
+            if (df == 0) return true;
+            terms++;
+            dict_bytes += 4ULL + rs[sm[0]].len + 16ULL;
+            postings_bytes += (hybrid ? bytes : df * 4ULL);
+            return true;
+        });
+    }
+    if (ok) ok = rewind_dicts(rs, k);
+    if (!ok) {
+        roaring_enc_free(&enc);
+        std::free(heap);
+        std::free(same);
+        return false;
+    }
+
+    hdr->terms_count = terms;
+    hdr->dict_offset = IDX_ALIGN;
+    hdr->dict_bytes = dict_bytes;
+    hdr->postings_offset = idx_align(hdr->dict_offset + dict_bytes);
+    hdr->postings_bytes = postings_bytes;
+    hdr->docs_offset = idx_align(hdr->postings_offset + postings_bytes);
+
+    SectionWriter dict_w, post_w;
+    if (!section_open(&dict_w, out, hdr->dict_offset)) ok = false;
+    if (ok && !section_open(&post_w, out, hdr->postings_offset)) {
+        section_close(&dict_w);
+        ok = false;
+    }
+    if (ok) {
+        auto put = [&](const unsigned char* p, size_t b) { section_put(&post_w, p, b); };
+        ok = merge_terms(rs, k, heap, same, [&](const uint32_t* sm, size_t m) {
+            uint64_t start = section_size(&post_w);
+            uint64_t df = 0, cf = 0;
+            for (size_t j = 0; j < m; ++j) cf += rs[sm[j]].cf;
+            bool rd = term_postings(rs, sm, m, del, rn, [&](const uint32_t* ids, size_t n) {
+                df += n;
+                if (hybrid) roaring_enc_add(&enc, ids, n, put);
+                else section_put(&post_w, ids, n * 4);
+            });
+            if (!rd) return false;
+            if (hybrid) roaring_enc_flush(&enc, put);
+            if (df == 0) return true;
+            section_u32(&dict_w, rs[sm[0]].len);
+            section_put(&dict_w, rs[sm[0]].term, rs[sm[0]].len);
+            section_u64(&dict_w, start);
+            section_u32(&dict_w, (uint32_t)df);
+            section_u32(&dict_w, cf_u32(cf));
+            return true;
+        });
+        if (section_size(&post_w) != postings_bytes) ok = false;
+        if (!section_close(&dict_w)) ok = false;
+        if (!section_close(&post_w)) ok = false;
+    }
+    roaring_enc_free(&enc);
+    std::free(heap);
+    std::free(same);
+    if (!ok) return false;
+
+    // Docs: the offsets table and the records go through two writers so the
+    // records need one pass. Records stay in id order, so renumbered ones are
+    // held in memory (the size of the docs section) and written at the end.
+    uint64_t* at = nullptr;
+    unsigned char* held = nullptr;
+    size_t held_len = 0, held_cap = 0;
+    if (rn) {
+        at = (uint64_t*)std::malloc((hdr->docs_count + 1) * sizeof(uint64_t));
+        if (!at) return false;
+    }
+    SectionWriter offs_w, rec_w;
+    if (!section_open(&offs_w, out, hdr->docs_offset)) {
+        std::free(at);
+        return false;
+    }
+    if (!section_open(&rec_w, out, hdr->docs_offset + 8 + 8 * hdr->docs_count)) {
+        section_close(&offs_w);
+        std::free(at);
+        return false;
+    }
+    auto put_doc = [&](const unsigned char* b, const unsigned char* t, uint32_t tl) {
+        section_u64(&offs_w, section_size(&rec_w));
+        section_put(&rec_w, b, 16);
+        section_put(&rec_w, t, tl);
+    };
+    section_u64(&offs_w, hdr->docs_count);
+    unsigned char* title = nullptr;
+    size_t title_cap = 0;
+    for (uint32_t i = 0; ok && i < k; ++i) {
+        MergeReader* r = &rs[i];
+        for (uint64_t d = 0; d < r->h.docs_count; ++d) {
+            unsigned char b[16];
+            if (!read_doc(r, b, &title, &title_cap)) { ok = false; break; }
+            uint32_t id = rd_u32(b), tl = rd_u32(b + 12);
+            if (del && tombstones_has(del, id)) {
+                tl = 0;
+                std::memset(b + 12, 0, 4);
+            }
+            id += r->shift;
+            if (!rn) {
+                std::memcpy(b, &id, 4);
+                put_doc(b, title, tl);
+                continue;
+            }
+            uint32_t to = rn->order[id - rn->first];
+            id = rn->first + to;
+            std::memcpy(b, &id, 4);
+            if (held_len + 16 + tl > held_cap) {
+                size_t nc = (held_cap ? held_cap * 2 : (size_t)1 << 20);
+                while (nc < held_len + 16 + tl) nc *= 2;
+                unsigned char* nh = (unsigned char*)std::realloc(held, nc);
+                if (!nh) { ok = false; break; }
+                held = nh;
+                held_cap = nc;
+            }
+            at[to] = held_len;
+            std::memcpy(held + held_len, b, 16);
+            std::memcpy(held + held_len + 16, title, tl);
+            held_len += 16 + tl;
+        }
+    }
+    for (uint64_t d = 0; ok && rn && d < hdr->docs_count; ++d) {
+        const unsigned char* rec = held + at[d];
+        put_doc(rec, rec + 16, rd_u32(rec + 12));
+    }
+    std::free(title);
+    std::free(held);
+    std::free(at);
+    hdr->docs_bytes = 8 + 8 * hdr->docs_count + section_size(&rec_w);
+    if (!section_close(&offs_w)) ok = false;
+    if (!section_close(&rec_w)) ok = false;
+    return ok && index_out_header(out, hdr);
+}
+
+static void close_inputs(MergeReader* rs, size_t k) {
+    for (size_t i = 0; i < k; ++i) reader_close(&rs[i]);
+    std::free(rs);
+}
+
+// Opens in[0, k) with ids from doc_base + 1, adding their docs and tokens to
+// hdr and clearing its CF flag unless every input has it, and its STEM flag
+// unless every input has it with the same mode.
+static MergeReader* open_inputs(const char* const* in, size_t k, const Tombstones* del, uint32_t doc_base,
+                                IndexHeader* hdr) {
+    if (k == 0 || k >= 0xFFFFFFFFULL) return nullptr;
+    MergeReader* rs = (MergeReader*)std::calloc(k, sizeof(MergeReader));
+    if (!rs) return nullptr;
+    bool ok = true;
+    uint64_t next_id = (uint64_t)doc_base + 1;
+    for (size_t i = 0; ok && i < k; ++i) {
+        ok = reader_open(&rs[i], in[i], (uint32_t)next_id, del);
+        if (!ok) break;
+        if (!(rs[i].h.flags & IDX_FLAG_CF)) hdr->flags &= ~IDX_FLAG_CF;
+        if (i == 0) hdr->stem = rs[i].h.stem;
+        if (!(rs[i].h.flags & IDX_FLAG_STEM) || rs[i].h.stem != hdr->stem) hdr->flags &= ~IDX_FLAG_STEM;
+        hdr->docs_count += rs[i].h.docs_count;
+        hdr->total_tokens += rs[i].h.total_tokens;
+        next_id += rs[i].h.docs_count;
+        if (next_id - 1 > 0xFFFFFFFFULL) ok = false;
+    }
+    if (!ok) {
+        close_inputs(rs, k);
+        return nullptr;
+    }
+    return rs;
+}
+
+// Checks that order is a permutation of [0, n).
+static bool is_permutation(const uint32_t* order, uint32_t n) {
+    unsigned char* seen = (unsigned char*)std::calloc((size_t)n + 1, 1);
+    if (!seen) return false;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < n; ++i) {
+        if (order[i] >= n || seen[order[i]]) ok = false;
+        else seen[order[i]] = 1;
+    }
+    std::free(seen);
+    return ok;
+}
+
+bool index_merge(const char* const* in, size_t k, const Tombstones* del, uint32_t doc_base,
+                 uint32_t flags, const uint32_t* order, const char* out_path, IndexHeader* out) {
+    IndexHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.flags = 0x3 | IDX_FLAG_CF | IDX_FLAG_ALIGNED | IDX_FLAG_STEM | (flags & (IDX_FLAG_SEGMENT | IDX_FLAG_ROARING));
+    hdr.doc_base = doc_base;
+    MergeReader* rs = open_inputs(in, k, del, doc_base, &hdr);
+    bool ok = (rs != nullptr);
+    if (!(hdr.flags & IDX_FLAG_CF)) hdr.total_tokens = 0;
+    if (!(hdr.flags & IDX_FLAG_STEM)) hdr.stem = 0;
+
+    Renumber rn;
+    std::memset(&rn, 0, sizeof(rn));
+    if (ok && order) {
+        rn.order = order;
+        rn.first = doc_base + 1;
+        rn.docs = (uint32_t)hdr.docs_count;
+        rn.buf = (uint32_t*)std::malloc((hdr.docs_count + 1) * sizeof(uint32_t));
+        ok = rn.buf && is_permutation(order, rn.docs);
+    }
+
+    IndexOut* f = (ok ? index_out_open(out_path) : nullptr);
+    if (f) {
+        ok = merge_write(rs, (uint32_t)k, del, order ? &rn : nullptr, f, &hdr);
+        if (!index_out_close(f)) ok = false;
+        if (!ok) std::remove(out_path);
+    } else {
+        ok = false;
+    }
+
+    std::free(rn.buf);
+    if (rs) close_inputs(rs, k);
+    if (ok && out) *out = hdr;
+    return ok;
+}
+
+bool index_scan_postings(const char* const* in, size_t k, ScanPostingsFn on, void* ctx) {
+    IndexHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    MergeReader* rs = open_inputs(in, k, nullptr, 0, &hdr);
+    if (!rs) return false;
+    uint32_t docs = (uint32_t)hdr.docs_count;
+    uint32_t* heap = (uint32_t*)std::malloc((k + 1) * sizeof(uint32_t));
+    uint32_t* same = (uint32_t*)std::malloc((k + 1) * sizeof(uint32_t));
+    uint32_t* buf = (uint32_t*)std::malloc(((size_t)docs + 1) * sizeof(uint32_t));
+    bool ok = heap && same && buf && rewind_dicts(rs, (uint32_t)k);
+    if (ok) {
+        ok = merge_terms(rs, (uint32_t)k, heap, same, [&](const uint32_t* sm, size_t m) {
+            uint32_t n = 0;
+            bool bad = false;
+            for (size_t j = 0; j < m; ++j) {
+                bool rd = reader_postings(&rs[sm[j]], nullptr, [&](const uint32_t* ids, size_t c) {
+                    if (c > docs - n) {
+                        bad = true;
+                        return;
+                    }
+                    std::memcpy(buf + n, ids, c * sizeof(uint32_t));
+                    n += (uint32_t)c;
+                });
+                if (!rd || bad) return false;
+            }
+            if (n) on(ctx, buf, n);
+            return true;
+        });
+    }
+    std::free(heap);
+    std::free(same);
+    std::free(buf);
+    close_inputs(rs, k);
+    return ok;
+}
+
+bool index_scan_docs(const char* const* in, size_t k, ScanDocsFn on, void* ctx) {
+    IndexHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    MergeReader* rs = open_inputs(in, k, nullptr, 0, &hdr);
+    if (!rs) return false;
+    bool ok = true;
+    unsigned char* title = nullptr;
+    size_t title_cap = 0;
+    for (size_t i = 0; ok && i < k; ++i) {
+        MergeReader* r = &rs[i];
+        for (uint64_t d = 0; d < r->h.docs_count; ++d) {
+            unsigned char b[16];
+            if (!read_doc(r, b, &title, &title_cap)) { ok = false; break; }
+            on(ctx, rd_u32(b) + r->shift, rd_u32(b + 4), rd_u32(b + 8), title, rd_u32(b + 12));
+        }
+    }
+    std::free(title);
+    close_inputs(rs, k);
+    return ok;
+}
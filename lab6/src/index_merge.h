@@ -0,0 +1,40 @@
+#pragma once
+#include "index_out.h"
+#include "roaring.h"
+#include "segments.h"
+#include <cstddef>
+#include <cstdint>
+
+// Streaming k-way merge of index.bin files. Each input is read front to back
+// through a few buffered handles (dictionary, postings, doc records), so
+// memory does not depend on the size of the inputs. Input i's docs get the
+// ids right after input i - 1's, the first input's starting at doc_base + 1;
+// inputs are expected to cover disjoint doc sets, so a term's postings are
+// the inputs' lists one after another.
+
+// Reads and checks the header of a version 2 index file.
+bool index_read_header(const char* path, IndexHeader* h);
+
+// Merges in[0, k) into out_path. Postings of docs whose input ids are set in
+// del (may be null) are dropped and their titles blanked; they keep their
+// ids. flags may hold IDX_FLAG_SEGMENT (the output is a segment starting at
+// doc_base) and IDX_FLAG_ROARING (postings are written as hybrid
+// containers, whatever the inputs use). The output has the CF flag only if
+// every input has it, and the STEM flag only if every input has it with the
+// same mode. order (may be null) renumbers the docs: the doc that
+// would get id doc_base + 1 + i gets doc_base + 1 + order[i] instead, and
+// postings are written in the new id order; it must be a permutation of
+// [0, docs). On success *out holds the written header; on failure out_path
+// is removed.
+bool index_merge(const char* const* in, size_t k, const Tombstones* del, uint32_t doc_base,
+                 uint32_t flags, const uint32_t* order, const char* out_path, IndexHeader* out);
+
+// Reads the inputs the way index_merge does (ids from 1, no deletions)
+// without writing anything. index_scan_postings calls on(ctx, ids, n) with
+// every merged term's whole postings, in term order; index_scan_docs calls
+// on(ctx, id, source, page, title, title_len) for every doc, in id order.
+typedef void (*ScanPostingsFn)(void* ctx, const uint32_t* ids, uint32_t n);
+typedef void (*ScanDocsFn)(void* ctx, uint32_t id, uint32_t source, uint32_t page,
+                           const unsigned char* title, uint32_t title_len);
+bool index_scan_postings(const char* const* in, size_t k, ScanPostingsFn on, void* ctx);
+bool index_scan_docs(const char* const* in, size_t k, ScanDocsFn on, void* ctx);
@@ -0,0 +1,145 @@
+#include "doc_order.h"
+#include "index_merge.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static void usage() {
+    std::fprintf(stderr,
+        "Usage:\n"
+        "  index_merge.exe [--roaring] [--reorder=url|title|bp] [--threads=N] <out_index_bin> <in_index_bin>...\n"
+        "  Merges index.bin shards built by indexer.exe into one index in a single streaming\n"
+        "  k-way pass over their dictionaries. Doc ids are renumbered in input order: the docs\n"
+        "  of the second input follow those of the first, and so on.\n"
+        "  --roaring writes the postings as hybrid array/bitmap/run containers per 64K doc ids;\n"
+        "  with a single input it converts an index.\n"
+        "  --reorder renumbers the docs before the postings are written: by source and page id\n"
+        "  (url), by title, or by recursive graph bisection of the doc-term graph (bp), which\n"
+        "  puts docs sharing terms next to each other. --threads=N runs bp on N threads.\n"
+        "  The output's postings size is also reported with the gaps between ids coded as varints\n"
+        "  and as gamma codes, to compare orders.\n"
+        "Examples:\n"
+        "  index_merge.exe index\\index.bin index\\ruwiki.bin index\\wikisource.bin\n"
+        "  index_merge.exe --roaring index\\index_roaring.bin index\\index.bin\n"
+        "  index_merge.exe --roaring --reorder=bp index\\index_bp.bin index\\index.bin\n");
+}
+
+// Size of the postings with the gaps between ids coded as varints and as
+// Elias gamma codes.
+struct GapSize {
+    uint64_t postings;
+    uint64_t varint_bytes;
+    uint64_t gamma_bits;
+};
+
+static void add_gaps(void* ctx, const uint32_t* ids, uint32_t n) {
+    GapSize* g = (GapSize*)ctx;
+    g->postings += n;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t gap = ids[i] - prev;
+        prev = ids[i];
+        g->varint_bytes += (gap < (1u << 7) ? 1 : gap < (1u << 14) ? 2 : gap < (1u << 21) ? 3 : gap < (1u << 28) ? 4 : 5);
+        g->gamma_bits += 2 * (31 - __builtin_clz(gap)) + 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint32_t flags = 0;
+    DocOrder reorder = ORDER_NONE;
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > 8) threads = 8;
+    int a = 1;
+    for (; a < argc && std::strncmp(argv[a], "--", 2) == 0; ++a) {
+        if (std::strcmp(argv[a], "--roaring") == 0) {
+            flags |= IDX_FLAG_ROARING;
+        } else if (std::strncmp(argv[a], "--reorder=", 10) == 0) {
+            if (!parse_doc_order(argv[a] + 10, &reorder)) {
+                usage();
+                return 2;
+            }
+        } else if (std::strncmp(argv[a], "--threads=", 10) == 0) {
+            int v = std::atoi(argv[a] + 10);
+            if (v < 1 || v > 256) {
+                usage();
+                return 2;
+            }
+            threads = (unsigned)v;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (argc - a < 2) {
+        usage();
+        return 2;
+    }
+    const char* out_path = argv[a];
+    int first_in = a + 1;
+    for (int i = first_in; i < argc; ++i) {
+        if (std::strcmp(argv[i], out_path) == 0) {
+            std::fprintf(stderr, "Output is also an input: %s\n", out_path);
+            return 2;
+        }
+    }
+
+    uint64_t in_bytes = 0, in_postings = 0, docs = 0;
+    for (int i = first_in; i < argc; ++i) {
+        IndexHeader h;
+        if (!index_read_header(argv[i], &h)) {
+            std::fprintf(stderr, "Not an index.bin (version 2): %s\n", argv[i]);
+            return 1;
+        }
+        std::fprintf(stderr, "in: %s docs=%llu terms=%llu\n", argv[i],
+                     (unsigned long long)h.docs_count, (unsigned long long)h.terms_count);
+        in_bytes += h.docs_offset + h.docs_bytes;
+        in_postings += h.postings_bytes;
+        docs += h.docs_count;
+    }
+    const char* const* in = (const char* const*)(argv + first_in);
+    size_t k = (size_t)(argc - first_in);
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t* order = nullptr;
+    if (reorder != ORDER_NONE) {
+        order = (uint32_t*)std::malloc((docs + 1) * sizeof(uint32_t));
+        if (!order || !doc_order_compute(in, k, reorder, threads, order)) {
+            std::fprintf(stderr, "Reordering failed\n");
+            return 1;
+        }
+        double osec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::fprintf(stderr, "reorder=%s time=%.3f s\n", doc_order_name(reorder), osec);
+    }
+    IndexHeader out;
+    bool merged = index_merge(in, k, nullptr, 0, flags, order, out_path, &out);
+    std::free(order);
+    if (!merged) {
+        std::fprintf(stderr, "Merge failed: %s\n", out_path);
+        return 1;
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    uint64_t out_bytes = out.docs_offset + out.docs_bytes;
+    std::fprintf(stderr, "Done. docs=%llu terms=%llu postings_bytes=%llu (inputs: %llu)\n",
+                 (unsigned long long)out.docs_count, (unsigned long long)out.terms_count,
+                 (unsigned long long)out.postings_bytes, (unsigned long long)in_postings);
+    std::fprintf(stderr, "read=%.1f MB written=%.1f MB time=%.3f s (%.1f MB/s)\n",
+                 in_bytes / 1048576.0, out_bytes / 1048576.0, sec,
+                 sec > 0 ? (in_bytes + out_bytes) / 1048576.0 / sec : 0.0);
+    GapSize gs = {0, 0, 0};
+    if (!index_scan_postings(&out_path, 1, add_gaps, &gs)) {
+        std::fprintf(stderr, "Cannot read back %s\n", out_path);
+        return 1;
+    }
+    double per = (gs.postings ? 1.0 / gs.postings : 0.0);
+    std::fprintf(stderr, "gap-coded postings: varint=%llu bytes (%.2f bits/posting) gamma=%llu bytes (%.2f bits/posting)\n",
+                 (unsigned long long)gs.varint_bytes, gs.varint_bytes * 8.0 * per,
+                 (unsigned long long)((gs.gamma_bits + 7) / 8), gs.gamma_bits * per);
+    if (!(out.flags & IDX_FLAG_CF)) {
+        std::fprintf(stderr, "Warning: some inputs have no collection frequencies; the output has none either\n");
+    }
+    return 0;
+}
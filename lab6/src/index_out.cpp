@@ -0,0 +1,209 @@
+#include "index_out.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct IndexOut {
+#ifdef _WIN32
+    HANDLE h;
+#else
+    int fd;
+#endif
+    std::atomic<bool> ok;
+};
+
+#ifdef _WIN32
+
+IndexOut* index_out_open(const char* path) {
+    HANDLE h = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return nullptr;
+    IndexOut* f = new IndexOut();
+    f->h = h;
+    f->ok = true;
+    return f;
+}
+
+// WriteFile takes the position from the OVERLAPPED on a synchronous handle
+// too, so writers on different threads never share a file pointer.
+bool index_out_write_at(IndexOut* f, uint64_t off, const void* p, size_t n) {
+    const unsigned char* s = (const unsigned char*)p;
+    while (n > 0) {
+        DWORD chunk = (DWORD)(n < ((size_t)1 << 30) ? n : ((size_t)1 << 30));
+        OVERLAPPED ov;
+        std::memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)off;
+        ov.OffsetHigh = (DWORD)(off >> 32);
+        DWORD wr = 0;
+        if (!WriteFile(f->h, s, chunk, &wr, &ov) || wr == 0) {
+            f->ok = false;
+            return false;
+        }
+        s += wr;
+        off += wr;
+        n -= wr;
+    }
+    return true;
+}
+
+bool index_out_close(IndexOut* f) {
+    bool ok = f->ok;
+    if (!CloseHandle(f->h)) ok = false;
+    delete f;
+    return ok;
+}
+
+#else
+
+IndexOut* index_out_open(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return nullptr;
+    IndexOut* f = new IndexOut();
+    f->fd = fd;
+    f->ok = true;
+    return f;
+}
+
+bool index_out_write_at(IndexOut* f, uint64_t off, const void* p, size_t n) {
+    const unsigned char* s = (const unsigned char*)p;
+    while (n > 0) {
+        ssize_t wr = pwrite(f->fd, s, n, (off_t)off);
+        if (wr <= 0) {
+            f->ok = false;
+            return false;
+        }
+        s += wr;
+        off += (uint64_t)wr;
+        n -= (size_t)wr;
+    }
+    return true;
+}
+
+bool index_out_close(IndexOut* f) {
+    bool ok = f->ok;
+    if (close(f->fd) != 0) ok = false;
+    delete f;
+    return ok;
+}
+
+#endif
+
+bool index_out_header(IndexOut* f, const IndexHeader* h) {
+    unsigned char b[128];
+    std::memset(b, 0, sizeof(b));
+    uint32_t version = 2;
+    std::memcpy(b, "MAIIRIDX", 8);
+    std::memcpy(b + 8, &version, 4);
+    std::memcpy(b + 12, &h->flags, 4);
+    std::memcpy(b + 16, &h->docs_count, 8);
+    std::memcpy(b + 24, &h->terms_count, 8);
+    std::memcpy(b + 32, &h->dict_offset, 8);
+    std::memcpy(b + 40, &h->dict_bytes, 8);
+    std::memcpy(b + 48, &h->postings_offset, 8);
+    std::memcpy(b + 56, &h->postings_bytes, 8);
+    std::memcpy(b + 64, &h->docs_offset, 8);
+    std::memcpy(b + 72, &h->docs_bytes, 8);
+    std::memcpy(b + 80, &h->total_tokens, 8);
+    std::memcpy(b + 88, &h->doc_base, 8);
+    if (h->flags & IDX_FLAG_STEM) std::memcpy(b + 96, &h->stem, 4);
+    return index_out_write_at(f, 0, b, sizeof(b));
+}
+
+struct SectionFlusher {
+    IndexOut* f;
+    uint64_t off;
+    unsigned char* bufs[2];
+
+    const unsigned char* pending;
+    size_t pending_len;
+    uint64_t pending_off;
+    bool busy;
+    bool stopping;
+    bool ok;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::thread th;
+};
+
+static void flusher_main(SectionFlusher* s) {
+    std::unique_lock<std::mutex> lk(s->mu);
+    for (;;) {
+        s->cv.wait(lk, [s] { return s->busy || s->stopping; });
+        if (!s->busy) return;
+        const unsigned char* p = s->pending;
+        size_t n = s->pending_len;
+        uint64_t off = s->pending_off;
+        lk.unlock();
+        bool ok = index_out_write_at(s->f, off, p, n);
+        lk.lock();
+        if (!ok) s->ok = false;
+        s->busy = false;
+        s->cv.notify_all();
+    }
+}
+
+bool section_open(SectionWriter* w, IndexOut* f, uint64_t off) {
+    std::memset(w, 0, sizeof(*w));
+    SectionFlusher* s = new SectionFlusher();
+    s->f = f;
+    s->off = off;
+    s->bufs[0] = (unsigned char*)std::malloc(SECTION_BUF);
+    s->bufs[1] = (unsigned char*)std::malloc(SECTION_BUF);
+    if (!s->bufs[0] || !s->bufs[1]) {
+        std::free(s->bufs[0]);
+        std::free(s->bufs[1]);
+        delete s;
+        return false;
+    }
+    s->ok = true;
+    s->th = std::thread(flusher_main, s);
+    w->buf = s->bufs[0];
+    w->fl = s;
+    return true;
+}
+
+void section_flush(SectionWriter* w) {
+    if (w->len == 0) return;
+    SectionFlusher* s = w->fl;
+    std::unique_lock<std::mutex> lk(s->mu);
+    s->cv.wait(lk, [s] { return !s->busy; });
+    s->pending = w->buf;
+    s->pending_len = w->len;
+    s->pending_off = s->off + w->flushed;
+    s->busy = true;
+    s->cv.notify_all();
+    lk.unlock();
+
+    w->buf = (w->buf == s->bufs[0] ? s->bufs[1] : s->bufs[0]);
+    w->flushed += w->len;
+    w->len = 0;
+}
+
+bool section_close(SectionWriter* w) {
+    SectionFlusher* s = w->fl;
+    if (!s) return false;
+    section_flush(w);
+    {
+        std::unique_lock<std::mutex> lk(s->mu);
+        s->cv.wait(lk, [s] { return !s->busy; });
+        s->stopping = true;
+        s->cv.notify_all();
+    }
+    s->th.join();
+    bool ok = s->ok;
+    std::free(s->bufs[0]);
+    std::free(s->bufs[1]);
+    delete s;
+    w->buf = nullptr;
+    w->fl = nullptr;
+    return ok;
+}
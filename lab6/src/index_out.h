@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Positioned output for index.bin. Every section streams through its own
+// pair of SECTION_BUF buffers: while one fills, the section's writer thread
+// puts the other at its file offset in a single positioned write. Sections
+// are thus written side by side and in any order, and nothing seeks. They
+// start on IDX_ALIGN boundaries and SECTION_BUF is a multiple of it, so all
+// writes but a section's last are page-aligned in the file.
+struct IndexOut;
+struct SectionFlusher;
+
+static const uint64_t IDX_ALIGN = 4096;
+static const size_t SECTION_BUF = (size_t)8 << 20;
+
+inline uint64_t idx_align(uint64_t x) {
+    return (x + IDX_ALIGN - 1) & ~(IDX_ALIGN - 1);
+}
+
+// Header flags. CF: the u32 after df in each dictionary entry is the term's
+// collection frequency (saturated at 0xFFFFFFFF) and the first reserved
+// header u64 (offset 80) is the total token count. ALIGNED: the dictionary,
+// postings and docs sections start on IDX_ALIGN boundaries, so each can be
+// mapped on its own. SEGMENT: the file is one segment of a segment set (see
+// segments.h); doc ids run from doc_base + 1 and doc_base is the header u64
+// at offset 88. ROARING: postings are hybrid containers (see roaring.h)
+// instead of u32 arrays. STEM: every doc was tokenized by the indexer with
+// the StemMode stored as the u32 at offset 96, which queries must use too.
+static const uint32_t IDX_FLAG_CF = 0x4;
+static const uint32_t IDX_FLAG_ALIGNED = 0x8;
+static const uint32_t IDX_FLAG_SEGMENT = 0x10;
+static const uint32_t IDX_FLAG_ROARING = 0x20;
+static const uint32_t IDX_FLAG_STEM = 0x40;
+
+struct IndexHeader {
+    uint32_t flags;
+    uint64_t docs_count;
+    uint64_t terms_count;
+    uint64_t dict_offset;
+    uint64_t dict_bytes;
+    uint64_t postings_offset;
+    uint64_t postings_bytes;
+    uint64_t docs_offset;
+    uint64_t docs_bytes;
+    uint64_t total_tokens;
+    uint64_t doc_base;
+    uint32_t stem;
+};
+
+IndexOut* index_out_open(const char* path);
+bool index_out_write_at(IndexOut* f, uint64_t off, const void* p, size_t n);
+// Writes the 128-byte header (magic, version 2, h) at offset 0.
+bool index_out_header(IndexOut* f, const IndexHeader* h);
+// False if any write to the file failed.
+bool index_out_close(IndexOut* f);
+
+struct SectionWriter {
+    unsigned char* buf;
+    size_t len;
+    uint64_t flushed;
+    SectionFlusher* fl;
+};
+
+bool section_open(SectionWriter* w, IndexOut* f, uint64_t off);
+// Hands the filled buffer to the writer thread and switches to the other.
+void section_flush(SectionWriter* w);
+// Waits for the last write; false if any of the section's writes failed.
+bool section_close(SectionWriter* w);
+
+inline uint64_t section_size(const SectionWriter* w) {
+    return w->flushed + w->len;
+}
+
+// Room for n <= SECTION_BUF bytes; the caller fills them and advances len.
+inline unsigned char* section_reserve(SectionWriter* w, size_t n) {
+    if (w->len + n > SECTION_BUF) section_flush(w);
+    return w->buf + w->len;
+}
+
+inline void section_put(SectionWriter* w, const void* p, size_t n) {
+    const unsigned char* s = (const unsigned char*)p;
+    while (n > 0) {
+        if (w->len == SECTION_BUF) section_flush(w);
+        size_t m = SECTION_BUF - w->len;
+        if (m > n) m = n;
+        std::memcpy(w->buf + w->len, s, m);
+        w->len += m;
+        s += m;
+        n -= m;
+    }
+}
+
+inline void section_u32(SectionWriter* w, uint32_t v) {
+    std::memcpy(section_reserve(w, 4), &v, 4);
+    w->len += 4;
+}
+
+inline void section_u64(SectionWriter* w, uint64_t v) {
+    std::memcpy(section_reserve(w, 8), &v, 8);
+    w->len += 8;
+}
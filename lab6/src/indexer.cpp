@@ -1,9 +1,26 @@
 #include "win_files.h"
+#include "tokenize.h"
+#include "term_ids.h"
+#include "file_reader.h"
+#include "paths.h"
+#include "term_table.h"
+#include "index_out.h"
+#include "segments.h"
+#include "seg_merge.h"
+#include "index_merge.h"
+#include "doc_order.h"
 #include <windows.h>
+#include <cinttypes>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 static void die(const char* msg) {
     std::fprintf(stderr, "ERROR: %s\n", msg);
@@ -21,16 +38,6 @@ static double qpc_seconds(uint64_t t0, uint64_t t1) {
     return (double)(t1 - t0) / (double)f.QuadPart;
 }
 
-static uint64_t fnv1a64(const unsigned char* s, size_t n) {
-    uint64_t h = 1469598103934665603ULL;
-    for (size_t i = 0; i < n; ++i) {
-        h ^= (uint64_t)s[i];
-        h *= 1099511628211ULL;
-    }
-    if (h == 0) h = 1;
-    return h;
-}
-
 struct BytePool {
     unsigned char* buf;
     size_t len;
@@ -59,120 +66,244 @@ static uint32_t pool_add(BytePool* p, const unsigned char* s, size_t n) {
     return off;
 }
 
-static const uint32_t POST_BLOCK = 32;
-
-struct PostBlock {
+// Postings are accumulated as varint doc-id gaps in per-term chunks carved
+// from large slabs. A term's chunks double from POST_CHUNK_MIN to
+// POST_CHUNK_MAX bytes, so a term seen once costs one small chunk and a long
+// list a handful of links; nothing is freed one chunk at a time.
+struct PostChunk {
+    PostChunk* next;
+    uint32_t cap;
     uint32_t used;
-    uint32_t doc[POST_BLOCK];
-    PostBlock* next;
 };
 
+static const uint32_t POST_CHUNK_MIN = 16;
+static const uint32_t POST_CHUNK_MAX = 4096;
+static const size_t POST_SLAB = (size_t)1 << 20;
+
+static unsigned char* chunk_data(PostChunk* c) { return (unsigned char*)(c + 1); }
+
+// Bump allocator over POST_SLAB slabs; reset keeps the slabs for reuse.
+struct PostArena {
+    unsigned char** slabs;
+    size_t slabs_n;
+    size_t slabs_cap;
+    size_t cur;
+    size_t used;
+};
+
+static void arena_init(PostArena* a) {
+    std::memset(a, 0, sizeof(*a));
+}
+
+static void* arena_alloc(PostArena* a, size_t n) {
+    n = (n + 7) & ~(size_t)7;
+    if (a->slabs_n == 0 || a->used + n > POST_SLAB) {
+        if (a->slabs_n > 0) a->cur++;
+        if (a->cur == a->slabs_n) {
+            if (a->slabs_n == a->slabs_cap) {
+                size_t nc = (a->slabs_cap ? a->slabs_cap * 2 : 64);
+                unsigned char** ns = (unsigned char**)std::realloc(a->slabs, nc * sizeof(unsigned char*));
+                if (!ns) return nullptr;
+                a->slabs = ns;
+                a->slabs_cap = nc;
+            }
+            unsigned char* slab = (unsigned char*)std::malloc(POST_SLAB);
+            if (!slab) return nullptr;
+            a->slabs[a->slabs_n++] = slab;
+        }
+        a->used = 0;
+    }
+    void* p = a->slabs[a->cur] + a->used;
+    a->used += n;
+    return p;
+}
+
+static void arena_reset(PostArena* a) {
+    a->cur = 0;
+    a->used = 0;
+}
+
+static void arena_free(PostArena* a) {
+    for (size_t i = 0; i < a->slabs_n; ++i) std::free(a->slabs[i]);
+    std::free(a->slabs);
+    arena_init(a);
+}
+
+static size_t arena_bytes(const PostArena* a) {
+    return (a->slabs_n ? a->cur * POST_SLAB + a->used : 0);
+}
+
+// Terms are stored densely by term id. The pool keeps each term as a record
+// (u32 len, u32 term id, bytes) and `index` maps term bytes to record
+// offsets, so a lookup reads the table group and one record.
 struct TermEntry {
     uint64_t hash;
+    PostChunk* first;
+    PostChunk* last;
     uint32_t off;
     uint32_t len;
-    uint32_t term_id;
-    uint8_t used;
-    PostBlock* first;
-    PostBlock* last;
     uint32_t df;
+    uint32_t last_doc;
 };
 
 struct TermDict {
-    TermEntry* tab;
-    size_t cap;
+    TermTable index;
+    TermEntry* ents;
+    uint64_t* cf;
+    size_t ents_cap;
     size_t size;
     BytePool pool;
+    PostArena post;
+    uint32_t epoch;
 };
 
-static bool term_equals(const TermDict* d, const TermEntry* e, const unsigned char* s, size_t n) {
-    if (e->len != (uint32_t)n) return false;
-    return std::memcmp(d->pool.buf + e->off, s, n) == 0;
-}
+static const size_t TERM_REC_HDR = 8;
 
 static bool dict_init(TermDict* d, size_t cap) {
-    d->tab = (TermEntry*)std::calloc(cap, sizeof(TermEntry));
-    if (!d->tab) return false;
-    d->cap = cap;
+    if (!term_table_init(&d->index, cap)) return false;
+    d->ents = nullptr;
+    d->cf = nullptr;
+    d->ents_cap = 0;
     d->size = 0;
     pool_init(&d->pool);
+    arena_init(&d->post);
+    d->epoch = 0;
     return true;
 }
 
-static bool dict_rehash(TermDict* d, size_t new_cap) {
-    TermEntry* old = d->tab;
-    size_t old_cap = d->cap;
-
-    TermEntry* nt = (TermEntry*)std::calloc(new_cap, sizeof(TermEntry));
-    if (!nt) return false;
-
-    d->tab = nt;
-    d->cap = new_cap;
-    d->size = 0;
-
-    size_t mask = d->cap - 1;
-    for (size_t i = 0; i < old_cap; ++i) {
-        if (!old[i].used) continue;
-        size_t pos = (size_t)old[i].hash & mask;
-        while (d->tab[pos].used) pos = (pos + 1) & mask;
-        d->tab[pos] = old[i];
-        d->size++;
-    }
-
-    std::free(old);
-    return true;
+static uint32_t rec_u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
 }
 
 static bool dict_get_or_add(TermDict* d, const unsigned char* s, size_t n, uint32_t* out_term_id) {
-    if ((d->size + 1) * 10 >= d->cap * 7) {
-        if (!dict_rehash(d, d->cap * 2)) return false;
+    const TermEntry* ents = d->ents;
+    const unsigned char* pool = d->pool.buf;
+    if (!term_table_reserve(&d->index, d->size + 1,
+                            [&](uint32_t rec) { return ents[rec_u32(pool + rec + 4)].hash; })) {
+        return false;
     }
 
-    uint64_t h = fnv1a64(s, n);
-    size_t mask = d->cap - 1;
-    size_t pos = (size_t)h & mask;
-
-    while (d->tab[pos].used) {
-        TermEntry* e = &d->tab[pos];
-        if (e->hash == h && term_equals(d, e, s, n)) {
-            *out_term_id = e->term_id;
-            return true;
-        }
-        pos = (pos + 1) & mask;
+    uint64_t h = term_hash(s, n);
+    uint32_t new_rec = (uint32_t)d->pool.len;
+    uint32_t rec = term_table_find_or_insert(&d->index, h, new_rec, [&](uint32_t r) {
+        return rec_u32(pool + r) == (uint32_t)n && std::memcmp(pool + r + TERM_REC_HDR, s, n) == 0;
+    });
+    if (rec != new_rec) {
+        *out_term_id = rec_u32(pool + rec + 4);
+        return true;
     }
+    if (d->pool.len + TERM_REC_HDR + n > 0xFFFFFFFFULL) return false;
+
+    uint32_t hdr[2] = {(uint32_t)n, (uint32_t)d->size};
+    if (!pool_reserve(&d->pool, d->pool.len + TERM_REC_HDR + n)) return false;
+    std::memcpy(d->pool.buf + d->pool.len, hdr, TERM_REC_HDR);
+    std::memcpy(d->pool.buf + d->pool.len + TERM_REC_HDR, s, n);
+    d->pool.len += TERM_REC_HDR + n;
+
+    if (d->size == d->ents_cap) {
+        size_t nc = (d->ents_cap == 0 ? 65536 : d->ents_cap * 2);
+        TermEntry* ne = (TermEntry*)std::realloc(d->ents, nc * sizeof(TermEntry));
+        if (!ne) return false;
+        d->ents = ne;
+        uint64_t* nf = (uint64_t*)std::realloc(d->cf, nc * sizeof(uint64_t));
+        if (!nf) return false;
+        d->cf = nf;
+        d->ents_cap = nc;
+    }
+    d->cf[d->size] = 0;
 
-    uint32_t off = pool_add(&d->pool, s, n);
-    if (off == UINT32_MAX) return false;
-
-    TermEntry* ne = &d->tab[pos];
-    ne->used = 1;
-    ne->hash = h;
-    ne->off = off;
-    ne->len = (uint32_t)n;
-    ne->term_id = (uint32_t)d->size;
-    ne->first = ne->last = nullptr;
-    ne->df = 0;
+    TermEntry* e = &d->ents[d->size];
+    e->hash = h;
+    e->off = new_rec + (uint32_t)TERM_REC_HDR;
+    e->len = (uint32_t)n;
+    e->first = e->last = nullptr;
+    e->df = 0;
+    e->last_doc = 0;
 
+    *out_term_id = (uint32_t)d->size;
     d->size++;
-    *out_term_id = ne->term_id;
     return true;
 }
 
-static bool postings_append(TermEntry* e, uint32_t doc_id) {
-    if (!e->last || e->last->used == POST_BLOCK) {
-        PostBlock* b = (PostBlock*)std::calloc(1, sizeof(PostBlock));
-        if (!b) return false;
-        b->used = 0;
-        b->next = nullptr;
-        if (!e->first) e->first = b;
-        if (e->last) e->last->next = b;
-        e->last = b;
+static TermEntry* dict_entry(TermDict* d, uint32_t term_id) {
+    return &d->ents[term_id];
+}
+
+// Frees all postings and empties the dictionary, keeping its capacity.
+// epoch tells callers that cached term ids are gone.
+static void dict_clear(TermDict* d) {
+    term_table_clear(&d->index);
+    d->size = 0;
+    d->pool.len = 0;
+    arena_reset(&d->post);
+    d->epoch++;
+}
+
+static void dict_free(TermDict* d) {
+    dict_clear(d);
+    term_table_free(&d->index);
+    std::free(d->ents);
+    std::free(d->cf);
+    std::free(d->pool.buf);
+    arena_free(&d->post);
+}
+
+// Memory held by the terms and postings indexed so far. Index capacity is
+// counted at the 7/8 load factor, since it is kept across dict_clear.
+static size_t dict_live_bytes(const TermDict* d) {
+    return d->size * (sizeof(TermEntry) + sizeof(uint64_t) + (1 + sizeof(uint32_t)) * 8 / 7) +
+           d->pool.len + arena_bytes(&d->post);
+}
+
+// Doc ids arrive in increasing order per term, so gaps are positive.
+static bool postings_append(TermDict* d, TermEntry* e, uint32_t doc_id) {
+    PostChunk* c = e->last;
+    if (!c || c->used + 5 > c->cap) {
+        uint32_t cap = (c ? (c->cap * 2 < POST_CHUNK_MAX ? c->cap * 2 : POST_CHUNK_MAX) : POST_CHUNK_MIN);
+        PostChunk* nc = (PostChunk*)arena_alloc(&d->post, sizeof(PostChunk) + cap);
+        if (!nc) return false;
+        nc->next = nullptr;
+        nc->cap = cap;
+        nc->used = 0;
+        if (c) c->next = nc;
+        else e->first = nc;
+        e->last = c = nc;
     }
-    e->last->doc[e->last->used++] = doc_id;
+    c->used += (uint32_t)varint_put(doc_id - e->last_doc, chunk_data(c) + c->used);
+    e->last_doc = doc_id;
     e->df += 1;
     return true;
 }
 
+// Decodes a term's postings and hands them to put(ids, n) as u32 doc ids,
+// up to 1024 at a time.
+template <typename Put>
+static void postings_decode(const TermEntry* e, Put put) {
+    uint32_t buf[1024];
+    size_t n = 0;
+    uint32_t doc = 0;
+    for (PostChunk* c = e->first; c; c = c->next) {
+        const unsigned char* p = chunk_data(c);
+        size_t pos = 0;
+        uint32_t gap;
+        while (pos < c->used && varint_get(p, c->used, &pos, &gap)) {
+            doc += gap;
+            buf[n++] = doc;
+            if (n == 1024) {
+                put(buf, n);
+                n = 0;
+            }
+        }
+    }
+    if (n) put(buf, n);
+}
+
+static void postings_write(const TermEntry* e, FILE* f) {
+    postings_decode(e, [f](const uint32_t* ids, size_t n) { std::fwrite(ids, 4, n, f); });
+}
+
 struct DocSet {
     uint32_t* tab;
     size_t cap;
@@ -250,25 +381,6 @@ static void docset_free(DocSet* s) {
     s->size = 0;
 }
 
-static bool read_all(const char* path, unsigned char** buf, size_t* n) {
-    *buf = nullptr; *n = 0;
-    FILE* f = std::fopen(path, "rb");
-    if (!f) return false;
-    if (std::fseek(f, 0, SEEK_END) != 0) { std::fclose(f); return false; }
-    long sz = std::ftell(f);
-    if (sz < 0) { std::fclose(f); return false; }
-    if (std::fseek(f, 0, SEEK_SET) != 0) { std::fclose(f); return false; }
-    unsigned char* b = (unsigned char*)std::malloc((size_t)sz + 1);
-    if (!b) { std::fclose(f); return false; }
-    size_t rd = std::fread(b, 1, (size_t)sz, f);
-    std::fclose(f);
-    if (rd != (size_t)sz) { std::free(b); return false; }
-    b[sz] = 0;
-    *buf = b;
-    *n = (size_t)sz;
-    return true;
-}
-
 static uint32_t parse_doc_id_from_name(const char* name) {
     uint32_t v = 0;
     for (int i = 0; i < 8 && name[i]; ++i) {
@@ -312,6 +424,25 @@ static bool fl_push(FileList* fl, uint32_t doc_id, const char* full, const char*
     return true;
 }
 
+// Starts a FileReader over the listed files; items come back in list order.
+// Documents are indexed from whole buffers, so there is no size limit.
+static FileReader* fl_reader(const FileList* fl, size_t threads, const char*** paths) {
+    *paths = (const char**)std::malloc((fl->n + 1) * sizeof(const char*));
+    if (!*paths) die("reader paths OOM");
+    for (size_t i = 0; i < fl->n; ++i) (*paths)[i] = fl->a[i].full;
+    FileReader* r = file_reader_start(*paths, fl->n, threads, 4 * threads + 16, SIZE_MAX);
+    if (!r) die("file_reader_start failed");
+    return r;
+}
+
+static void fl_read_next(FileReader* r, ReadItem* it, const FileList* fl) {
+    if (!file_reader_next(r, it)) die("file reader stopped early");
+    if (!it->ok) {
+        std::fprintf(stderr, "ERROR: cannot read %s\n", fl->a[it->index].full);
+        std::exit(1);
+    }
+}
+
 static void fl_free(FileList* fl) {
     for (size_t i = 0; i < fl->n; ++i) {
         std::free(fl->a[i].full);
@@ -424,53 +555,525 @@ static bool read_meta_any(const char* path, LocalMeta** out_meta, uint32_t* out_
     return true;
 }
 
-static TermEntry** build_entries_by_id(TermDict* d) {
-    TermEntry** by = (TermEntry**)std::malloc(d->size * sizeof(TermEntry*));
-    if (!by) return nullptr;
-    for (size_t i = 0; i < d->cap; ++i) {
-        if (d->tab[i].used) by[d->tab[i].term_id] = &d->tab[i];
+// Dictionary order: multikey quicksort over 8-byte big-endian chunks of the
+// terms. Each item carries its current chunk, so most comparisons are one
+// integer compare on contiguous memory; items equal on a chunk move on to
+// the next one only if their terms go on past it. rest is the number of
+// term bytes in the chunk, which puts a term before its extensions.
+struct SortItem {
+    uint64_t key;
+    uint32_t off;
+    uint32_t len;
+    uint32_t id;
+    uint32_t rest;
+};
+
+static const size_t SORT_SMALL = 16;
+
+static void sort_load_key(SortItem* it, const unsigned char* pool, size_t depth) {
+    size_t rem = (it->len > depth ? it->len - depth : 0);
+    const unsigned char* p = pool + it->off + depth;
+    uint64_t k = 0;
+    if (rem >= 8) {
+        std::memcpy(&k, p, 8);
+        k = __builtin_bswap64(k);
+        rem = 8;
+    } else {
+        for (size_t i = 0; i < rem; ++i) k |= (uint64_t)p[i] << (56 - 8 * i);
     }
-    return by;
+    it->key = k;
+    it->rest = (uint32_t)rem;
 }
 
-static int term_cmp(const TermDict* d, const TermEntry* a, const TermEntry* b) {
-    const unsigned char* sa = d->pool.buf + a->off;
-    const unsigned char* sb = d->pool.buf + b->off;
-    size_t na = a->len, nb = b->len;
-    size_t m = (na < nb ? na : nb);
-    int c = std::memcmp(sa, sb, m);
-    if (c != 0) return c;
-    if (na < nb) return -1;
-    if (na > nb) return 1;
+static int sort_cmp_chunk(const SortItem* a, const SortItem* b) {
+    if (a->key != b->key) return (a->key < b->key ? -1 : 1);
+    if (a->rest != b->rest) return (a->rest < b->rest ? -1 : 1);
     return 0;
 }
 
-static void term_qsort(uint32_t* ids, int l, int r, const TermDict* d, TermEntry** by_id) {
-    while (l < r) {
-        uint32_t pivot_id = ids[(l + r) / 2];
-        TermEntry* pivot = by_id[pivot_id];
-        int i = l, j = r;
-        while (i <= j) {
-            while (term_cmp(d, by_id[ids[i]], pivot) < 0) i++;
-            while (term_cmp(d, by_id[ids[j]], pivot) > 0) j--;
-            if (i <= j) {
-                uint32_t tmp = ids[i]; ids[i] = ids[j]; ids[j] = tmp;
-                i++; j--;
+static bool sort_less(const SortItem* a, const SortItem* b, const unsigned char* pool, size_t depth) {
+    int c = sort_cmp_chunk(a, b);
+    if (c != 0) return c < 0;
+    if (a->rest < 8) return false;
+    size_t na = a->len - depth - 8, nb = b->len - depth - 8;
+    c = std::memcmp(pool + a->off + depth + 8, pool + b->off + depth + 8, (na < nb ? na : nb));
+    if (c != 0) return c < 0;
+    return na < nb;
+}
+
+static void sort_swap(SortItem* a, SortItem* b) {
+    SortItem t = *a; *a = *b; *b = t;
+}
+
+static void mkqs(SortItem* a, size_t n, const unsigned char* pool, size_t depth) {
+    while (n > SORT_SMALL) {
+        SortItem* x = &a[0];
+        SortItem* y = &a[n / 2];
+        SortItem* z = &a[n - 1];
+        if (sort_cmp_chunk(x, y) > 0) { SortItem* t = x; x = y; y = t; }
+        if (sort_cmp_chunk(y, z) > 0) { y = z; if (sort_cmp_chunk(x, y) > 0) y = x; }
+        SortItem pv = *y;
+
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt) {
+            int c = sort_cmp_chunk(&a[i], &pv);
+            if (c < 0) sort_swap(&a[lt++], &a[i++]);
+            else if (c > 0) sort_swap(&a[i], &a[--gt]);
+            else i++;
+        }
+
+        if (pv.rest == 8 && gt - lt > 1) {
+            for (size_t k = lt; k < gt; ++k) {
+                if (k + 8 < gt) __builtin_prefetch(pool + a[k + 8].off + depth + 8);
+                sort_load_key(&a[k], pool, depth + 8);
             }
+            mkqs(a + lt, gt - lt, pool, depth + 8);
         }
-        if (j - l < r - i) {
-            if (l < j) term_qsort(ids, l, j, d, by_id);
-            l = i;
+        if (lt < n - gt) {
+            mkqs(a, lt, pool, depth);
+            a += gt;
+            n -= gt;
         } else {
-            if (i < r) term_qsort(ids, i, r, d, by_id);
-            r = j;
+            mkqs(a + gt, n - gt, pool, depth);
+            n = lt;
+        }
+    }
+    for (size_t i = 1; i < n; ++i) {
+        SortItem v = a[i];
+        size_t j = i;
+        while (j > 0 && sort_less(&v, &a[j - 1], pool, depth)) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = v;
+    }
+}
+
+// Writes the term ids of d in dictionary order. A counting pass on the first
+// two bytes splits the terms into buckets, which `threads` workers sort
+// independently.
+static void term_sort(const TermDict* d, uint32_t* ids, size_t threads) {
+    size_t n = d->size;
+    if (n == 0) return;
+    const unsigned char* pool = d->pool.buf;
+    SortItem* b = (SortItem*)std::malloc(n * sizeof(SortItem));
+    size_t* start = (size_t*)std::calloc(65536 + 1, sizeof(size_t));
+    if (!b || !start) die("term sort OOM");
+
+    for (size_t i = 0; i < n; ++i) {
+        SortItem it;
+        it.off = d->ents[i].off;
+        it.len = d->ents[i].len;
+        sort_load_key(&it, pool, 0);
+        start[(it.key >> 48) + 1]++;
+    }
+    for (size_t k = 0; k < 65536; ++k) start[k + 1] += start[k];
+    for (size_t i = 0; i < n; ++i) {
+        SortItem it;
+        it.off = d->ents[i].off;
+        it.len = d->ents[i].len;
+        it.id = (uint32_t)i;
+        sort_load_key(&it, pool, 0);
+        b[start[it.key >> 48]++] = it;
+    }
+    for (size_t k = 65536; k > 0; --k) start[k] = start[k - 1];
+    start[0] = 0;
+
+    std::atomic<size_t> next(0);
+    auto work = [&] {
+        for (;;) {
+            size_t k = next.fetch_add(1);
+            if (k >= 65536) return;
+            if (start[k + 1] - start[k] > 1) mkqs(b + start[k], start[k + 1] - start[k], pool, 0);
         }
+    };
+    if (threads <= 1 || n < ((size_t)1 << 16)) {
+        work();
+    } else {
+        std::vector<std::thread> pool_threads;
+        for (size_t t = 0; t < threads; ++t) pool_threads.emplace_back(work);
+        for (auto& th : pool_threads) th.join();
     }
+
+    for (size_t i = 0; i < n; ++i) ids[i] = b[i].id;
+    std::free(b);
+    std::free(start);
 }
 
 static void wr_u32(FILE* f, uint32_t v) { std::fwrite(&v, 1, 4, f); }
 static void wr_u64(FILE* f, uint64_t v) { std::fwrite(&v, 1, 8, f); }
 
+static uint32_t cf_u32(uint64_t cf) {
+    return cf > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)cf;
+}
+
+// SPIMI: once the dictionary and its postings outgrow --mem-mb, the terms
+// are sorted and written out as run k and indexing continues with an empty
+// dictionary. <out>.run<k>.dict holds (u32 len, term, u32 df, u64 cf) per
+// term, <out>.run<k>.post the doc ids in the same order. Doc ids only grow,
+// so a term's final postings are its run lists concatenated in run order.
+static const size_t RUN_IO_BUF = (size_t)1 << 20;
+
+static void run_path(char* out, size_t out_sz, const char* out_bin, uint32_t k, const char* ext) {
+    std::snprintf(out, out_sz, "%s.run%u.%s", out_bin, k, ext);
+}
+
+static FILE* open_run(const char* out_bin, uint32_t k, const char* ext, const char* mode) {
+    char p[1024];
+    run_path(p, sizeof(p), out_bin, k, ext);
+    FILE* f = std::fopen(p, mode);
+    if (!f) die("cannot open run file");
+    std::setvbuf(f, nullptr, _IOFBF, RUN_IO_BUF);
+    return f;
+}
+
+static void spimi_flush(TermDict* d, const char* out_bin, uint32_t k) {
+    uint32_t n = (uint32_t)d->size;
+    uint32_t* ids = (uint32_t*)std::malloc(((size_t)n + 1) * sizeof(uint32_t));
+    if (!ids) die("run ids OOM");
+    term_sort(d, ids, 1);
+
+    FILE* fd = open_run(out_bin, k, "dict", "wb");
+    FILE* fp = open_run(out_bin, k, "post", "wb");
+    for (uint32_t si = 0; si < n; ++si) {
+        TermEntry* e = &d->ents[ids[si]];
+        wr_u32(fd, e->len);
+        std::fwrite(d->pool.buf + e->off, 1, e->len, fd);
+        wr_u32(fd, e->df);
+        wr_u64(fd, d->cf[ids[si]]);
+        postings_write(e, fp);
+    }
+    if (std::ferror(fd) || std::ferror(fp)) die("run write failed");
+    if (std::fclose(fd) != 0 || std::fclose(fp) != 0) die("run write failed");
+
+    std::free(ids);
+    dict_clear(d);
+}
+
+// Merge input: run file `run`, or a dictionary still in memory (`mem`).
+// Sources are listed in doc-id order.
+struct MergeSrc {
+    TermDict* mem;
+    uint32_t run;
+};
+
+struct RunReader {
+    FILE* dict;
+    FILE* post;
+    const TermDict* mem;
+    uint32_t* ids;
+    uint32_t pos;
+    TermEntry* e;
+    const unsigned char* term;
+    unsigned char* buf;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t df;
+    uint64_t cf;
+};
+
+static bool run_next(RunReader* r) {
+    if (r->mem) {
+        if (r->pos == r->mem->size) return false;
+        uint32_t id = r->ids[r->pos++];
+        r->e = &r->mem->ents[id];
+        r->term = r->mem->pool.buf + r->e->off;
+        r->len = r->e->len;
+        r->df = r->e->df;
+        r->cf = r->mem->cf[id];
+        return true;
+    }
+    uint32_t len;
+    if (std::fread(&len, 1, 4, r->dict) != 4) return false;
+    if (len > r->cap) {
+        unsigned char* nt = (unsigned char*)std::realloc(r->buf, len);
+        if (!nt) die("run term OOM");
+        r->buf = nt;
+        r->cap = len;
+    }
+    if (std::fread(r->buf, 1, len, r->dict) != len) die("truncated run dictionary");
+    if (std::fread(&r->df, 1, 4, r->dict) != 4) die("truncated run dictionary");
+    if (std::fread(&r->cf, 1, 8, r->dict) != 8) die("truncated run dictionary");
+    r->term = r->buf;
+    r->len = len;
+    return true;
+}
+
+// Heap order: term bytes, then source index, so sources sharing a term come
+// out in doc-id order.
+static bool run_less(const RunReader* rs, uint32_t a, uint32_t b) {
+    size_t m = (rs[a].len < rs[b].len ? rs[a].len : rs[b].len);
+    int c = std::memcmp(rs[a].term, rs[b].term, m);
+    if (c != 0) return c < 0;
+    if (rs[a].len != rs[b].len) return rs[a].len < rs[b].len;
+    return a < b;
+}
+
+static void run_heap_down(uint32_t* h, size_t n, size_t i, const RunReader* rs) {
+    for (;;) {
+        size_t l = 2 * i + 1, m = i;
+        if (l < n && run_less(rs, h[l], h[m])) m = l;
+        if (l + 1 < n && run_less(rs, h[l + 1], h[m])) m = l + 1;
+        if (m == i) return;
+        uint32_t t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+// k-way merge over sorted dictionaries; on_term(srcs, m) gets the sources
+// holding the smallest remaining term, in source order, and may read their
+// postings before they advance.
+template <typename Fn>
+static void merge_runs(RunReader* rs, uint32_t k, Fn on_term) {
+    uint32_t* heap = (uint32_t*)std::malloc(((size_t)k + 1) * sizeof(uint32_t));
+    uint32_t* same = (uint32_t*)std::malloc(((size_t)k + 1) * sizeof(uint32_t));
+    if (!heap || !same) die("merge heap OOM");
+    size_t n = 0;
+    for (uint32_t r = 0; r < k; ++r) {
+        if (run_next(&rs[r])) heap[n++] = r;
+    }
+    for (size_t i = n / 2; i-- > 0;) run_heap_down(heap, n, i, rs);
+
+    while (n > 0) {
+        size_t m = 0;
+        same[m++] = heap[0];
+        heap[0] = heap[--n];
+        run_heap_down(heap, n, 0, rs);
+        while (n > 0 && rs[heap[0]].len == rs[same[0]].len &&
+               std::memcmp(rs[heap[0]].term, rs[same[0]].term, rs[same[0]].len) == 0) {
+            same[m++] = heap[0];
+            heap[0] = heap[--n];
+            run_heap_down(heap, n, 0, rs);
+        }
+
+        on_term(same, m);
+
+        for (size_t j = 0; j < m; ++j) {
+            if (!run_next(&rs[same[j]])) continue;
+            size_t i = n++;
+            heap[i] = same[j];
+            while (i > 0 && run_less(rs, heap[i], heap[(i - 1) / 2])) {
+                uint32_t t = heap[i]; heap[i] = heap[(i - 1) / 2]; heap[(i - 1) / 2] = t;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+    std::free(heap);
+    std::free(same);
+}
+
+struct MergeTotals {
+    uint64_t terms;
+    uint64_t dict_offset;
+    uint64_t dict_bytes;
+    uint64_t postings_offset;
+    uint64_t postings_bytes;
+    uint64_t sum_term_bytes;
+};
+
+static void open_sources(RunReader* rs, const MergeSrc* srcs, uint32_t k, const char* out_bin, bool postings) {
+    for (uint32_t r = 0; r < k; ++r) {
+        rs[r].pos = 0;
+        if (rs[r].mem) continue;
+        rs[r].dict = open_run(out_bin, srcs[r].run, "dict", "rb");
+        rs[r].post = (postings ? open_run(out_bin, srcs[r].run, "post", "rb") : nullptr);
+    }
+}
+
+static void close_sources(RunReader* rs, uint32_t k) {
+    for (uint32_t r = 0; r < k; ++r) {
+        if (rs[r].dict) std::fclose(rs[r].dict);
+        if (rs[r].post) std::fclose(rs[r].post);
+        rs[r].dict = rs[r].post = nullptr;
+    }
+}
+
+// Readers over srcs[0, k); in-memory dictionaries are sorted here, one
+// thread each, with the cores shared out among them.
+static RunReader* readers_open(const MergeSrc* srcs, uint32_t k) {
+    RunReader* rs = (RunReader*)std::calloc((size_t)k + 1, sizeof(RunReader));
+    if (!rs) die("run readers OOM");
+
+    size_t mems = 0;
+    for (uint32_t r = 0; r < k; ++r) mems += (srcs[r].mem != nullptr);
+    size_t sort_threads = std::thread::hardware_concurrency();
+    if (sort_threads > 8) sort_threads = 8;
+    sort_threads = (mems > 0 && sort_threads > mems ? sort_threads / mems : 1);
+
+    std::vector<std::thread> sorters;
+    for (uint32_t r = 0; r < k; ++r) {
+        if (!srcs[r].mem) continue;
+        rs[r].mem = srcs[r].mem;
+        sorters.emplace_back([rs, r, sort_threads] {
+            RunReader* x = &rs[r];
+            uint32_t n = (uint32_t)x->mem->size;
+            x->ids = (uint32_t*)std::malloc(((size_t)n + 1) * sizeof(uint32_t));
+            if (!x->ids) die("merge sort OOM");
+            term_sort(x->mem, x->ids, sort_threads);
+        });
+    }
+    for (auto& th : sorters) th.join();
+    return rs;
+}
+
+// Closes the readers and removes the run files behind them.
+static void readers_free(RunReader* rs, const MergeSrc* srcs, uint32_t k, const char* out_bin) {
+    close_sources(rs, k);
+    for (uint32_t r = 0; r < k; ++r) {
+        std::free(rs[r].buf);
+        std::free(rs[r].ids);
+        if (rs[r].mem) continue;
+        char p[1024];
+        run_path(p, sizeof(p), out_bin, srcs[r].run, "dict");
+        std::remove(p);
+        run_path(p, sizeof(p), out_bin, srcs[r].run, "post");
+        std::remove(p);
+    }
+    std::free(rs);
+}
+
+static void copy_postings(RunReader* r, FILE* to, unsigned char* copy) {
+    if (r->mem) {
+        postings_write(r->e, to);
+        return;
+    }
+    uint64_t left = (uint64_t)r->df * 4ULL;
+    while (left > 0) {
+        size_t chunk = (left < RUN_IO_BUF ? (size_t)left : RUN_IO_BUF);
+        if (std::fread(copy, 1, chunk, r->post) != chunk) die("truncated run postings");
+        std::fwrite(copy, 1, chunk, to);
+        left -= chunk;
+    }
+}
+
+static void copy_postings_out(RunReader* r, SectionWriter* w) {
+    if (r->mem) {
+        postings_decode(r->e, [w](const uint32_t* ids, size_t n) { section_put(w, ids, n * 4); });
+        return;
+    }
+    uint64_t left = (uint64_t)r->df * 4ULL;
+    while (left > 0) {
+        size_t chunk = (left < RUN_IO_BUF ? (size_t)left : RUN_IO_BUF);
+        unsigned char* p = section_reserve(w, chunk);
+        if (std::fread(p, 1, chunk, r->post) != chunk) die("truncated run postings");
+        w->len += chunk;
+        left -= chunk;
+    }
+}
+
+// Upper bound on sources merged at once; each run holds two open files.
+static const uint32_t MERGE_FAN_IN = 64;
+
+static void merge_into_run(const char* out_bin, const MergeSrc* srcs, uint32_t k, uint32_t dst,
+                           unsigned char* copy) {
+    RunReader* rs = readers_open(srcs, k);
+    open_sources(rs, srcs, k, out_bin, true);
+    FILE* fd = open_run(out_bin, dst, "dict", "wb");
+    FILE* fp = open_run(out_bin, dst, "post", "wb");
+    merge_runs(rs, k, [&](const uint32_t* same, size_t m) {
+        uint64_t df = 0, cf = 0;
+        for (size_t j = 0; j < m; ++j) {
+            df += rs[same[j]].df;
+            cf += rs[same[j]].cf;
+            copy_postings(&rs[same[j]], fp, copy);
+        }
+        wr_u32(fd, rs[same[0]].len);
+        std::fwrite(rs[same[0]].term, 1, rs[same[0]].len, fd);
+        wr_u32(fd, (uint32_t)df);
+        wr_u64(fd, cf);
+    });
+    if (std::ferror(fd) || std::ferror(fp)) die("run write failed");
+    if (std::fclose(fd) != 0 || std::fclose(fp) != 0) die("run write failed");
+    readers_free(rs, srcs, k, out_bin);
+}
+
+// Merges consecutive groups of sources into new runs until at most
+// MERGE_FAN_IN are left; returns the new count. Merged dictionaries are freed.
+static uint32_t merge_cascade(const char* out_bin, MergeSrc* srcs, uint32_t k, uint32_t* next_run,
+                              unsigned char* copy) {
+    while (k > MERGE_FAN_IN) {
+        uint32_t nk = 0;
+        for (uint32_t g = 0; g < k; g += MERGE_FAN_IN) {
+            uint32_t m = (k - g < MERGE_FAN_IN ? k - g : MERGE_FAN_IN);
+            if (m == 1) {
+                srcs[nk++] = srcs[g];
+                continue;
+            }
+            uint32_t dst = (*next_run)++;
+            merge_into_run(out_bin, srcs + g, m, dst, copy);
+            for (uint32_t j = g; j < g + m; ++j) {
+                if (!srcs[j].mem) continue;
+                dict_free(srcs[j].mem);
+                std::free(srcs[j].mem);
+            }
+            srcs[nk].mem = nullptr;
+            srcs[nk].run = dst;
+            nk++;
+        }
+        k = nk;
+    }
+    return k;
+}
+
+// Two passes over the sources. The first sizes the dictionary and the
+// postings, which fixes where every section goes; on_sized gets the totals
+// and may start on the other sections. The second streams dictionary entries
+// and postings into their sections of `out`. Run files are removed
+// afterwards; *k is updated if runs were cascaded.
+template <typename OnSized>
+static void merge_sources(const char* out_bin, MergeSrc* srcs, uint32_t* k, uint32_t* next_run,
+                          IndexOut* out, uint64_t dict_offset, MergeTotals* t, OnSized on_sized) {
+    unsigned char* copy = (unsigned char*)std::malloc(RUN_IO_BUF);
+    if (!copy) die("copy buffer OOM");
+    *k = merge_cascade(out_bin, srcs, *k, next_run, copy);
+    std::free(copy);
+    uint32_t n = *k;
+
+    RunReader* rs = readers_open(srcs, n);
+
+    std::memset(t, 0, sizeof(*t));
+    open_sources(rs, srcs, n, out_bin, false);
+    merge_runs(rs, n, [&](const uint32_t* same, size_t m) {
+        t->terms++;
+        t->dict_bytes += 4ULL + rs[same[0]].len + 16ULL;
+        t->sum_term_bytes += rs[same[0]].len;
+        for (size_t j = 0; j < m; ++j) t->postings_bytes += rs[same[j]].df * 4ULL;
+    });
+    close_sources(rs, n);
+    t->dict_offset = dict_offset;
+    t->postings_offset = idx_align(dict_offset + t->dict_bytes);
+    on_sized(*t);
+
+    SectionWriter dict_w, post_w;
+    if (!section_open(&dict_w, out, t->dict_offset) || !section_open(&post_w, out, t->postings_offset)) {
+        die("section buffers OOM");
+    }
+
+    open_sources(rs, srcs, n, out_bin, true);
+    uint64_t cur = 0;
+    merge_runs(rs, n, [&](const uint32_t* same, size_t m) {
+        const RunReader* first = &rs[same[0]];
+        uint64_t df = 0, cf = 0;
+        for (size_t j = 0; j < m; ++j) {
+            df += rs[same[j]].df;
+            cf += rs[same[j]].cf;
+        }
+        section_u32(&dict_w, first->len);
+        section_put(&dict_w, first->term, first->len);
+        section_u64(&dict_w, cur);
+        section_u32(&dict_w, (uint32_t)df);
+        section_u32(&dict_w, cf_u32(cf));
+
+        for (size_t j = 0; j < m; ++j) copy_postings_out(&rs[same[j]], &post_w);
+        cur += df * 4ULL;
+    });
+    if (cur != t->postings_bytes || section_size(&dict_w) != t->dict_bytes) die("merge size mismatch");
+
+    if (!section_close(&dict_w)) die("dictionary write failed");
+    if (!section_close(&post_w)) die("postings write failed");
+    readers_free(rs, srcs, n, out_bin);
+}
+
 struct EnumCtx { FileList* fl; };
 
 static void on_tok(const char* full_path, const char* file_name, void* user) {
@@ -483,10 +1086,378 @@ static void on_tok(const char* full_path, const char* file_name, void* user) {
 static void usage() {
     std::fprintf(stderr,
         "Usage:\n"
-        "  indexer.exe --add <tok_dir> <meta_tsv> --add <tok_dir> <meta_tsv> <out_index_bin>\n"
+        "  indexer.exe [--stem=none|simple|snowball] --add <tok_dir> <meta_tsv> | --add-raw <docs_dir> <meta_tsv> | --add-tid <tid_dir> <meta_tsv> ... <out_index_bin>\n"
+        "  --add-tid reads varint term-id files (.tid) and <tid_dir>\\terms.dict written by tokenize.exe --tid.\n"
+        "  --add-raw tokenizes raw .txt documents in a reader/tokenizer/indexer pipeline without .tok files.\n"
+        "  --stem selects the stemmer for all --add-raw sources (default: simple).\n"
+        "  --read-threads=N sets how many files are read ahead in parallel (default 4).\n"
+        "  --threads=N indexes each source with N workers over contiguous doc-id ranges\n"
+        "    (default: hardware threads, up to 8); their partial indexes are merged by term.\n"
+        "  --mem-mb=N caps dictionary and postings memory; when it is reached they are\n"
+        "    flushed to sorted runs next to <out_index_bin> and merged at the end (default 1024, 0 = no cap).\n"
+        "  --into=<dir> adds the sources as a new segment of the segment set in <dir> instead of\n"
+        "    writing <out_index_bin>; doc ids continue after the set's last one.\n"
+        "  --reorder=url|title|bp renumbers the docs before the postings of <out_index_bin> are\n"
+        "    written (see index_merge.exe); not with --into.\n"
+        "  indexer.exe --delete <dir> <doc_id>... marks documents of a segment set as deleted.\n"
+        "  indexer.exe --compact <dir> [--watch=SEC] merges segments by the tiered policy until none\n"
+        "    is due; with --watch it keeps checking every SEC seconds.\n"
     );
 }
 
+static int delete_main(int argc, char** argv) {
+    const char* dir = argv[2];
+    SegLock lk;
+    if (!seg_lock(dir, &lk)) die("cannot lock segment dir");
+    SegManifest m;
+    Tombstones del;
+    if (!manifest_load(dir, &m)) die("bad segment manifest");
+    if (!tombstones_load(dir, &del)) die("cannot read tombstones");
+    uint32_t marked = 0;
+    for (int i = 3; i < argc; ++i) {
+        uint32_t id = (uint32_t)std::strtoul(argv[i], nullptr, 10);
+        if (id == 0 || id > m.next_doc) die("doc id out of range");
+        if (tombstones_has(&del, id)) continue;
+        if (!tombstones_set(&del, id)) die("tombstones OOM");
+        marked++;
+    }
+    m.version++;
+    if (!tombstones_save(dir, &del) || !manifest_save(dir, &m)) die("cannot update segment set");
+    seg_unlock(&lk);
+    std::fprintf(stderr, "deleted=%u\n", marked);
+    tombstones_free(&del);
+    manifest_free(&m);
+    return 0;
+}
+
+static int compact_main(int argc, char** argv) {
+    const char* dir = argv[2];
+    int watch = 0;
+    for (int i = 3; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--watch=", 8) == 0) watch = std::atoi(argv[i] + 8);
+    }
+    for (;;) {
+        int merged = 0, r;
+        while ((r = seg_compact_once(dir)) > 0) merged++;
+        if (r < 0) die("segment merge failed");
+        if (merged) std::fprintf(stderr, "compact: merges=%d\n", merged);
+        if (watch <= 0) return 0;
+        std::this_thread::sleep_for(std::chrono::seconds(watch));
+    }
+}
+
+// Fixed-capacity FIFO between pipeline stages; push blocks while full and
+// pop blocks while empty, so each stage runs at most `cap` items ahead.
+template <typename T>
+struct BoundedQueue {
+    T* a;
+    size_t cap;
+    size_t head;
+    size_t count;
+    bool closed;
+    std::mutex mu;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+
+    explicit BoundedQueue(size_t c) : a(nullptr), cap(c), head(0), count(0), closed(false) {
+        a = (T*)std::malloc(cap * sizeof(T));
+        if (!a) die("queue OOM");
+    }
+    ~BoundedQueue() { std::free(a); }
+
+    void push(const T& v) {
+        std::unique_lock<std::mutex> lk(mu);
+        not_full.wait(lk, [&] { return count < cap; });
+        a[(head + count) % cap] = v;
+        count++;
+        not_empty.notify_one();
+    }
+
+    bool pop(T* out) {
+        std::unique_lock<std::mutex> lk(mu);
+        not_empty.wait(lk, [&] { return count > 0 || closed; });
+        if (count == 0) return false;
+        *out = a[head];
+        head = (head + 1) % cap;
+        count--;
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lk(mu);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+static const size_t PIPE_QUEUE_DOCS = 64;
+
+// A document travelling through the pipeline: raw bytes after the reader,
+// newline-separated terms (the .tok layout) after the tokenizer.
+struct PipeDoc {
+    uint32_t local_doc_id;
+    unsigned char* buf;
+    size_t n;
+    size_t bytes_in;
+};
+
+struct TokBuf {
+    unsigned char* buf;
+    size_t len;
+    size_t cap;
+};
+
+static bool tokbuf_sink(const unsigned char* tok, size_t len, void* user) {
+    TokBuf* b = (TokBuf*)user;
+    if (b->len + len + 1 > b->cap) {
+        size_t nc = (b->cap == 0 ? 4096 : b->cap);
+        while (nc < b->len + len + 1) nc *= 2;
+        unsigned char* nb = (unsigned char*)std::realloc(b->buf, nc);
+        if (!nb) return false;
+        b->buf = nb;
+        b->cap = nc;
+    }
+    std::memcpy(b->buf + b->len, tok, len);
+    b->len += len;
+    b->buf[b->len++] = '\n';
+    return true;
+}
+
+struct StageTimes {
+    double read_sec;
+    double tokenize_sec;
+    double index_sec;
+};
+
+// Runs reader and tokenizer threads over the listed documents and calls
+// index_doc on this thread for each tokenized one, in list order.
+template <typename IndexFn>
+static void run_raw_pipeline(const FileList* fl, StemMode stem, size_t read_threads, StageTimes* times, IndexFn index_doc) {
+    BoundedQueue<PipeDoc> raw_q(PIPE_QUEUE_DOCS);
+    BoundedQueue<PipeDoc> tok_q(PIPE_QUEUE_DOCS);
+
+    std::thread reader([&] {
+        uint64_t busy = 0;
+        const char** paths = nullptr;
+        FileReader* fr = fl_reader(fl, read_threads, &paths);
+        for (size_t fi = 0; fi < fl->n; ++fi) {
+            uint64_t a = now_qpc();
+            ReadItem it;
+            fl_read_next(fr, &it, fl);
+            PipeDoc d;
+            d.local_doc_id = fl->a[fi].doc_id;
+            d.buf = it.buf;
+            d.n = it.n;
+            d.bytes_in = d.n;
+            busy += now_qpc() - a;
+            raw_q.push(d);
+        }
+        file_reader_stop(fr);
+        std::free(paths);
+        raw_q.close();
+        times->read_sec = qpc_seconds(0, busy);
+    });
+
+    std::thread tokenizer([&] {
+        uint64_t busy = 0;
+        PipeDoc d;
+        while (raw_q.pop(&d)) {
+            uint64_t a = now_qpc();
+            TokBuf tb = {nullptr, 0, 0};
+            Tokenizer t;
+            tokenizer_init(&t, stem, tokbuf_sink, &tb);
+            bool ok = tokenizer_feed(&t, d.buf, d.n) && tokenizer_finish(&t);
+            tokenizer_free(&t);
+            if (!ok) die("tokenize failed");
+            std::free(d.buf);
+            d.buf = tb.buf;
+            d.n = tb.len;
+            busy += now_qpc() - a;
+            tok_q.push(d);
+        }
+        tok_q.close();
+        times->tokenize_sec = qpc_seconds(0, busy);
+    });
+
+    uint64_t busy = 0;
+    PipeDoc d;
+    while (tok_q.pop(&d)) {
+        uint64_t a = now_qpc();
+        index_doc(d.local_doc_id, d.buf, d.n, d.bytes_in);
+        std::free(d.buf);
+        busy += now_qpc() - a;
+    }
+    times->index_sec = qpc_seconds(0, busy);
+
+    reader.join();
+    tokenizer.join();
+}
+
+// One worker's share of a --add source: a contiguous range of doc ids
+// indexed into a private dictionary. Its flushed runs and the dictionary
+// left at the end become merge sources, in doc-id order.
+struct IndexPart {
+    TermDict* dict;
+    const char* out_bin;
+    size_t budget;
+    std::atomic<uint32_t>* next_run;
+    std::atomic<uint32_t>* docs_done;
+    uint32_t* runs;
+    size_t runs_n;
+    size_t runs_cap;
+    uint64_t token_bytes;
+    uint64_t token_count;
+    uint64_t input_bytes;
+    StageTimes stage;
+};
+
+static void part_init(IndexPart* p, const char* out_bin, size_t budget,
+                      std::atomic<uint32_t>* next_run, std::atomic<uint32_t>* docs_done) {
+    std::memset(p, 0, sizeof(*p));
+    p->dict = (TermDict*)std::malloc(sizeof(TermDict));
+    if (!p->dict || !dict_init(p->dict, 1 << 16)) die("dict_init OOM");
+    p->out_bin = out_bin;
+    p->budget = budget;
+    p->next_run = next_run;
+    p->docs_done = docs_done;
+}
+
+static void part_flush(IndexPart* p) {
+    if (p->runs_n == p->runs_cap) {
+        size_t nc = (p->runs_cap ? p->runs_cap * 2 : 16);
+        uint32_t* nr = (uint32_t*)std::realloc(p->runs, nc * sizeof(uint32_t));
+        if (!nr) die("runs OOM");
+        p->runs = nr;
+        p->runs_cap = nc;
+    }
+    uint32_t k = p->next_run->fetch_add(1);
+    spimi_flush(p->dict, p->out_bin, k);
+    p->runs[p->runs_n++] = k;
+}
+
+static void part_finish_doc(IndexPart* p, uint32_t doc_id, DocSet* ds) {
+    for (size_t k = 0; k < ds->cap; ++k) {
+        uint32_t tid = ds->tab[k];
+        if (tid == 0xFFFFFFFFu) continue;
+        TermEntry* e = dict_entry(p->dict, tid);
+        if (!postings_append(p->dict, e, doc_id)) die("postings_append OOM");
+    }
+    if (p->budget && dict_live_bytes(p->dict) >= p->budget) part_flush(p);
+
+    uint32_t done = p->docs_done->fetch_add(1) + 1;
+    if ((done % 1000u) == 0u) {
+        std::fprintf(stderr, "[prog] docs=%u terms=%" PRIu64 "\n", done, (uint64_t)p->dict->size);
+    }
+}
+
+static void part_index_doc(IndexPart* p, uint32_t doc_id, const unsigned char* buf, size_t n, size_t bytes_in) {
+    p->input_bytes += (uint64_t)bytes_in;
+
+    DocSet ds; docset_init(&ds, 4096);
+
+    size_t pos = 0, start = 0;
+    while (pos <= n) {
+        if (pos == n || buf[pos] == '\n') {
+            size_t len = (pos > start ? (pos - start) : 0);
+            if (len > 0 && buf[start + len - 1] == '\r') len--;
+            if (len > 0) {
+                p->token_bytes += (uint64_t)len;
+                p->token_count++;
+
+                uint32_t term_id;
+                if (!dict_get_or_add(p->dict, buf + start, len, &term_id)) die("dict_get_or_add OOM");
+                p->dict->cf[term_id]++;
+
+                bool inserted;
+                if (!docset_add(&ds, term_id, &inserted)) die("docset_add OOM");
+            }
+            pos++; start = pos;
+        } else pos++;
+    }
+
+    part_finish_doc(p, doc_id, &ds);
+    docset_free(&ds);
+}
+
+// .tid documents: ids of the source's terms.dict are mapped to dictionary
+// term ids on first use, after which a token costs one array lookup.
+static void part_index_tid_doc(IndexPart* p, uint32_t doc_id, const TermIds* src, uint32_t* remap,
+                               uint32_t* remap_epoch, const unsigned char* buf, size_t n) {
+    p->input_bytes += (uint64_t)n;
+    if (*remap_epoch != p->dict->epoch) {
+        for (size_t k = 0; k < src->size; ++k) remap[k] = UINT32_MAX;
+        *remap_epoch = p->dict->epoch;
+    }
+
+    DocSet ds; docset_init(&ds, 4096);
+
+    size_t pos = 0;
+    uint32_t src_id;
+    while (varint_get(buf, n, &pos, &src_id)) {
+        if (src_id >= src->size) die("term id out of dictionary range");
+        uint32_t term_id = remap[src_id];
+        if (term_id == UINT32_MAX) {
+            size_t len;
+            const unsigned char* s = term_ids_str(src, src_id, &len);
+            if (!dict_get_or_add(p->dict, s, len, &term_id)) die("dict_get_or_add OOM");
+            remap[src_id] = term_id;
+        }
+        p->token_bytes += (uint64_t)src->len[src_id];
+        p->token_count++;
+        p->dict->cf[term_id]++;
+
+        bool inserted;
+        if (!docset_add(&ds, term_id, &inserted)) die("docset_add OOM");
+    }
+    if (pos != n) die("truncated .tid file");
+
+    part_finish_doc(p, doc_id, &ds);
+    docset_free(&ds);
+}
+
+enum SourceKind { SRC_TOK, SRC_TID, SRC_RAW };
+
+// Indexes fl->a[lo, hi) as doc ids first_doc_id, first_doc_id + 1, ...
+static void part_run(IndexPart* p, SourceKind kind, const FileList* fl, size_t lo, size_t hi,
+                     uint32_t first_doc_id, const TermIds* src, StemMode stem, size_t read_threads) {
+    FileList view;
+    view.a = fl->a + lo;
+    view.n = hi - lo;
+    view.cap = view.n;
+    uint32_t doc_id = first_doc_id;
+
+    if (kind == SRC_RAW) {
+        run_raw_pipeline(&view, stem, read_threads, &p->stage,
+            [&](uint32_t, const unsigned char* buf, size_t n, size_t bytes_in) {
+                part_index_doc(p, doc_id++, buf, n, bytes_in);
+            });
+        return;
+    }
+
+    uint32_t* remap = nullptr;
+    uint32_t remap_epoch = 0;
+    if (kind == SRC_TID) {
+        remap = (uint32_t*)std::malloc((src->size + 1) * sizeof(uint32_t));
+        if (!remap) die("remap OOM");
+        for (size_t k = 0; k < src->size; ++k) remap[k] = UINT32_MAX;
+        remap_epoch = p->dict->epoch;
+    }
+
+    const char** paths = nullptr;
+    FileReader* fr = fl_reader(&view, read_threads, &paths);
+    for (size_t fi = 0; fi < view.n; ++fi) {
+        ReadItem it;
+        fl_read_next(fr, &it, &view);
+        if (kind == SRC_TID) part_index_tid_doc(p, doc_id++, src, remap, &remap_epoch, it.buf, it.n);
+        else part_index_doc(p, doc_id++, it.buf, it.n, it.n);
+        std::free(it.buf);
+    }
+    file_reader_stop(fr);
+    std::free(paths);
+    std::free(remap);
+}
+
 struct DocRec {
     uint32_t source_id;
     uint32_t page_id;
@@ -495,16 +1466,82 @@ struct DocRec {
 };
 
 int main(int argc, char** argv) {
+    if (argc >= 4 && std::strcmp(argv[1], "--delete") == 0) return delete_main(argc, argv);
+    if (argc >= 3 && std::strcmp(argv[1], "--compact") == 0) return compact_main(argc, argv);
     if (argc < 5) { usage(); return 2; }
 
+    // --stem applies to every --add-raw source wherever it appears, so the
+    // one stemmer can be recorded in the header.
+    const char* seg_dir = nullptr;
+    DocOrder reorder = ORDER_NONE;
+    StemMode stem = STEM_SIMPLE;
+    for (int j = 1; j < argc; ++j) {
+        if (std::strncmp(argv[j], "--into=", 7) == 0) seg_dir = argv[j] + 7;
+        if (std::strncmp(argv[j], "--reorder=", 10) == 0 && !parse_doc_order(argv[j] + 10, &reorder)) {
+            die("bad --reorder mode");
+        }
+        if (std::strncmp(argv[j], "--stem=", 7) == 0 && !parse_stem_mode(argv[j] + 7, &stem)) {
+            die("bad --stem mode");
+        }
+    }
+    if (seg_dir && reorder != ORDER_NONE) die("--reorder does not go with --into");
+    int argn = (seg_dir ? argc : argc - 1);
     const char* out_bin = argv[argc - 1];
 
-    uint64_t t0 = now_qpc();
+    // With --reorder the index is built next to out_bin in enumeration order
+    // and then merged into it with the docs renumbered.
+    char unordered_bin[1024];
+    const char* final_bin = out_bin;
+    if (reorder != ORDER_NONE) {
+        std::snprintf(unordered_bin, sizeof(unordered_bin), "%s.unordered", out_bin);
+        out_bin = unordered_bin;
+    }
 
-    TermDict dict;
-    if (!dict_init(&dict, 1 << 20)) die("dict_init OOM");
+    // A new segment is written under the set's lock, which is held until it
+    // is in the manifest.
+    char seg_bin[1024];
+    char seg_name[SEG_NAME_MAX];
+    SegLock seg_lk;
+    SegManifest seg_m;
+    uint32_t doc_base = 0;
+    if (seg_dir) {
+        if (!ensure_dir_exists(seg_dir)) die("cannot create segment dir");
+        if (!seg_lock(seg_dir, &seg_lk)) die("cannot lock segment dir");
+        if (!manifest_load(seg_dir, &seg_m)) die("bad segment manifest");
+        doc_base = seg_m.next_doc;
+        std::snprintf(seg_name, sizeof(seg_name), "seg_%06u.bin", seg_m.next_gen);
+        seg_path(seg_bin, sizeof(seg_bin), seg_dir, seg_name);
+        out_bin = seg_bin;
+    }
+    size_t read_threads = 4;
+    size_t mem_budget = (size_t)1024 << 20;
+    size_t threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > 8) threads = 8;
+    StageTimes stage = {0.0, 0.0, 0.0};
+    bool any_raw = false;
+    bool all_raw = true;
 
-    TermEntry** by_id = nullptr;
+    uint64_t t0 = now_qpc();
+
+    std::atomic<uint32_t> next_run(0);
+    std::atomic<uint32_t> docs_done(0);
+    MergeSrc* srcs = nullptr;
+    size_t srcs_n = 0, srcs_cap = 0;
+    size_t parts_count = 0;
+    size_t post_slabs = 0;
+    auto push_src = [&](TermDict* mem, uint32_t run) {
+        if (srcs_n == srcs_cap) {
+            size_t nc = (srcs_cap ? srcs_cap * 2 : 64);
+            MergeSrc* ns = (MergeSrc*)std::realloc(srcs, nc * sizeof(MergeSrc));
+            if (!ns) die("merge sources OOM");
+            srcs = ns;
+            srcs_cap = nc;
+        }
+        srcs[srcs_n].mem = mem;
+        srcs[srcs_n].run = run;
+        srcs_n++;
+    };
 
     BytePool title_pool; pool_init(&title_pool);
 
@@ -519,10 +1556,38 @@ int main(int argc, char** argv) {
     uint64_t t_scan0 = now_qpc();
 
     int i = 1;
-    while (i < argc - 1) {
-        if (std::strcmp(argv[i], "--add") != 0) die("expected --add");
-        if (i + 2 >= argc - 1) die("bad --add args");
-        const char* tok_dir = argv[i + 1];
+    while (i < argn) {
+        if (std::strncmp(argv[i], "--into=", 7) == 0 || std::strncmp(argv[i], "--reorder=", 10) == 0 ||
+            std::strncmp(argv[i], "--stem=", 7) == 0) {
+            i += 1;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--read-threads=", 15) == 0) {
+            int v = std::atoi(argv[i] + 15);
+            if (v < 1 || v > 256) die("bad --read-threads");
+            read_threads = (size_t)v;
+            i += 1;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--mem-mb=", 9) == 0) {
+            int v = std::atoi(argv[i] + 9);
+            if (v < 0) die("bad --mem-mb");
+            mem_budget = (size_t)v << 20;
+            i += 1;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            int v = std::atoi(argv[i] + 10);
+            if (v < 1 || v > 256) die("bad --threads");
+            threads = (size_t)v;
+            i += 1;
+            continue;
+        }
+        bool raw = (std::strcmp(argv[i], "--add-raw") == 0);
+        bool tid = (std::strcmp(argv[i], "--add-tid") == 0);
+        if (!raw && !tid && std::strcmp(argv[i], "--add") != 0) die("expected --add, --add-raw or --add-tid");
+        if (i + 2 >= argn) die("bad --add args");
+        const char* src_dir = argv[i + 1];
         const char* meta_tsv = argv[i + 2];
         i += 3;
 
@@ -532,73 +1597,119 @@ int main(int argc, char** argv) {
 
         FileList fl; fl_init(&fl);
         EnumCtx ec; ec.fl = &fl;
-        if (!list_tok_files(tok_dir, on_tok, &ec)) die("list_tok_files failed");
-        if (fl.n == 0) die("no .tok files found");
+        if (raw) {
+            if (!list_txt_files(src_dir, on_tok, &ec)) die("list_txt_files failed");
+            if (fl.n == 0) die("no .txt files found");
+        } else if (tid) {
+            if (!list_tid_files(src_dir, on_tok, &ec)) die("list_tid_files failed");
+            if (fl.n == 0) die("no .tid files found");
+        } else {
+            if (!list_tok_files(src_dir, on_tok, &ec)) die("list_tok_files failed");
+            if (fl.n == 0) die("no .tok files found");
+        }
         fl_qsort(fl.a, 0, (int)fl.n - 1);
 
+        size_t kept = 0;
         for (size_t fi = 0; fi < fl.n; ++fi) {
             uint32_t local_doc_id = fl.a[fi].doc_id;
             if (local_doc_id == 0 || local_doc_id > meta_max) continue;
             if (meta[local_doc_id].title_len == 0) continue;
+            fl.a[kept++] = fl.a[fi];
+        }
+        for (size_t fi = kept; fi < fl.n; ++fi) {
+            std::free(fl.a[fi].full);
+            std::free(fl.a[fi].name);
+        }
+        fl.n = kept;
+
+        if (docs_count + fl.n > docs_cap) {
+            uint32_t nc = (docs_cap == 0 ? 8192 : docs_cap);
+            while (nc < docs_count + fl.n) nc *= 2;
+            DocRec* nd = (DocRec*)std::realloc(docs, (size_t)nc * sizeof(DocRec));
+            if (!nd) die("docs realloc OOM");
+            docs = nd;
+            docs_cap = nc;
+        }
+        for (size_t fi = 0; fi < fl.n; ++fi) {
+            const LocalMeta& m = meta[fl.a[fi].doc_id];
+            DocRec& r = docs[docs_count + fi];
+            r.source_id = m.source_id;
+            r.page_id = m.page_id;
+            r.title_off = m.title_off;
+            r.title_len = m.title_len;
+        }
 
-            unsigned char* buf = nullptr;
-            size_t n = 0;
-            if (!read_all(fl.a[fi].full, &buf, &n)) die("read tok failed");
-            total_input_bytes += (uint64_t)n;
-
-            DocSet ds; docset_init(&ds, 4096);
-
-            size_t pos = 0, start = 0;
-            while (pos <= n) {
-                if (pos == n || buf[pos] == '\n') {
-                    size_t len = (pos > start ? (pos - start) : 0);
-                    if (len > 0 && buf[start + len - 1] == '\r') len--;
-                    if (len > 0) {
-                        total_token_bytes += (uint64_t)len;
-                        total_token_count++;
-
-                        uint32_t term_id;
-                        if (!dict_get_or_add(&dict, buf + start, len, &term_id)) die("dict_get_or_add OOM");
-
-                        bool inserted;
-                        if (!docset_add(&ds, term_id, &inserted)) die("docset_add OOM");
-                    }
-                    pos++; start = pos;
-                } else pos++;
-            }
-
-            if (by_id) std::free(by_id);
-            by_id = build_entries_by_id(&dict);
-            if (!by_id) die("build_entries_by_id OOM");
-
-            uint32_t global_doc_id = docs_count + 1;
+        SourceKind kind = (raw ? SRC_RAW : (tid ? SRC_TID : SRC_TOK));
+        TermIds src;
+        if (tid) {
+            char dict_path[1024];
+            join_path(dict_path, sizeof(dict_path), src_dir, TERM_IDS_DICT_NAME);
+            if (!term_ids_load(&src, dict_path)) die("cannot load terms.dict");
+        }
+        if (raw) any_raw = true;
+        else all_raw = false;
+
+        // Contiguous doc-id ranges, one per worker, so each part's postings
+        // are already sorted and parts merge by concatenation.
+        size_t nparts = (threads < fl.n ? threads : fl.n);
+        IndexPart* parts = (IndexPart*)std::calloc(nparts + 1, sizeof(IndexPart));
+        if (!parts) die("parts OOM");
+        size_t part_read = (nparts ? (read_threads + nparts - 1) / nparts : 1);
+        for (size_t w = 0; w < nparts; ++w) {
+            part_init(&parts[w], out_bin, (nparts ? mem_budget / nparts : 0), &next_run, &docs_done);
+        }
+        auto run_part = [&](size_t w) {
+            size_t lo = fl.n * w / nparts, hi = fl.n * (w + 1) / nparts;
+            part_run(&parts[w], kind, &fl, lo, hi, doc_base + docs_count + (uint32_t)lo + 1,
+                     &src, stem, part_read);
+        };
+        if (nparts == 1) {
+            run_part(0);
+        } else {
+            std::vector<std::thread> pool;
+            for (size_t w = 0; w < nparts; ++w) pool.emplace_back(run_part, w);
+            for (auto& th : pool) th.join();
+        }
 
-            for (size_t k = 0; k < ds.cap; ++k) {
-                uint32_t tid = ds.tab[k];
-                if (tid == 0xFFFFFFFFu) continue;
-                TermEntry* e2 = by_id[tid];
-                if (!postings_append(e2, global_doc_id)) die("postings_append OOM");
+        for (size_t w = 0; w < nparts; ++w) {
+            IndexPart* p = &parts[w];
+            post_slabs += p->dict->post.slabs_n;
+            for (size_t r = 0; r < p->runs_n; ++r) push_src(nullptr, p->runs[r]);
+            if (p->dict->size > 0) {
+                push_src(p->dict, 0);
+            } else {
+                dict_free(p->dict);
+                std::free(p->dict);
             }
-
-            docset_free(&ds);
-            std::free(buf);
-
-            if (docs_count + 1 > docs_cap) {
-                uint32_t nc = (docs_cap == 0 ? 8192 : docs_cap * 2);
-                DocRec* nd = (DocRec*)std::realloc(docs, (size_t)nc * sizeof(DocRec));
-                if (!nd) die("docs realloc OOM");
-                docs = nd;
-                docs_cap = nc;
+            std::free(p->runs);
+            total_token_bytes += p->token_bytes;
+            total_token_count += p->token_count;
+            total_input_bytes += p->input_bytes;
+            stage.read_sec += p->stage.read_sec;
+            stage.tokenize_sec += p->stage.tokenize_sec;
+            stage.index_sec += p->stage.index_sec;
+        }
+        parts_count += nparts;
+        std::free(parts);
+        if (tid) term_ids_free(&src);
+        docs_count += (uint32_t)fl.n;
+
+        // Parts kept from earlier sources count against the budget too.
+        if (mem_budget) {
+            size_t kept_bytes = 0;
+            for (size_t j = 0; j < srcs_n; ++j) {
+                if (srcs[j].mem) kept_bytes += dict_live_bytes(srcs[j].mem);
             }
-
-            docs[docs_count].source_id = meta[local_doc_id].source_id;
-            docs[docs_count].page_id = meta[local_doc_id].page_id;
-            docs[docs_count].title_off = meta[local_doc_id].title_off;
-            docs[docs_count].title_len = meta[local_doc_id].title_len;
-            docs_count++;
-
-            if ((docs_count % 1000u) == 0u) {
-                std::fprintf(stderr, "[prog] docs=%u terms=%I64u\n", docs_count, (unsigned long long)dict.size);
+            if (kept_bytes > mem_budget / 2) {
+                for (size_t j = 0; j < srcs_n; ++j) {
+                    if (!srcs[j].mem) continue;
+                    uint32_t k = next_run.fetch_add(1);
+                    spimi_flush(srcs[j].mem, out_bin, k);
+                    dict_free(srcs[j].mem);
+                    std::free(srcs[j].mem);
+                    srcs[j].mem = nullptr;
+                    srcs[j].run = k;
+                }
             }
         }
 
@@ -608,111 +1719,96 @@ int main(int argc, char** argv) {
 
     uint64_t t_scan1 = now_qpc();
 
-    if (by_id) std::free(by_id);
-    by_id = build_entries_by_id(&dict);
-    if (!by_id) die("build_entries_by_id OOM final");
-
-    uint32_t terms_count = (uint32_t)dict.size;
-
-    uint32_t* term_ids = (uint32_t*)std::malloc((size_t)terms_count * sizeof(uint32_t));
-    if (!term_ids) die("term_ids OOM");
-    for (uint32_t k = 0; k < terms_count; ++k) term_ids[k] = k;
-    term_qsort(term_ids, 0, (int)terms_count - 1, &dict, by_id);
-
-    uint64_t* postings_off = (uint64_t*)std::malloc((size_t)terms_count * sizeof(uint64_t));
-    if (!postings_off) die("postings_off OOM");
-    uint64_t cur = 0;
-    for (uint32_t si = 0; si < terms_count; ++si) {
-        TermEntry* e = by_id[term_ids[si]];
-        postings_off[si] = cur;
-        cur += (uint64_t)e->df * 4ULL;
-    }
-    uint64_t postings_bytes = cur;
+    IndexOut* out = index_out_open(out_bin);
+    if (!out) die("cannot open out_bin");
 
-    uint64_t sum_term_bytes = 0;
-    for (uint32_t k = 0; k < terms_count; ++k) sum_term_bytes += (uint64_t)by_id[k]->len;
+    // The docs section only needs the postings size to know its place, so
+    // it is written while the dictionary and postings are merged.
+    uint64_t docs_bytes = 8ULL + 8ULL * docs_count;
+    for (uint32_t k = 0; k < docs_count; ++k) docs_bytes += 16ULL + docs[k].title_len;
+    uint64_t docs_offset = 0;
+    bool docs_ok = false;
+    std::thread docs_writer;
+
+    uint32_t run_count = next_run.load();
+    uint32_t merge_n = (uint32_t)srcs_n;
+    MergeTotals mt;
+    merge_sources(out_bin, srcs, &merge_n, &run_count, out, IDX_ALIGN, &mt, [&](const MergeTotals& t) {
+        docs_offset = idx_align(t.postings_offset + t.postings_bytes);
+        docs_writer = std::thread([&] {
+            SectionWriter w;
+            if (!section_open(&w, out, docs_offset)) return;
+            section_u64(&w, (uint64_t)docs_count);
+            uint64_t rel = 0;
+            for (uint32_t k = 0; k < docs_count; ++k) {
+                section_u64(&w, rel);
+                rel += 16ULL + docs[k].title_len;
+            }
+            for (uint32_t id = 1; id <= docs_count; ++id) {
+                const DocRec& r = docs[id - 1];
+                section_u32(&w, doc_base + id);
+                section_u32(&w, r.source_id);
+                section_u32(&w, r.page_id);
+                section_u32(&w, r.title_len);
+                section_put(&w, title_pool.buf + r.title_off, r.title_len);
+            }
+            docs_ok = section_close(&w);
+        });
+    });
+    docs_writer.join();
+    if (!docs_ok) die("docs write failed");
+    srcs_n = merge_n;
+    if (mt.terms > 0xFFFFFFFFULL) die("too many terms");
+    uint32_t terms_count = (uint32_t)mt.terms;
+    uint64_t dict_bytes = mt.dict_bytes;
+    uint64_t postings_bytes = mt.postings_bytes;
+    uint64_t sum_term_bytes = mt.sum_term_bytes;
 
     double avg_token_len = (total_token_count ? (double)total_token_bytes / (double)total_token_count : 0.0);
     double avg_term_len  = (terms_count ? (double)sum_term_bytes / (double)terms_count : 0.0);
 
-    FILE* out = std::fopen(out_bin, "wb");
-    if (!out) die("cannot open out_bin");
-
-    unsigned char zero[128]; std::memset(zero, 0, sizeof(zero));
-    std::fwrite(zero, 1, sizeof(zero), out);
-
-    uint64_t dict_offset = 128;
-
-    for (uint32_t si = 0; si < terms_count; ++si) {
-        TermEntry* e = by_id[term_ids[si]];
-        wr_u32(out, e->len);
-        std::fwrite(dict.pool.buf + e->off, 1, e->len, out);
-        wr_u64(out, postings_off[si]);
-        wr_u32(out, e->df);
-        wr_u32(out, 0);
+    IndexHeader hdr;
+    // The stemmer is only known when the indexer tokenized every doc itself.
+    hdr.flags = 0x3 | IDX_FLAG_CF | IDX_FLAG_ALIGNED | (seg_dir ? IDX_FLAG_SEGMENT : 0) |
+                (all_raw ? IDX_FLAG_STEM : 0);
+    hdr.docs_count = docs_count;
+    hdr.terms_count = terms_count;
+    hdr.dict_offset = mt.dict_offset;
+    hdr.dict_bytes = dict_bytes;
+    hdr.postings_offset = mt.postings_offset;
+    hdr.postings_bytes = postings_bytes;
+    hdr.docs_offset = docs_offset;
+    hdr.docs_bytes = docs_bytes;
+    hdr.total_tokens = total_token_count;
+    hdr.doc_base = doc_base;
+    hdr.stem = (uint32_t)stem;
+    index_out_header(out, &hdr);
+    if (!index_out_close(out)) die("index write failed");
+
+    double reorder_sec = 0.0;
+    if (reorder != ORDER_NONE) {
+        uint64_t tr0 = now_qpc();
+        uint32_t* order = (uint32_t*)std::malloc(((size_t)docs_count + 1) * sizeof(uint32_t));
+        if (!order) die("reorder OOM");
+        if (!doc_order_compute(&out_bin, 1, reorder, (unsigned)threads, order)) die("doc reordering failed");
+        if (!index_merge(&out_bin, 1, nullptr, 0, 0, order, final_bin, nullptr)) die("reordered index write failed");
+        std::free(order);
+        std::remove(out_bin);
+        reorder_sec = qpc_seconds(tr0, now_qpc());
     }
 
-    uint64_t dict_end = (uint64_t)std::ftell(out);
-    uint64_t dict_bytes = dict_end - dict_offset;
-
-    uint64_t postings_offset = dict_end;
-
-    for (uint32_t si = 0; si < terms_count; ++si) {
-        TermEntry* e = by_id[term_ids[si]];
-        PostBlock* b = e->first;
-        while (b) {
-            for (uint32_t k = 0; k < b->used; ++k) wr_u32(out, b->doc[k]);
-            b = b->next;
+    if (seg_dir) {
+        seg_m.next_gen++;
+        seg_m.next_doc = doc_base + docs_count;
+        seg_m.version++;
+        if (!manifest_push(&seg_m, seg_name, doc_base, docs_count, 0) || !manifest_save(seg_dir, &seg_m)) {
+            die("cannot update segment manifest");
         }
+        seg_unlock(&seg_lk);
+        manifest_free(&seg_m);
+        std::fprintf(stderr, "segment: %s docs=%u..%u\n", seg_name, doc_base + 1, doc_base + docs_count);
     }
 
-    uint64_t postings_end = (uint64_t)std::ftell(out);
-
-    uint64_t docs_offset = postings_end;
-
-    wr_u64(out, (uint64_t)docs_count);
-
-    uint64_t* doc_off = (uint64_t*)std::malloc((size_t)docs_count * sizeof(uint64_t));
-    if (!doc_off) die("doc_off OOM");
-
-    uint64_t rel = 0;
-    for (uint32_t id = 1; id <= docs_count; ++id) {
-        const DocRec& r = docs[id - 1];
-        doc_off[id - 1] = rel;
-        rel += (uint64_t)(4 + 4 + 4 + 4 + r.title_len);
-    }
-
-    for (uint32_t k = 0; k < docs_count; ++k) wr_u64(out, doc_off[k]);
-
-    for (uint32_t id = 1; id <= docs_count; ++id) {
-        const DocRec& r = docs[id - 1];
-        wr_u32(out, id);
-        wr_u32(out, r.source_id);
-        wr_u32(out, r.page_id);
-        wr_u32(out, r.title_len);
-        std::fwrite(title_pool.buf + r.title_off, 1, r.title_len, out);
-    }
-
-    uint64_t docs_end = (uint64_t)std::ftell(out);
-    uint64_t docs_bytes = docs_end - docs_offset;
-
-    std::fseek(out, 0, SEEK_SET);
-    const char magic[8] = {'M','A','I','I','R','I','D','X'};
-    std::fwrite(magic, 1, 8, out);
-    wr_u32(out, 2);
-    wr_u32(out, 0x3);
-    wr_u64(out, (uint64_t)docs_count);
-    wr_u64(out, (uint64_t)terms_count);
-    wr_u64(out, dict_offset);
-    wr_u64(out, dict_bytes);
-    wr_u64(out, postings_offset);
-    wr_u64(out, postings_bytes);
-    wr_u64(out, docs_offset);
-    wr_u64(out, docs_bytes);
-    for (int z = 0; z < 6; ++z) wr_u64(out, 0);
-
-    std::fclose(out);
-
     uint64_t t1 = now_qpc();
     double total_sec = qpc_seconds(t0, t1);
     double scan_sec  = qpc_seconds(t_scan0, t_scan1);
@@ -725,24 +1821,39 @@ int main(int argc, char** argv) {
         "DONE.\n"
         "docs=%u terms=%u\n"
         "avg_token_len_bytes=%.3f avg_term_len_bytes=%.3f\n"
-        "scan_sec=%.3f total_sec=%.3f\n"
+        "scan_sec=%.3f write_sec=%.3f total_sec=%.3f\n"
         "speed: docs/sec=%.2f KB/sec=%.2f\n"
-        "index.bin: dict_bytes=%I64u postings_bytes=%I64u docs_bytes=%I64u\n",
+        "index.bin: dict_bytes=%" PRIu64 " postings_bytes=%" PRIu64 " docs_bytes=%" PRIu64 "\n",
         docs_count, terms_count,
         avg_token_len, avg_term_len,
-        scan_sec, total_sec,
+        scan_sec, qpc_seconds(t_scan1, t1), total_sec,
         docs_per_sec, kb_per_sec,
-        (unsigned long long)dict_bytes,
-        (unsigned long long)postings_bytes,
-        (unsigned long long)docs_bytes
+        (uint64_t)dict_bytes,
+        (uint64_t)postings_bytes,
+        (uint64_t)docs_bytes
     );
+    std::fprintf(stderr, "threads=%" PRIu64 " parts=%" PRIu64 " postings_slabs=%" PRIu64 " (%" PRIu64 " MB)\n",
+        (uint64_t)threads, (uint64_t)parts_count,
+        (uint64_t)post_slabs, (uint64_t)(post_slabs * POST_SLAB >> 20));
+    if (reorder != ORDER_NONE) {
+        std::fprintf(stderr, "reorder=%s reorder_sec=%.3f\n", doc_order_name(reorder), reorder_sec);
+    }
+    if (run_count > 0) {
+        std::fprintf(stderr, "spimi: runs=%u mem_mb=%" PRIu64 "\n",
+            run_count, (uint64_t)(mem_budget >> 20));
+    }
+    if (any_raw) {
+        std::fprintf(stderr,
+            "pipeline (--add-raw, stem=%s): read_sec=%.3f tokenize_sec=%.3f index_sec=%.3f\n",
+            stem_mode_name(stem), stage.read_sec, stage.tokenize_sec, stage.index_sec);
+    }
 
-    std::free(term_ids);
-    std::free(postings_off);
-    std::free(doc_off);
-    std::free(by_id);
-    std::free(dict.tab);
-    std::free(dict.pool.buf);
+    for (size_t j = 0; j < srcs_n; ++j) {
+        if (!srcs[j].mem) continue;
+        dict_free(srcs[j].mem);
+        std::free(srcs[j].mem);
+    }
+    std::free(srcs);
     std::free(title_pool.buf);
     std::free(docs);
 
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+
+#ifdef _WIN32
+static const char PATH_SEP = '\\';
+#else
+static const char PATH_SEP = '/';
+#endif
+
+// dir and name joined with the platform's separator.
+inline void join_path(char* out, size_t out_sz, const char* dir, const char* name) {
+    std::snprintf(out, out_sz, "%s%c%s", dir, PATH_SEP, name);
+}
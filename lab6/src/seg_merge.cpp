@@ -0,0 +1,159 @@
+#include "seg_merge.h"
+#include "index_merge.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static uint32_t seg_tier(uint32_t live) {
+    uint32_t t = 0;
+    for (uint64_t lim = (uint64_t)SEG_TIER_DOCS * SEG_MERGE_FACTOR; live >= lim; lim *= SEG_MERGE_FACTOR) t++;
+    return t;
+}
+
+bool seg_pick_merge(const SegManifest* m, const Tombstones* del, size_t* first, size_t* count) {
+    for (size_t i = 0; i < m->n; ++i) {
+        const SegInfo* s = &m->segs[i];
+        uint32_t dead = tombstones_count(del, s->doc_base + 1, s->doc_base + s->docs + 1);
+        uint32_t pending = (dead > s->dropped ? dead - s->dropped : 0);
+        if (pending > 0 && pending * 2 >= s->docs - s->dropped) {
+            *first = i;
+            *count = 1;
+            return true;
+        }
+    }
+    size_t run = 0;
+    uint32_t run_tier = 0;
+    for (size_t i = 0; i < m->n; ++i) {
+        const SegInfo* s = &m->segs[i];
+        uint32_t live = s->docs - tombstones_count(del, s->doc_base + 1, s->doc_base + s->docs + 1);
+        uint32_t t = seg_tier(live);
+        if (run > 0 && t == run_tier) {
+            run++;
+        } else {
+            run = 1;
+            run_tier = t;
+        }
+        if (run == SEG_MERGE_FACTOR) {
+            *first = i + 1 - run;
+            *count = run;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool seg_merge(const char* dir, const SegInfo* segs, size_t count, const Tombstones* del,
+               const char* out_name) {
+    char** in = (char**)std::calloc(count, sizeof(char*));
+    bool ok = (in != nullptr);
+    for (size_t i = 0; ok && i < count; ++i) {
+        in[i] = (char*)std::malloc(1024);
+        if (!in[i]) { ok = false; break; }
+        seg_path(in[i], 1024, dir, segs[i].name);
+        IndexHeader h;
+        ok = index_read_header(in[i], &h) && (h.flags & IDX_FLAG_SEGMENT) &&
+             h.doc_base == segs[i].doc_base && h.docs_count == segs[i].docs;
+    }
+    if (ok) {
+        char p[1024];
+        seg_path(p, sizeof(p), dir, out_name);
+        ok = index_merge(in, count, del, segs[0].doc_base, IDX_FLAG_SEGMENT, nullptr, p, nullptr);
+    }
+    for (size_t i = 0; in && i < count; ++i) std::free(in[i]);
+    std::free(in);
+    return ok;
+}
+
+int seg_compact_once(const char* dir) {
+    SegLock lk;
+    SegManifest m;
+    Tombstones del;
+    if (!seg_lock(dir, &lk)) return -1;
+    if (!manifest_load(dir, &m)) {
+        seg_unlock(&lk);
+        return -1;
+    }
+    if (!tombstones_load(dir, &del)) {
+        manifest_free(&m);
+        seg_unlock(&lk);
+        return -1;
+    }
+    size_t first = 0, count = 0;
+    if (!seg_pick_merge(&m, &del, &first, &count)) {
+        tombstones_free(&del);
+        manifest_free(&m);
+        seg_unlock(&lk);
+        return 0;
+    }
+
+    // Reserve the output name, then merge without the lock so indexing and
+    // deletes go on meanwhile.
+    char out_name[SEG_NAME_MAX];
+    std::snprintf(out_name, sizeof(out_name), "seg_%06u.bin", m.next_gen);
+    m.next_gen++;
+    m.version++;
+    bool ok = manifest_save(dir, &m);
+    seg_unlock(&lk);
+
+    SegInfo* picked = (SegInfo*)std::malloc(count * sizeof(SegInfo));
+    if (!picked) ok = false;
+    uint32_t dropped = 0;
+    if (ok) {
+        std::memcpy(picked, m.segs + first, count * sizeof(SegInfo));
+        dropped = tombstones_count(&del, picked[0].doc_base + 1,
+                                   picked[count - 1].doc_base + picked[count - 1].docs + 1);
+        ok = seg_merge(dir, picked, count, &del, out_name);
+    }
+    tombstones_free(&del);
+    manifest_free(&m);
+    if (!ok) {
+        std::free(picked);
+        return -1;
+    }
+
+    // Segments are only ever removed here, so the picked ones are still
+    // neighbours; anything added meanwhile went after them.
+    if (!seg_lock(dir, &lk)) ok = false;
+    if (ok && !manifest_load(dir, &m)) {
+        seg_unlock(&lk);
+        ok = false;
+    }
+    if (ok) {
+        size_t at = m.n;
+        for (size_t i = 0; i < m.n; ++i) {
+            if (std::strcmp(m.segs[i].name, picked[0].name) == 0) at = i;
+        }
+        ok = (at + count <= m.n);
+        for (size_t j = 0; ok && j < count; ++j) {
+            ok = (std::strcmp(m.segs[at + j].name, picked[j].name) == 0);
+        }
+        if (ok) {
+            SegInfo merged = m.segs[at];
+            std::memcpy(merged.name, out_name, sizeof(out_name));
+            merged.docs = picked[count - 1].doc_base + picked[count - 1].docs - picked[0].doc_base;
+            merged.dropped = dropped;
+            m.segs[at] = merged;
+            std::memmove(m.segs + at + 1, m.segs + at + count, (m.n - at - count) * sizeof(SegInfo));
+            m.n -= count - 1;
+            m.version++;
+            ok = manifest_save(dir, &m);
+        }
+        manifest_free(&m);
+        seg_unlock(&lk);
+    }
+
+    char p[1024];
+    if (!ok) {
+        seg_path(p, sizeof(p), dir, out_name);
+        std::remove(p);
+    } else {
+        // A reader still loading an old segment may keep it from going away
+        // on Windows; it is then left behind, unused.
+        for (size_t j = 0; j < count; ++j) {
+            seg_path(p, sizeof(p), dir, picked[j].name);
+            std::remove(p);
+        }
+    }
+    std::free(picked);
+    return ok ? 1 : -1;
+}
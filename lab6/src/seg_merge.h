@@ -0,0 +1,27 @@
+#pragma once
+#include "segments.h"
+#include <cstddef>
+#include <cstdint>
+
+// Tiered compaction of a segment set. Segments fall into tiers by live doc
+// count, SEG_MERGE_FACTOR apart starting from SEG_TIER_DOCS; once
+// SEG_MERGE_FACTOR neighbours share a tier they are merged into one segment
+// of the next tier. A segment whose deleted but not yet dropped docs are at
+// least half of what it still holds is rewritten on its own. Merging drops
+// the postings of deleted docs and blanks their titles; doc ids never
+// change, so neighbours stay contiguous.
+static const size_t SEG_MERGE_FACTOR = 4;
+static const uint32_t SEG_TIER_DOCS = 1000;
+
+// Picks m->segs[*first, *first + *count) to merge; false if nothing is due.
+bool seg_pick_merge(const SegManifest* m, const Tombstones* del, size_t* first, size_t* count);
+
+// Streams the consecutive segments segs[0, count) of dir into a new segment
+// file out_name in the same directory.
+bool seg_merge(const char* dir, const SegInfo* segs, size_t count, const Tombstones* del,
+               const char* out_name);
+
+// One round of the policy: pick, merge without holding the lock, then swap
+// the result into the manifest. Returns 1 if a merge was committed, 0 if
+// nothing was due, -1 on error. Only one compactor may run per set.
+int seg_compact_once(const char* dir);
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// A segment set is a directory of immutable index files (segments) plus two
+// small files that change:
+//   segments.tsv  the manifest: live segments in doc-id order, each holding
+//                 the ids doc_base + 1 .. doc_base + docs, of which `dropped`
+//                 were deleted before the segment was written
+//   deleted.bin   tombstones: a little-endian u64 bitmap over global doc ids
+// Both are replaced as a whole (written to .tmp, then renamed), so a reader
+// sees either the old or the new version. Writers serialize on the LOCK
+// file; version goes up with every change, so readers can poll it.
+static const char* const SEG_MANIFEST_NAME = "segments.tsv";
+static const char* const SEG_TOMBSTONES_NAME = "deleted.bin";
+static const char* const SEG_LOCK_NAME = "LOCK";
+static const size_t SEG_NAME_MAX = 64;
+
+struct SegInfo {
+    char name[SEG_NAME_MAX];
+    uint32_t doc_base;
+    uint32_t docs;
+    uint32_t dropped;
+};
+
+struct SegManifest {
+    uint64_t version;
+    uint32_t next_gen;
+    uint32_t next_doc;
+    SegInfo* segs;
+    size_t n;
+    size_t cap;
+};
+
+struct Tombstones {
+    uint64_t* words;
+    size_t n;
+};
+
+struct SegLock {
+    void* handle;
+    int fd;
+};
+
+void seg_path(char* out, size_t out_sz, const char* dir, const char* name);
+// True if dir holds a segment set manifest.
+bool seg_set_exists(const char* dir);
+
+// A missing manifest loads as an empty set.
+bool manifest_load(const char* dir, SegManifest* m);
+bool manifest_save(const char* dir, const SegManifest* m);
+bool manifest_push(SegManifest* m, const char* name, uint32_t doc_base, uint32_t docs, uint32_t dropped);
+void manifest_free(SegManifest* m);
+
+// A missing file loads as no deletions.
+bool tombstones_load(const char* dir, Tombstones* t);
+bool tombstones_save(const char* dir, const Tombstones* t);
+bool tombstones_set(Tombstones* t, uint32_t doc_id);
+// Deleted ids in [lo, hi).
+uint32_t tombstones_count(const Tombstones* t, uint32_t lo, uint32_t hi);
+void tombstones_free(Tombstones* t);
+
+inline bool tombstones_has(const Tombstones* t, uint32_t doc_id) {
+    size_t w = doc_id >> 6;
+    return w < t->n && ((t->words[w] >> (doc_id & 63)) & 1);
+}
+
+// Blocks until this process holds the set's lock. The OS drops it if the
+// process dies.
+bool seg_lock(const char* dir, SegLock* l);
+void seg_unlock(SegLock* l);
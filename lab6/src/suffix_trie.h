@@ -0,0 +1,128 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+struct SuffixRule {
+    const char* s;
+    uint16_t tag;
+};
+
+// Reversed trie over a fixed list of Cyrillic suffixes, built at compile time.
+// Every suffix letter is a two-byte UTF-8 sequence (D0/D1 xx), so the trie is
+// keyed by letters and a match walks the token tail two bytes at a time.
+// Rule tags are bit masks; for each node and tag bit the trie keeps the length
+// of the longest rule with that bit on the path to the node, so one walk
+// answers "longest suffix from list X" for every list at once.
+template <size_t Nodes, size_t Classes, size_t Tags>
+struct SuffixTrie {
+    uint8_t cls[128];
+    uint16_t next[Nodes][Classes];
+    uint8_t depth[Nodes][Tags];
+    size_t nodes;
+    size_t classes;
+    bool ok;
+
+    // Deepest node reached by reading s[limit..n) backwards.
+    uint32_t walk(const unsigned char* s, size_t n, size_t limit) const {
+        uint32_t v = 0;
+        for (size_t i = n; i >= limit + 2; i -= 2) {
+            unsigned char b0 = s[i - 2], b1 = s[i - 1];
+            if ((b0 & 0xFE) != 0xD0 || (b1 & 0xC0) != 0x80) break;
+            uint8_t c = cls[((b0 & 1) << 6) | (b1 & 0x3F)];
+            if (!c) break;
+            uint32_t w = next[v][c];
+            if (!w) break;
+            v = w;
+        }
+        return v;
+    }
+
+    // Byte length of the longest rule tagged with bit b ending at node v, or 0.
+    size_t longest(uint32_t v, unsigned b) const {
+        return 2 * (size_t)depth[v][b];
+    }
+};
+
+struct SuffixTrieSize {
+    size_t nodes;
+    size_t classes;
+    size_t tags;
+};
+
+constexpr size_t suffix_len(const char* s) {
+    size_t n = 0;
+    while (s[n]) ++n;
+    return n;
+}
+
+template <size_t K>
+constexpr size_t suffix_trie_bound(const SuffixRule (&rules)[K]) {
+    size_t n = 1;
+    for (size_t k = 0; k < K; ++k) n += suffix_len(rules[k].s) / 2;
+    return n;
+}
+
+template <size_t Nodes, size_t Classes, size_t Tags, size_t K>
+constexpr SuffixTrie<Nodes, Classes, Tags> make_suffix_trie(const SuffixRule (&rules)[K]) {
+    SuffixTrie<Nodes, Classes, Tags> t{};
+    uint16_t parent[Nodes] = {};
+    uint8_t level[Nodes] = {};
+    uint16_t mask[Nodes] = {};
+    t.nodes = 1;
+    t.classes = 1;
+    t.ok = true;
+
+    for (size_t k = 0; k < K; ++k) {
+        const char* s = rules[k].s;
+        size_t m = suffix_len(s);
+        if (m == 0 || (m & 1) || (rules[k].tag >> Tags)) { t.ok = false; return t; }
+
+        uint32_t v = 0;
+        for (size_t i = m; i > 0; i -= 2) {
+            unsigned char b0 = (unsigned char)s[i - 2];
+            unsigned char b1 = (unsigned char)s[i - 1];
+            if ((b0 & 0xFE) != 0xD0 || (b1 & 0xC0) != 0x80) { t.ok = false; return t; }
+            uint8_t key = (uint8_t)(((b0 & 1) << 6) | (b1 & 0x3F));
+            if (!t.cls[key]) {
+                if (t.classes == Classes) { t.ok = false; return t; }
+                t.cls[key] = (uint8_t)t.classes++;
+            }
+            uint8_t c = t.cls[key];
+            if (!t.next[v][c]) {
+                if (t.nodes == Nodes) { t.ok = false; return t; }
+                parent[t.nodes] = (uint16_t)v;
+                level[t.nodes] = (uint8_t)(level[v] + 1);
+                t.next[v][c] = (uint16_t)t.nodes++;
+            }
+            v = t.next[v][c];
+        }
+        mask[v] |= rules[k].tag;
+    }
+
+    for (size_t v = 1; v < t.nodes; ++v) {
+        for (size_t b = 0; b < Tags; ++b) {
+            t.depth[v][b] = ((mask[v] >> b) & 1) ? level[v] : t.depth[parent[v]][b];
+        }
+    }
+    return t;
+}
+
+template <size_t K>
+constexpr size_t suffix_trie_tags(const SuffixRule (&rules)[K]) {
+    uint16_t all = 0;
+    for (size_t k = 0; k < K; ++k) all |= rules[k].tag;
+    size_t n = 1;
+    while (n < 16 && (all >> n)) ++n;
+    return n;
+}
+
+template <size_t Bound, size_t K>
+constexpr SuffixTrieSize suffix_trie_size(const SuffixRule (&rules)[K]) {
+    auto t = make_suffix_trie<Bound, 72, 16>(rules);
+    return SuffixTrieSize{t.ok ? t.nodes : 0, t.ok ? t.classes : 0, suffix_trie_tags(rules)};
+}
+
+#define SUFFIX_TRIE(rules) \
+    make_suffix_trie<suffix_trie_size<suffix_trie_bound(rules)>(rules).nodes, \
+                     suffix_trie_size<suffix_trie_bound(rules)>(rules).classes, \
+                     suffix_trie_size<suffix_trie_bound(rules)>(rules).tags>(rules)
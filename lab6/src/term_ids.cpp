@@ -0,0 +1,156 @@
+#include "term_ids.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static uint64_t fnv1a64(const unsigned char* s, size_t n) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (uint64_t)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool term_ids_init(TermIds* t) {
+    std::memset(t, 0, sizeof(*t));
+    t->cap = (size_t)1 << 16;
+    t->tab = (uint32_t*)std::calloc(t->cap, sizeof(uint32_t));
+    return t->tab != nullptr;
+}
+
+static bool rehash(TermIds* t, size_t new_cap) {
+    uint32_t* nt = (uint32_t*)std::calloc(new_cap, sizeof(uint32_t));
+    if (!nt) return false;
+    size_t mask = new_cap - 1;
+    for (size_t id = 0; id < t->size; ++id) {
+        size_t pos = (size_t)t->hash[id] & mask;
+        while (nt[pos]) pos = (pos + 1) & mask;
+        nt[pos] = (uint32_t)id + 1;
+    }
+    std::free(t->tab);
+    t->tab = nt;
+    t->cap = new_cap;
+    return true;
+}
+
+static bool add_term(TermIds* t, const unsigned char* s, size_t n, uint64_t h) {
+    if (t->size == t->ids_cap) {
+        size_t nc = (t->ids_cap == 0 ? 65536 : t->ids_cap * 2);
+        uint64_t* nh = (uint64_t*)std::realloc(t->hash, nc * sizeof(uint64_t));
+        if (!nh) return false;
+        t->hash = nh;
+        uint32_t* no = (uint32_t*)std::realloc(t->off, nc * sizeof(uint32_t));
+        if (!no) return false;
+        t->off = no;
+        uint32_t* nl = (uint32_t*)std::realloc(t->len, nc * sizeof(uint32_t));
+        if (!nl) return false;
+        t->len = nl;
+        t->ids_cap = nc;
+    }
+    if (t->pool_len + n > t->pool_cap) {
+        size_t nc = (t->pool_cap == 0 ? (1u << 20) : t->pool_cap);
+        while (nc < t->pool_len + n) nc *= 2;
+        unsigned char* np = (unsigned char*)std::realloc(t->pool, nc);
+        if (!np) return false;
+        t->pool = np;
+        t->pool_cap = nc;
+    }
+    if (n > 0) std::memcpy(t->pool + t->pool_len, s, n);
+    t->hash[t->size] = h;
+    t->off[t->size] = (uint32_t)t->pool_len;
+    t->len[t->size] = (uint32_t)n;
+    t->pool_len += n;
+    t->size++;
+    return true;
+}
+
+bool term_ids_get_or_add(TermIds* t, const unsigned char* s, size_t n, uint32_t* out_id) {
+    if ((t->size + 1) * 10 >= t->cap * 7) {
+        if (!rehash(t, t->cap * 2)) return false;
+    }
+
+    uint64_t h = fnv1a64(s, n);
+    size_t mask = t->cap - 1;
+    size_t pos = (size_t)h & mask;
+    while (t->tab[pos]) {
+        uint32_t id = t->tab[pos] - 1;
+        if (t->hash[id] == h && t->len[id] == n && std::memcmp(t->pool + t->off[id], s, n) == 0) {
+            *out_id = id;
+            return true;
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    if (!add_term(t, s, n, h)) return false;
+    t->tab[pos] = (uint32_t)t->size;
+    *out_id = (uint32_t)t->size - 1;
+    return true;
+}
+
+bool term_ids_save(const TermIds* t, const char* path) {
+    FILE* f = std::fopen(path, "wb");
+    if (!f) return false;
+    bool ok = true;
+    for (size_t id = 0; id < t->size && ok; ++id) {
+        if (std::fwrite(t->pool + t->off[id], 1, t->len[id], f) != t->len[id]) ok = false;
+        if (std::fputc('\n', f) == EOF) ok = false;
+    }
+    if (std::fclose(f) != 0) ok = false;
+    return ok;
+}
+
+// Loads a dictionary written by term_ids_save; ids follow line order.
+bool term_ids_load(TermIds* t, const char* path) {
+    if (!term_ids_init(t)) return false;
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+
+    unsigned char* line = nullptr;
+    size_t line_len = 0, line_cap = 0;
+    unsigned char chunk[1 << 16];
+    bool ok = true;
+    size_t rd;
+    while (ok && (rd = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        size_t start = 0;
+        for (size_t i = 0; i <= rd && ok; ++i) {
+            if (i < rd && chunk[i] != '\n') continue;
+            size_t n = i - start;
+            if (n > 0 && line_len + n > line_cap) {
+                size_t nc = (line_cap == 0 ? 4096 : line_cap);
+                while (nc < line_len + n) nc *= 2;
+                unsigned char* np = (unsigned char*)std::realloc(line, nc);
+                if (!np) { ok = false; break; }
+                line = np;
+                line_cap = nc;
+            }
+            if (n > 0) std::memcpy(line + line_len, chunk + start, n);
+            line_len += n;
+            if (i < rd) {
+                size_t L = line_len;
+                if (L > 0 && line[L - 1] == '\r') L--;
+                ok = add_term(t, line, L, fnv1a64(line, L));
+                line_len = 0;
+            }
+            start = i + 1;
+        }
+    }
+    if (std::ferror(f)) ok = false;
+    std::fclose(f);
+    if (ok && line_len > 0) ok = add_term(t, line, line_len, fnv1a64(line, line_len));
+    std::free(line);
+
+    size_t cap = t->cap;
+    while ((t->size + 1) * 10 >= cap * 7) cap *= 2;
+    if (ok) ok = rehash(t, cap);
+    return ok;
+}
+
+void term_ids_free(TermIds* t) {
+    std::free(t->tab);
+    std::free(t->hash);
+    std::free(t->off);
+    std::free(t->len);
+    std::free(t->pool);
+    std::memset(t, 0, sizeof(*t));
+}
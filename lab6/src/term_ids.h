@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Global term dictionary for the binary token format: every distinct term
+// gets a dense id in order of first appearance. The dictionary file lists
+// the terms one per line, so the id of a term is its line number from 0.
+// A .tid file is the document's token stream as LEB128 varint ids.
+struct TermIds {
+    uint32_t* tab;
+    size_t cap;
+    size_t size;
+
+    uint64_t* hash;
+    uint32_t* off;
+    uint32_t* len;
+    size_t ids_cap;
+
+    unsigned char* pool;
+    size_t pool_len;
+    size_t pool_cap;
+};
+
+static const char* const TERM_IDS_DICT_NAME = "terms.dict";
+
+bool term_ids_init(TermIds* t);
+bool term_ids_get_or_add(TermIds* t, const unsigned char* s, size_t n, uint32_t* out_id);
+bool term_ids_save(const TermIds* t, const char* path);
+bool term_ids_load(TermIds* t, const char* path);
+void term_ids_free(TermIds* t);
+
+inline const unsigned char* term_ids_str(const TermIds* t, uint32_t id, size_t* n) {
+    *n = t->len[id];
+    return t->pool + t->off[id];
+}
+
+inline size_t varint_put(uint32_t v, unsigned char out[5]) {
+    size_t k = 0;
+    while (v >= 0x80) {
+        out[k++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[k++] = (unsigned char)v;
+    return k;
+}
+
+// Decodes one id at *pos; false at the end of input or on a cut sequence.
+inline bool varint_get(const unsigned char* s, size_t n, size_t* pos, uint32_t* out) {
+    uint32_t v = 0;
+    size_t p = *pos;
+    for (int shift = 0; shift < 35 && p < n; shift += 7) {
+        unsigned char b = s[p++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *pos = p;
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
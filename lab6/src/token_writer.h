@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+// Collects newline-terminated tokens in memory and hands them to the FILE in
+// large blocks, so the hot path is a memcpy instead of two stdio calls.
+struct TokenWriter {
+    FILE* out;
+    unsigned char* buf;
+    size_t len;
+    size_t cap;
+    unsigned long long write_calls;
+    unsigned long long bytes_out;
+    bool ok;
+};
+
+static const size_t TOKEN_WRITER_BUF = (size_t)1 << 20;
+
+// Uses the calling thread's reusable buffer; one open writer per thread.
+bool token_writer_open(TokenWriter* w, FILE* out);
+bool token_writer_flush(TokenWriter* w);
+bool token_writer_close(TokenWriter* w);
+
+inline bool token_writer_write(TokenWriter* w, const unsigned char* p, size_t len) {
+    if (w->len + len > w->cap) {
+        if (!token_writer_flush(w)) return false;
+        if (len > w->cap) {
+            w->write_calls++;
+            w->bytes_out += len;
+            if (std::fwrite(p, 1, len, w->out) != len) { w->ok = false; return false; }
+            return true;
+        }
+    }
+    std::memcpy(w->buf + w->len, p, len);
+    w->len += len;
+    return true;
+}
+
+inline bool token_writer_put(TokenWriter* w, const unsigned char* tok, size_t len) {
+    if (w->len + len + 1 > w->cap) {
+        if (!token_writer_flush(w)) return false;
+        if (len + 1 > w->cap) {
+            w->write_calls++;
+            w->bytes_out += len;
+            if (std::fwrite(tok, 1, len, w->out) != len) { w->ok = false; return false; }
+            w->buf[w->len++] = '\n';
+            return true;
+        }
+    }
+    std::memcpy(w->buf + w->len, tok, len);
+    w->len += len;
+    w->buf[w->len++] = '\n';
+    return true;
+}
@@ -0,0 +1,235 @@
+#include "tokenize.h"
+#include "utf8.h"
+#include "stem_cache.h"
+#include "token_writer.h"
+#include "term_ids.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const size_t READ_CHUNK = (size_t)1 << 16;
+
+static bool tok_reserve(Tokenizer* t, size_t need) {
+    if (need <= t->tok_cap) return true;
+    size_t new_cap = (t->tok_cap == 0 ? 64 : t->tok_cap);
+    while (new_cap < need) new_cap *= 2;
+    unsigned char* p = (unsigned char*)std::realloc(t->tok, new_cap);
+    if (!p) return false;
+    t->tok = p;
+    t->tok_cap = new_cap;
+    return true;
+}
+
+static bool flush_token(Tokenizer* t) {
+    if (t->tok_len == 0) return true;
+
+    size_t L = t->tok_len;
+    stem_apply_cached(t->stem, t->tok, &L);
+
+    if (L > 0 && !t->sink(t->tok, L, t->user)) return false;
+
+    t->st.tokens_out++;
+    t->st.token_chars_sum += t->tok_chars;
+
+    t->tok_len = 0;
+    t->tok_chars = 0;
+    return true;
+}
+
+// Processes sequences starting before `stop`. Unless `final`, stops at a
+// sequence that runs past n and returns its offset so it can be completed
+// by the next chunk. The current token is kept in locals and written back
+// around calls that look at it.
+static size_t scan(Tokenizer* t, const unsigned char* s, size_t n, size_t stop, bool final) {
+    unsigned char* tok = t->tok;
+    size_t tok_cap = t->tok_cap;
+    size_t tok_len = t->tok_len;
+    unsigned long long tok_chars = t->tok_chars;
+
+    auto flush = [&]() -> bool {
+        if (tok_len == 0) return true;
+        t->tok_len = tok_len;
+        t->tok_chars = tok_chars;
+        bool ok = flush_token(t);
+        tok_len = 0;
+        tok_chars = 0;
+        return ok;
+    };
+
+    size_t i = 0;
+    while (i < stop) {
+        if (!final && n - i < 4 && utf8_seq_len(s[i]) > n - i) break;
+
+        size_t used = 0;
+        uint32_t cp = 0;
+        bool ok = utf8_decode_one(s + i, n - i, &used, &cp);
+        if (!ok || used == 0) {
+            if (!flush()) { t->ok = false; return n; }
+            i += 1;
+            continue;
+        }
+
+        if (is_token_char(cp)) {
+            cp = to_lower_basic(cp);
+            if (tok_len + 4 > tok_cap) {
+                t->tok_len = tok_len;
+                if (!tok_reserve(t, tok_len + 4)) { t->ok = false; return n; }
+                tok = t->tok;
+                tok_cap = t->tok_cap;
+            }
+            tok_len += utf8_encode_one(cp, tok + tok_len);
+            tok_chars += 1;
+        } else {
+            if (!flush()) { t->ok = false; return n; }
+        }
+
+        i += used;
+    }
+
+    t->tok_len = tok_len;
+    t->tok_chars = tok_chars;
+    return i;
+}
+
+void tokenizer_init(Tokenizer* t, StemMode stem, token_sink_t sink, void* user) {
+    std::memset(t, 0, sizeof(*t));
+    t->stem = stem;
+    t->sink = sink;
+    t->user = user;
+    t->ok = (sink != nullptr);
+}
+
+bool tokenizer_feed(Tokenizer* t, const unsigned char* data, size_t n) {
+    if (!t->ok) return false;
+    if (n == 0) return true;
+    t->st.bytes_in += n;
+
+    if (t->carry_len > 0) {
+        // Finish the cut sequence from a small window: the carried bytes plus
+        // enough of the new chunk to complete any sequence starting in them.
+        unsigned char win[8];
+        size_t c = t->carry_len;
+        size_t take = (n < 4 ? n : 4);
+        std::memcpy(win, t->carry, c);
+        std::memcpy(win + c, data, take);
+        t->carry_len = 0;
+
+        size_t pos = scan(t, win, c + take, c, false);
+        if (!t->ok) return false;
+        if (pos < c) {
+            t->carry_len = c + take - pos;
+            std::memcpy(t->carry, win + pos, t->carry_len);
+            return true;
+        }
+        data += pos - c;
+        n -= pos - c;
+    }
+
+    size_t pos = scan(t, data, n, n, false);
+    if (!t->ok) return false;
+    t->carry_len = n - pos;
+    std::memcpy(t->carry, data + pos, t->carry_len);
+    return true;
+}
+
+bool tokenizer_finish(Tokenizer* t) {
+    if (!t->ok) return false;
+    if (t->carry_len > 0) {
+        scan(t, t->carry, t->carry_len, t->carry_len, true);
+        t->carry_len = 0;
+        if (!t->ok) return false;
+    }
+    if (!flush_token(t)) t->ok = false;
+    return t->ok;
+}
+
+void tokenizer_free(Tokenizer* t) {
+    std::free(t->tok);
+    t->tok = nullptr;
+    t->tok_cap = 0;
+    t->tok_len = 0;
+}
+
+static bool writer_sink(const unsigned char* tok, size_t len, void* user) {
+    return token_writer_put((TokenWriter*)user, tok, len);
+}
+
+struct IdSink {
+    TokenWriter* w;
+    TermIds* ids;
+};
+
+static bool id_sink(const unsigned char* tok, size_t len, void* user) {
+    IdSink* s = (IdSink*)user;
+    uint32_t id;
+    if (!term_ids_get_or_add(s->ids, tok, len, &id)) return false;
+    unsigned char v[5];
+    return token_writer_write(s->w, v, varint_put(id, v));
+}
+
+// Tokenizes either the open file `in` (read in chunks) or the in-memory
+// buffer data[0..n).
+static bool tokenize_input(FILE* in, const unsigned char* data, size_t n,
+                           FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids) {
+    if (st) { st->bytes_in = 0; st->tokens_out = 0; st->token_chars_sum = 0; st->write_calls = 0; st->bytes_out = 0; }
+    if (!out) return false;
+
+    unsigned char* chunk = nullptr;
+    if (in) {
+        chunk = (unsigned char*)std::malloc(READ_CHUNK);
+        if (!chunk) return false;
+    }
+
+    TokenWriter w;
+    if (!token_writer_open(&w, out)) { std::free(chunk); return false; }
+
+    IdSink is = {&w, ids};
+    Tokenizer t;
+    if (ids) tokenizer_init(&t, stem, id_sink, &is);
+    else tokenizer_init(&t, stem, writer_sink, &w);
+
+    bool ok = true;
+    if (in) {
+        size_t rd;
+        while (ok && (rd = std::fread(chunk, 1, READ_CHUNK, in)) > 0) {
+            ok = tokenizer_feed(&t, chunk, rd);
+        }
+        if (ok && std::ferror(in)) ok = false;
+    } else {
+        ok = tokenizer_feed(&t, data, n);
+    }
+    if (ok) ok = tokenizer_finish(&t);
+    std::free(chunk);
+
+    if (!token_writer_close(&w)) ok = false;
+    if (st) {
+        *st = t.st;
+        st->write_calls = w.write_calls;
+        st->bytes_out = w.bytes_out;
+    }
+    tokenizer_free(&t);
+    return ok;
+}
+
+static bool tokenize_file(const char* input_path, FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids) {
+    if (!input_path || !out) return false;
+    FILE* f = std::fopen(input_path, "rb");
+    if (!f) return false;
+    bool ok = tokenize_input(f, nullptr, 0, out, st, stem, ids);
+    std::fclose(f);
+    return ok;
+}
+
+bool tokenize_file_to_stream_ex(const char* input_path, FILE* out, TokenizeStats* st, StemMode stem) {
+    return tokenize_file(input_path, out, st, stem, nullptr);
+}
+
+bool tokenize_file_to_ids_ex(const char* input_path, FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids) {
+    if (!ids) return false;
+    return tokenize_file(input_path, out, st, stem, ids);
+}
+
+bool tokenize_buffer_ex(const unsigned char* data, size_t n, FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids) {
+    if (!data && n > 0) return false;
+    return tokenize_input(nullptr, data, n, out, st, stem, ids);
+}
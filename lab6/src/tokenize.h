@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include "stem_ru.h"
+
+struct TokenizeStats {
+    unsigned long long bytes_in;
+    unsigned long long tokens_out;
+    unsigned long long token_chars_sum;
+    unsigned long long write_calls;
+    unsigned long long bytes_out;
+};
+
+typedef bool (*token_sink_t)(const unsigned char* tok, size_t len, void* user);
+
+// Streaming tokenizer: input arrives in chunks of any size; a token or a
+// UTF-8 sequence cut by a chunk boundary is carried over to the next chunk,
+// so the output does not depend on how the input was split.
+struct Tokenizer {
+    StemMode stem;
+    token_sink_t sink;
+    void* user;
+
+    unsigned char carry[4];
+    size_t carry_len;
+
+    unsigned char* tok;
+    size_t tok_cap;
+    size_t tok_len;
+    unsigned long long tok_chars;
+
+    TokenizeStats st;
+    bool ok;
+};
+
+void tokenizer_init(Tokenizer* t, StemMode stem, token_sink_t sink, void* user);
+bool tokenizer_feed(Tokenizer* t, const unsigned char* data, size_t n);
+bool tokenizer_finish(Tokenizer* t);
+void tokenizer_free(Tokenizer* t);
+
+struct TermIds;
+
+bool tokenize_file_to_stream_ex(const char* input_path, FILE* out, TokenizeStats* st, StemMode stem);
+
+// Binary variant: writes the document as varint term ids from `ids` (.tid).
+bool tokenize_file_to_ids_ex(const char* input_path, FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids);
+
+// Same for a document already in memory (ids may be null for .tok output).
+bool tokenize_buffer_ex(const unsigned char* data, size_t n, FILE* out, TokenizeStats* st, StemMode stem, TermIds* ids);
+
+inline bool tokenize_file_to_stream(const char* input_path, FILE* out, TokenizeStats* st) {
+    return tokenize_file_to_stream_ex(input_path, out, st, STEM_NONE);
+}
@@ -1,8 +1,16 @@
 #include "win_files.h"
-#include <windows.h>
+#include "file_scan.h"
 #include <cstdio>
 #include <cstring>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
 bool ensure_dir_exists(const char* path) {
     if (!path || !path[0]) return false;
     DWORD attr = GetFileAttributesA(path);
@@ -12,40 +20,44 @@ bool ensure_dir_exists(const char* path) {
     return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
 }
 
-static void join_path(char* out, size_t out_sz, const char* a, const char* b) {
-    if (!out || out_sz == 0) return;
-    out[0] = 0;
-    std::snprintf(out, out_sz, "%s\\%s", a, b);
-}
-
-static bool list_files_by_pattern(const char* dir_path, const char* pattern_ext, file_callback_t cb, void* user) {
-    if (!dir_path || !cb || !pattern_ext) return false;
+#else
 
-    char pattern[MAX_PATH];
-    std::snprintf(pattern, sizeof(pattern), "%s\\%s", dir_path, pattern_ext);
+bool ensure_dir_exists(const char* path) {
+    if (!path || !path[0]) return false;
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) return true;
+    if (mkdir(path, 0777) == 0) return true;
+    return (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+}
 
-    WIN32_FIND_DATAA ffd;
-    HANDLE h = FindFirstFileA(pattern, &ffd);
-    if (h == INVALID_HANDLE_VALUE) {
-        std::fprintf(stderr, "FindFirstFileA failed for: %s\n", pattern);
-        return false;
-    }
+#endif
 
-    do {
-        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
-        char full[MAX_PATH];
-        join_path(full, sizeof(full), dir_path, ffd.cFileName);
-        cb(full, ffd.cFileName, user);
-    } while (FindNextFileA(h, &ffd));
+struct ShimCtx {
+    file_callback_t cb;
+    void* user;
+};
 
-    FindClose(h);
+// Passes the bare file name, as FindFirstFileA did for these flat listings.
+static bool shim_batch(const ScanEntry* batch, size_t n, void* user) {
+    ShimCtx* c = (ShimCtx*)user;
+    for (size_t i = 0; i < n; ++i) c->cb(batch[i].full_path, batch[i].rel_path, c->user);
     return true;
 }
 
+static bool list_flat(const char* dir_path, const char* ext, file_callback_t cb, void* user) {
+    if (!dir_path || !cb) return false;
+    ShimCtx c = {cb, user};
+    return scan_files(dir_path, ext, false, 1, SCAN_BY_INODE, shim_batch, &c);
+}
+
 bool list_txt_files(const char* dir_path, file_callback_t cb, void* user) {
-    return list_files_by_pattern(dir_path, "*.txt", cb, user);
+    return list_flat(dir_path, "txt", cb, user);
 }
 
 bool list_tok_files(const char* dir_path, file_callback_t cb, void* user) {
-    return list_files_by_pattern(dir_path, "*.tok", cb, user);
+    return list_flat(dir_path, "tok", cb, user);
+}
+
+bool list_tid_files(const char* dir_path, file_callback_t cb, void* user) {
+    return list_flat(dir_path, "tid", cb, user);
 }
@@ -3,8 +3,8 @@ setlocal
 
 if not exist bin mkdir bin
 
-g++ -O2 -std=c++17 -Wall -Wextra ^
-  src\search.cpp src\utf8.cpp src\stem_ru.cpp ^
+g++ -O2 -std=c++17 -Wall -Wextra -mpopcnt ^
+  src\search.cpp src\utf8.cpp src\stem_ru.cpp src\stem_ru_snowball.cpp src\segments.cpp src\roaring.cpp src\rlist.cpp ^
   -o bin\search.exe
 
 if errorlevel 1 (
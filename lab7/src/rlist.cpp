@@ -0,0 +1,406 @@
+#include "rlist.h"
+#include <cstdio>
+#include <cstdlib>
+
+static void* rl_alloc(size_t n) {
+    void* p = std::malloc(n ? n : 1);
+    if (!p) {
+        std::fprintf(stderr, "ERROR: OOM\n");
+        std::exit(1);
+    }
+    return p;
+}
+
+static const uint16_t* c_arr(const RCont& c) { return (const uint16_t*)c.data; }
+static const uint64_t* c_words(const RCont& c) { return (const uint64_t*)c.data; }
+// Run r of a run container: [start, start + len].
+static uint32_t run_start(const RCont& c, uint32_t r) { return ((const uint16_t*)c.data)[2 * r]; }
+static uint32_t run_last(const RCont& c, uint32_t r) {
+    return run_start(c, r) + ((const uint16_t*)c.data)[2 * r + 1];
+}
+
+static uint32_t popcount_words(const uint64_t* w) {
+    uint32_t card = 0;
+    for (size_t i = 0; i < RC_BITMAP_WORDS; ++i) card += (uint32_t)__builtin_popcountll(w[i]);
+    return card;
+}
+
+// Sets (or clears) the bits lo..hi of a bitmap.
+static void words_range(uint64_t* w, uint32_t lo, uint32_t hi, bool set) {
+    uint32_t a = lo >> 6, b = hi >> 6;
+    uint64_t ma = ~0ULL << (lo & 63), mb = ~0ULL >> (63 - (hi & 63));
+    if (a == b) {
+        if (set) w[a] |= ma & mb;
+        else w[a] &= ~(ma & mb);
+        return;
+    }
+    if (set) {
+        w[a] |= ma;
+        for (uint32_t i = a + 1; i < b; ++i) w[i] = ~0ULL;
+        w[b] |= mb;
+    } else {
+        w[a] &= ~ma;
+        for (uint32_t i = a + 1; i < b; ++i) w[i] = 0;
+        w[b] &= ~mb;
+    }
+}
+
+// A zeroed bitmap holding c's ids.
+static uint64_t* to_words(const RCont& c) {
+    uint64_t* w = (uint64_t*)rl_alloc(RC_BITMAP_WORDS * 8);
+    if (c.type == RC_BITMAP) {
+        std::memcpy(w, c.data, RC_BITMAP_WORDS * 8);
+        return w;
+    }
+    std::memset(w, 0, RC_BITMAP_WORDS * 8);
+    if (c.type == RC_ARRAY) {
+        const uint16_t* a = c_arr(c);
+        for (uint32_t i = 0; i < c.n; ++i) w[a[i] >> 6] |= 1ULL << (a[i] & 63);
+    } else {
+        for (uint32_t r = 0; r < c.n; ++r) words_range(w, run_start(c, r), run_last(c, r), true);
+    }
+    return w;
+}
+
+struct RBuild {
+    RList l;
+    uint32_t cap;
+};
+
+static void rb_push(RBuild* b, const RCont& c) {
+    if (b->l.nc == b->cap) {
+        uint32_t nc = (b->cap ? b->cap * 2 : 4);
+        RCont* ns = (RCont*)rl_alloc((size_t)nc * sizeof(RCont));
+        if (b->l.nc) std::memcpy(ns, b->l.c, (size_t)b->l.nc * sizeof(RCont));
+        std::free(b->l.c);
+        b->l.c = ns;
+        b->cap = nc;
+    }
+    b->l.c[b->l.nc++] = c;
+    b->l.card += c.card;
+}
+
+static void push_array(RBuild* b, uint16_t key, uint16_t* v, uint32_t n) {
+    if (n == 0) {
+        std::free(v);
+        return;
+    }
+    rb_push(b, RCont{key, RC_ARRAY, n, n, v, true});
+}
+
+// Keeps a bitmap result as a bitmap only while it holds more than
+// RC_ARRAY_MAX ids, as the encoder would.
+static void push_words(RBuild* b, uint16_t key, uint64_t* w, uint32_t card) {
+    if (card > RC_ARRAY_MAX) {
+        rb_push(b, RCont{key, RC_BITMAP, card, card, w, true});
+        return;
+    }
+    uint16_t* v = (uint16_t*)rl_alloc((size_t)card * 2);
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < RC_BITMAP_WORDS; ++i) {
+        uint64_t bits = w[i];
+        while (bits) {
+            v[k++] = (uint16_t)((i << 6) | (uint32_t)__builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+    std::free(w);
+    push_array(b, key, v, k);
+}
+
+// Containers of the index are shared; those of an intermediate result are
+// copied, since it is freed after the operation.
+static void push_copy(RBuild* b, const RCont& c) {
+    if (!c.owned) {
+        rb_push(b, c);
+        return;
+    }
+    size_t bytes = (c.type == RC_BITMAP ? RC_BITMAP_WORDS * 8 : (c.type == RC_RUN ? 4ULL * c.n : 2ULL * c.n));
+    void* d = rl_alloc(bytes);
+    std::memcpy(d, c.data, bytes);
+    RCont x = c;
+    x.data = d;
+    rb_push(b, x);
+}
+
+// Array values of a kept (keep = true) or dropped by membership in o.
+static void filter_array(RBuild* b, const RCont& a, const RCont& o, bool keep) {
+    uint16_t* v = (uint16_t*)rl_alloc((size_t)a.n * 2);
+    const uint16_t* x = c_arr(a);
+    uint32_t k = 0;
+    if (o.type == RC_ARRAY) {
+        const uint16_t* y = c_arr(o);
+        uint32_t i = 0, j = 0;
+        while (i < a.n && j < o.n) {
+            if (x[i] == y[j]) {
+                if (keep) v[k++] = x[i];
+                i++;
+                j++;
+            } else if (x[i] < y[j]) {
+                if (!keep) v[k++] = x[i];
+                i++;
+            } else {
+                j++;
+            }
+        }
+        if (!keep) {
+            while (i < a.n) v[k++] = x[i++];
+        }
+    } else if (o.type == RC_BITMAP) {
+        const uint64_t* w = c_words(o);
+        for (uint32_t i = 0; i < a.n; ++i) {
+            bool in = (w[x[i] >> 6] >> (x[i] & 63)) & 1;
+            if (in == keep) v[k++] = x[i];
+        }
+    } else {
+        uint32_t r = 0;
+        for (uint32_t i = 0; i < a.n; ++i) {
+            while (r < o.n && run_last(o, r) < x[i]) r++;
+            bool in = (r < o.n && run_start(o, r) <= x[i]);
+            if (in == keep) v[k++] = x[i];
+        }
+    }
+    push_array(b, a.key, v, k);
+}
+
+// Runs of a and b merged (AND: their overlaps; OR: their union).
+static void merge_runs(RBuild* b, const RCont& x, const RCont& y, bool inter) {
+    uint16_t* v = (uint16_t*)rl_alloc(4ULL * (x.n + y.n));
+    uint32_t k = 0, card = 0, i = 0, j = 0;
+    auto emit = [&](uint32_t s, uint32_t e) {
+        if (k > 0 && !inter && s <= (uint32_t)v[2 * (k - 1)] + v[2 * (k - 1) + 1] + 1) {
+            uint32_t ps = v[2 * (k - 1)], pe = ps + v[2 * (k - 1) + 1];
+            if (e > pe) {
+                card += e - pe;
+                v[2 * (k - 1) + 1] = (uint16_t)(e - ps);
+            }
+            return;
+        }
+        v[2 * k] = (uint16_t)s;
+        v[2 * k + 1] = (uint16_t)(e - s);
+        card += e - s + 1;
+        k++;
+    };
+    if (inter) {
+        while (i < x.n && j < y.n) {
+            uint32_t s = run_start(x, i) > run_start(y, j) ? run_start(x, i) : run_start(y, j);
+            uint32_t e = run_last(x, i) < run_last(y, j) ? run_last(x, i) : run_last(y, j);
+            if (s <= e) emit(s, e);
+            if (run_last(x, i) < run_last(y, j)) i++;
+            else j++;
+        }
+    } else {
+        while (i < x.n || j < y.n) {
+            bool take_x = (j == y.n || (i < x.n && run_start(x, i) <= run_start(y, j)));
+            if (take_x) {
+                emit(run_start(x, i), run_last(x, i));
+                i++;
+            } else {
+                emit(run_start(y, j), run_last(y, j));
+                j++;
+            }
+        }
+    }
+    if (k == 0) {
+        std::free(v);
+        return;
+    }
+    rb_push(b, RCont{x.key, RC_RUN, k, card, v, true});
+}
+
+static void and_cont(RBuild* b, const RCont& p, const RCont& q) {
+    const RCont& x = (p.type <= q.type ? p : q);
+    const RCont& y = (p.type <= q.type ? q : p);
+    if (x.type == RC_ARRAY) {
+        filter_array(b, x, y, true);
+    } else if (x.type == RC_BITMAP && y.type == RC_BITMAP) {
+        uint64_t* w = (uint64_t*)rl_alloc(RC_BITMAP_WORDS * 8);
+        const uint64_t* u = c_words(x);
+        const uint64_t* v = c_words(y);
+        uint32_t card = 0;
+        for (size_t i = 0; i < RC_BITMAP_WORDS; ++i) {
+            w[i] = u[i] & v[i];
+            card += (uint32_t)__builtin_popcountll(w[i]);
+        }
+        push_words(b, x.key, w, card);
+    } else if (x.type == RC_BITMAP) {
+        // Bitmap AND runs: the bitmap's bits inside each run, word by word.
+        uint64_t* w = (uint64_t*)rl_alloc(RC_BITMAP_WORDS * 8);
+        std::memset(w, 0, RC_BITMAP_WORDS * 8);
+        const uint64_t* u = c_words(x);
+        for (uint32_t r = 0; r < y.n; ++r) {
+            uint32_t lo = run_start(y, r), hi = run_last(y, r);
+            uint32_t a = lo >> 6, z = hi >> 6;
+            for (uint32_t i = a; i <= z; ++i) {
+                uint64_t m = ~0ULL;
+                if (i == a) m &= ~0ULL << (lo & 63);
+                if (i == z) m &= ~0ULL >> (63 - (hi & 63));
+                w[i] |= u[i] & m;
+            }
+        }
+        push_words(b, x.key, w, popcount_words(w));
+    } else {
+        merge_runs(b, x, y, true);
+    }
+}
+
+static void or_cont(RBuild* b, const RCont& p, const RCont& q) {
+    const RCont& x = (p.type <= q.type ? p : q);
+    const RCont& y = (p.type <= q.type ? q : p);
+    if (x.type == RC_ARRAY && y.type == RC_ARRAY) {
+        uint16_t* v = (uint16_t*)rl_alloc(2ULL * (x.n + y.n));
+        const uint16_t* s = c_arr(x);
+        const uint16_t* t = c_arr(y);
+        uint32_t i = 0, j = 0, k = 0;
+        while (i < x.n && j < y.n) {
+            if (s[i] == t[j]) { v[k++] = s[i]; i++; j++; }
+            else if (s[i] < t[j]) v[k++] = s[i++];
+            else v[k++] = t[j++];
+        }
+        while (i < x.n) v[k++] = s[i++];
+        while (j < y.n) v[k++] = t[j++];
+        if (k <= RC_ARRAY_MAX) {
+            push_array(b, x.key, v, k);
+            return;
+        }
+        uint64_t* w = (uint64_t*)rl_alloc(RC_BITMAP_WORDS * 8);
+        std::memset(w, 0, RC_BITMAP_WORDS * 8);
+        for (uint32_t m = 0; m < k; ++m) w[v[m] >> 6] |= 1ULL << (v[m] & 63);
+        std::free(v);
+        push_words(b, x.key, w, k);
+    } else if (x.type == RC_RUN) {
+        merge_runs(b, x, y, false);
+    } else if (x.type == RC_BITMAP && y.type == RC_BITMAP) {
+        uint64_t* w = (uint64_t*)rl_alloc(RC_BITMAP_WORDS * 8);
+        const uint64_t* u = c_words(x);
+        const uint64_t* v = c_words(y);
+        uint32_t card = 0;
+        for (size_t i = 0; i < RC_BITMAP_WORDS; ++i) {
+            w[i] = u[i] | v[i];
+            card += (uint32_t)__builtin_popcountll(w[i]);
+        }
+        push_words(b, x.key, w, card);
+    } else {
+        // Array or bitmap with runs, or array with bitmap: set the smaller
+        // side's ids in a copy of the other's bitmap.
+        const RCont& big = (y.type == RC_RUN || x.type == RC_ARRAY ? y : x);
+        const RCont& small = (&big == &y ? x : y);
+        uint64_t* w = to_words(big);
+        if (small.type == RC_ARRAY) {
+            const uint16_t* a = c_arr(small);
+            for (uint32_t i = 0; i < small.n; ++i) w[a[i] >> 6] |= 1ULL << (a[i] & 63);
+        } else if (small.type == RC_BITMAP) {
+            const uint64_t* u = c_words(small);
+            for (size_t i = 0; i < RC_BITMAP_WORDS; ++i) w[i] |= u[i];
+        } else {
+            for (uint32_t r = 0; r < small.n; ++r) words_range(w, run_start(small, r), run_last(small, r), true);
+        }
+        push_words(b, x.key, w, popcount_words(w));
+    }
+}
+
+static void andnot_cont(RBuild* b, const RCont& x, const RCont& y) {
+    if (x.type == RC_ARRAY) {
+        filter_array(b, x, y, false);
+        return;
+    }
+    uint64_t* w = to_words(x);
+    if (y.type == RC_ARRAY) {
+        const uint16_t* a = c_arr(y);
+        for (uint32_t i = 0; i < y.n; ++i) w[a[i] >> 6] &= ~(1ULL << (a[i] & 63));
+    } else if (y.type == RC_BITMAP) {
+        const uint64_t* u = c_words(y);
+        for (size_t i = 0; i < RC_BITMAP_WORDS; ++i) w[i] &= ~u[i];
+    } else {
+        for (uint32_t r = 0; r < y.n; ++r) words_range(w, run_start(y, r), run_last(y, r), false);
+    }
+    push_words(b, x.key, w, popcount_words(w));
+}
+
+enum RlOp { RL_AND, RL_OR, RL_ANDNOT };
+
+static RList rl_merge(const RList& a, const RList& b, RlOp op) {
+    RBuild r;
+    std::memset(&r, 0, sizeof(r));
+    uint32_t i = 0, j = 0;
+    while (i < a.nc || j < b.nc) {
+        if (j == b.nc || (i < a.nc && a.c[i].key < b.c[j].key)) {
+            if (op != RL_AND) push_copy(&r, a.c[i]);
+            i++;
+        } else if (i == a.nc || b.c[j].key < a.c[i].key) {
+            if (op == RL_OR) push_copy(&r, b.c[j]);
+            j++;
+        } else {
+            if (op == RL_AND) and_cont(&r, a.c[i], b.c[j]);
+            else if (op == RL_OR) or_cont(&r, a.c[i], b.c[j]);
+            else andnot_cont(&r, a.c[i], b.c[j]);
+            i++;
+            j++;
+        }
+    }
+    return r.l;
+}
+
+RList rl_and(const RList& a, const RList& b) { return rl_merge(a, b, RL_AND); }
+RList rl_or(const RList& a, const RList& b) { return rl_merge(a, b, RL_OR); }
+RList rl_andnot(const RList& a, const RList& b) { return rl_merge(a, b, RL_ANDNOT); }
+
+bool rl_from_blob(const unsigned char* p, const unsigned char* end, uint32_t df, RList* out) {
+    RBuild r;
+    std::memset(&r, 0, sizeof(r));
+    while (r.l.card < df) {
+        RoaringChunk h;
+        if (end - p < (ptrdiff_t)RC_CHUNK_HEAD || !roaring_chunk_head(p, &h)) break;
+        size_t bytes = roaring_data_bytes(h.type, h.n);
+        if ((size_t)(end - p) < RC_CHUNK_HEAD + bytes) break;
+        const unsigned char* d = p + RC_CHUNK_HEAD;
+        uint32_t card = roaring_chunk_card(&h, d);
+        if (r.l.nc > 0 && h.key <= r.l.c[r.l.nc - 1].key) break;
+        rb_push(&r, RCont{h.key, h.type, h.n, card, d, false});
+        p += RC_CHUNK_HEAD + bytes;
+    }
+    if (r.l.card != df) {
+        rl_free(&r.l);
+        return false;
+    }
+    *out = r.l;
+    return true;
+}
+
+RList rl_from_ids(const uint32_t* ids, uint32_t n) {
+    RBuild r;
+    std::memset(&r, 0, sizeof(r));
+    uint16_t* lows = (uint16_t*)rl_alloc(65536 * 2);
+    unsigned char* buf = (unsigned char*)rl_alloc(RC_CHUNK_MAX);
+    uint32_t i = 0;
+    while (i < n) {
+        uint32_t key = ids[i] >> 16, m = 0;
+        while (i < n && (ids[i] >> 16) == key) lows[m++] = (uint16_t)ids[i++];
+        roaring_chunk_encode((uint16_t)key, lows, m, buf);
+        RoaringChunk h;
+        roaring_chunk_head(buf, &h);
+        size_t bytes = roaring_data_bytes(h.type, h.n);
+        void* d = rl_alloc(bytes);
+        std::memcpy(d, buf + RC_CHUNK_HEAD, bytes);
+        rb_push(&r, RCont{h.key, h.type, h.n, m, d, true});
+    }
+    std::free(lows);
+    std::free(buf);
+    return r.l;
+}
+
+void rl_to_ids(const RList* l, uint32_t* out) {
+    for (uint32_t i = 0; i < l->nc; ++i) {
+        const RCont& c = l->c[i];
+        RoaringChunk h{c.key, c.type, c.n};
+        out += roaring_chunk_decode(&h, (const unsigned char*)c.data, out);
+    }
+}
+
+void rl_free(RList* l) {
+    for (uint32_t i = 0; i < l->nc; ++i) {
+        if (l->c[i].owned) std::free((void*)l->c[i].data);
+    }
+    std::free(l->c);
+    std::memset(l, 0, sizeof(*l));
+}
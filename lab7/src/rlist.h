@@ -0,0 +1,38 @@
+#pragma once
+#include "roaring.h"
+#include <cstddef>
+#include <cstdint>
+
+// A doc-id set held as hybrid containers (see roaring.h), one per 64K chunk,
+// in key order. Containers read from an index point into its buffer; those
+// built by the set operations own their data.
+struct RCont {
+    uint16_t key;
+    uint16_t type;
+    uint32_t n;      // ids for arrays and bitmaps, runs for run containers
+    uint32_t card;
+    const void* data;
+    bool owned;
+};
+
+struct RList {
+    RCont* c;
+    uint32_t nc;
+    uint32_t card;
+};
+
+// The containers of one term's postings blob (df ids); false if malformed.
+// The blob must start on an 8-byte boundary.
+bool rl_from_blob(const unsigned char* p, const unsigned char* end, uint32_t df, RList* out);
+// Sorted, distinct ids.
+RList rl_from_ids(const uint32_t* ids, uint32_t n);
+// Writes the ids in increasing order; out holds l->card.
+void rl_to_ids(const RList* l, uint32_t* out);
+void rl_free(RList* l);
+
+// Merge by key, with one routine per container pair: array/array merges,
+// array probes into bitmaps and runs, bitmap/bitmap word ops with popcount,
+// and run/run on intervals.
+RList rl_and(const RList& a, const RList& b);
+RList rl_or(const RList& a, const RList& b);
+RList rl_andnot(const RList& a, const RList& b);
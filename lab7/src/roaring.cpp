@@ -0,0 +1,109 @@
+#include "roaring.h"
+#include <cstdlib>
+
+static uint16_t rd_u16(const unsigned char* p) {
+    uint16_t v;
+    std::memcpy(&v, p, 2);
+    return v;
+}
+
+static uint32_t rd_u32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+bool roaring_chunk_head(const unsigned char* p, RoaringChunk* c) {
+    c->key = rd_u16(p);
+    c->type = rd_u16(p + 2);
+    c->n = rd_u32(p + 4);
+    if (c->n == 0) return false;
+    if (c->type == RC_ARRAY) return c->n <= RC_ARRAY_MAX;
+    if (c->type == RC_BITMAP) return c->n <= 65536;
+    if (c->type == RC_RUN) return c->n <= 32768;
+    return false;
+}
+
+size_t roaring_chunk_encode(uint16_t key, const uint16_t* lows, uint32_t n, unsigned char* out) {
+    uint32_t runs = 1;
+    for (uint32_t i = 1; i < n; ++i) {
+        if (lows[i] != lows[i - 1] + 1) runs++;
+    }
+    size_t run_b = 4ULL * runs, arr_b = 2ULL * n, bmp_b = RC_BITMAP_WORDS * 8;
+    uint16_t type = RC_BITMAP;
+    if (run_b < bmp_b && (n > RC_ARRAY_MAX || run_b < arr_b)) type = RC_RUN;
+    else if (n <= RC_ARRAY_MAX) type = RC_ARRAY;
+
+    uint32_t hn = (type == RC_RUN ? runs : n);
+    std::memcpy(out, &key, 2);
+    std::memcpy(out + 2, &type, 2);
+    std::memcpy(out + 4, &hn, 4);
+    unsigned char* d = out + RC_CHUNK_HEAD;
+    size_t bytes = roaring_data_bytes(type, hn);
+    std::memset(d, 0, bytes);
+
+    if (type == RC_ARRAY) {
+        std::memcpy(d, lows, 2ULL * n);
+    } else if (type == RC_BITMAP) {
+        uint64_t* w = (uint64_t*)d;
+        for (uint32_t i = 0; i < n; ++i) w[lows[i] >> 6] |= 1ULL << (lows[i] & 63);
+    } else {
+        uint32_t i = 0;
+        for (uint32_t r = 0; r < runs; ++r) {
+            uint32_t j = i;
+            while (j + 1 < n && lows[j + 1] == lows[j] + 1) j++;
+            uint16_t start = lows[i], len1 = (uint16_t)(j - i);
+            std::memcpy(d + 4ULL * r, &start, 2);
+            std::memcpy(d + 4ULL * r + 2, &len1, 2);
+            i = j + 1;
+        }
+    }
+    return RC_CHUNK_HEAD + bytes;
+}
+
+uint32_t roaring_chunk_card(const RoaringChunk* c, const unsigned char* data) {
+    if (c->type != RC_RUN) return c->n;
+    uint32_t card = 0;
+    for (uint32_t r = 0; r < c->n; ++r) card += (uint32_t)rd_u16(data + 4ULL * r + 2) + 1;
+    return card;
+}
+
+uint32_t roaring_chunk_decode(const RoaringChunk* c, const unsigned char* data, uint32_t* out) {
+    uint32_t hi = (uint32_t)c->key << 16;
+    uint32_t k = 0;
+    if (c->type == RC_ARRAY) {
+        for (uint32_t i = 0; i < c->n; ++i) out[k++] = hi | rd_u16(data + 2ULL * i);
+    } else if (c->type == RC_BITMAP) {
+        for (uint32_t w = 0; w < RC_BITMAP_WORDS; ++w) {
+            uint64_t bits;
+            std::memcpy(&bits, data + 8ULL * w, 8);
+            while (bits) {
+                out[k++] = hi | (w << 6) | (uint32_t)__builtin_ctzll(bits);
+                bits &= bits - 1;
+            }
+        }
+    } else {
+        for (uint32_t r = 0; r < c->n; ++r) {
+            uint32_t start = rd_u16(data + 4ULL * r), len = (uint32_t)rd_u16(data + 4ULL * r + 2) + 1;
+            for (uint32_t i = 0; i < len; ++i) out[k++] = hi | (start + i);
+        }
+    }
+    return k;
+}
+
+bool roaring_enc_init(RoaringEnc* e) {
+    std::memset(e, 0, sizeof(*e));
+    e->lows = (uint16_t*)std::malloc(65536 * sizeof(uint16_t));
+    e->buf = (unsigned char*)std::malloc(RC_CHUNK_MAX);
+    if (!e->lows || !e->buf) {
+        roaring_enc_free(e);
+        return false;
+    }
+    return true;
+}
+
+void roaring_enc_free(RoaringEnc* e) {
+    std::free(e->lows);
+    std::free(e->buf);
+    std::memset(e, 0, sizeof(*e));
+}
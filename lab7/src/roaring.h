@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Hybrid postings, as in Roaring bitmaps. A term's doc ids are split by their
+// high 16 bits into chunks, in increasing order; each chunk is
+//   u16 key, u16 type, u32 n, then the container zero-padded to 8 bytes:
+//   RC_ARRAY   n sorted u16 low halves (n <= RC_ARRAY_MAX)
+//   RC_BITMAP  RC_BITMAP_WORDS u64 words, bit i set for low half i; n is the
+//              number of ids
+//   RC_RUN     n pairs of u16 (start, length - 1)
+// A chunk takes whichever container is smallest. The dictionary df stays the
+// number of ids, which tells a reader where the term's chunks end; a blob
+// starting on an 8-byte boundary keeps every bitmap 8-byte aligned.
+static const uint16_t RC_ARRAY = 0;
+static const uint16_t RC_BITMAP = 1;
+static const uint16_t RC_RUN = 2;
+static const uint32_t RC_ARRAY_MAX = 4096;
+static const size_t RC_BITMAP_WORDS = 1024;
+static const size_t RC_CHUNK_HEAD = 8;
+// Largest encoded chunk: a header and a bitmap.
+static const size_t RC_CHUNK_MAX = RC_CHUNK_HEAD + RC_BITMAP_WORDS * 8;
+
+struct RoaringChunk {
+    uint16_t key;
+    uint16_t type;
+    uint32_t n;
+};
+
+inline size_t roaring_data_bytes(uint16_t type, uint32_t n) {
+    size_t b = (type == RC_BITMAP ? RC_BITMAP_WORDS * 8 : (type == RC_RUN ? 4ULL * n : 2ULL * n));
+    return (b + 7) & ~(size_t)7;
+}
+
+// Parses and checks a chunk header; false if it is malformed.
+bool roaring_chunk_head(const unsigned char* p, RoaringChunk* c);
+
+// Encodes one chunk (lows sorted and distinct, 1 <= n <= 65536) into out,
+// which must hold RC_CHUNK_MAX bytes; returns the bytes written.
+size_t roaring_chunk_encode(uint16_t key, const uint16_t* lows, uint32_t n, unsigned char* out);
+
+// Number of ids in a chunk.
+uint32_t roaring_chunk_card(const RoaringChunk* c, const unsigned char* data);
+
+// Expands a chunk's ids (key in the high half) into out, which must hold
+// roaring_chunk_card ids; returns their number.
+uint32_t roaring_chunk_decode(const RoaringChunk* c, const unsigned char* data, uint32_t* out);
+
+// Streams a sorted id list in, chunk by chunk: out(bytes, n) gets every
+// encoded chunk as soon as the next key starts or on finish.
+struct RoaringEnc {
+    uint16_t* lows;
+    unsigned char* buf;
+    uint32_t n;
+    uint32_t key;
+    uint64_t bytes;
+};
+
+bool roaring_enc_init(RoaringEnc* e);
+void roaring_enc_free(RoaringEnc* e);
+
+template <typename Out>
+inline void roaring_enc_flush(RoaringEnc* e, Out out) {
+    if (e->n == 0) return;
+    size_t b = roaring_chunk_encode((uint16_t)e->key, e->lows, e->n, e->buf);
+    e->bytes += b;
+    e->n = 0;
+    out(e->buf, b);
+}
+
+template <typename Out>
+inline void roaring_enc_add(RoaringEnc* e, const uint32_t* ids, size_t n, Out out) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t key = ids[i] >> 16;
+        if (key != e->key) {
+            roaring_enc_flush(e, out);
+            e->key = key;
+        }
+        e->lows[e->n++] = (uint16_t)ids[i];
+    }
+}
@@ -1,10 +1,18 @@
 #include "utf8.h"
 #include "stem_ru.h"
+#include "segments.h"
+#include "rlist.h"
+#include <cinttypes>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 static void die(const char* msg) {
     std::fprintf(stderr, "ERROR: %s\n", msg);
@@ -17,7 +25,7 @@ static void* xmalloc(size_t n) {
     return p;
 }
 static void* xrealloc(void* p, size_t n) {
-    void* q = std::realloc(p, n);
+    void* q = std::realloc(p, n ? n : 1);
     if (!q) die("OOM");
     return q;
 }
@@ -64,6 +72,8 @@ struct IndexView {
     uint64_t postings_bytes;
     uint64_t docs_offset;
     uint64_t docs_bytes;
+    uint32_t doc_base;
+    uint32_t stem;
 
     uint64_t* dict_term_off;
 
@@ -72,6 +82,13 @@ struct IndexView {
     const unsigned char* docs_offs_ptr;
 };
 
+// Header flags. SEGMENT: doc ids run from doc_base + 1, doc_base being the
+// u64 at 88. ROARING: postings are hybrid containers (see roaring.h). STEM:
+// the indexer stemmed every doc with the StemMode in the u32 at 96.
+static const uint32_t IDX_FLAG_SEGMENT = 0x10;
+static const uint32_t IDX_FLAG_ROARING = 0x20;
+static const uint32_t IDX_FLAG_STEM = 0x40;
+
 static bool load_index(const char* path, IndexView* iv) {
     unsigned char* buf = nullptr;
     size_t n = 0;
@@ -93,6 +110,9 @@ static bool load_index(const char* path, IndexView* iv) {
     iv->postings_bytes  = rd_u64(buf + 56);
     iv->docs_offset     = rd_u64(buf + 64);
     iv->docs_bytes      = rd_u64(buf + 72);
+    iv->doc_base = (iv->flags & IDX_FLAG_SEGMENT) ? (uint32_t)rd_u64(buf + 88) : 0;
+    iv->stem = (iv->flags & IDX_FLAG_STEM) ? rd_u32(buf + 96) : 0;
+    if (iv->stem > STEM_SNOWBALL) return false;
 
     if (iv->dict_offset + iv->dict_bytes > (uint64_t)n) return false;
     if (iv->postings_offset + iv->postings_bytes > (uint64_t)n) return false;
@@ -221,7 +241,7 @@ static bool is_space(unsigned char c) {
     return c == ' ' || c == '\t' || c == '\r' || c == '\n';
 }
 
-static bool read_term(const unsigned char* q, size_t n, size_t* i, unsigned char** out_s, uint32_t* out_len) {
+static bool read_term(const unsigned char* q, size_t n, size_t* i, StemMode stem, unsigned char** out_s, uint32_t* out_len) {
     size_t pos = *i;
 
     size_t cap = 64;
@@ -257,7 +277,7 @@ static bool read_term(const unsigned char* q, size_t n, size_t* i, unsigned char
     }
 
     size_t L = len;
-    stem_ru_utf8(tok, &L);
+    stem_apply(stem, tok, &L);
     len = L;
 
     unsigned char* out = (unsigned char*)xmalloc(len);
@@ -270,7 +290,7 @@ static bool read_term(const unsigned char* q, size_t n, size_t* i, unsigned char
     return true;
 }
 
-static void tokenize_query(const unsigned char* q, size_t n, TokArr* out) {
+static void tokenize_query(const unsigned char* q, size_t n, StemMode stem, TokArr* out) {
     ta_init(out);
     size_t i = 0;
 
@@ -317,7 +337,7 @@ static void tokenize_query(const unsigned char* q, size_t n, TokArr* out) {
         unsigned char* s = nullptr;
         uint32_t L = 0;
         size_t save = i;
-        if (!read_term(q, n, &i, &s, &L)) {
+        if (!read_term(q, n, &i, stem, &s, &L)) {
             i = save + 1;
             continue;
         }
@@ -516,6 +536,339 @@ static List eval_rpn(const IndexView* iv, const TokArr* rpn, const List& ALL) {
     return out;
 }
 
+static RList rlist_from_term(const IndexView* iv, const unsigned char* term, uint32_t len) {
+    uint64_t off = 0;
+    uint32_t df = 0;
+    RList l{nullptr, 0, 0};
+    if (!dict_find(iv, term, len, &off, &df) || df == 0) return l;
+    const unsigned char* p = iv->base + iv->postings_offset + off;
+    const unsigned char* end = iv->base + iv->postings_offset + iv->postings_bytes;
+    if (iv->postings_offset + off > iv->postings_offset + iv->postings_bytes || !rl_from_blob(p, end, df, &l)) {
+        return RList{nullptr, 0, 0};
+    }
+    return l;
+}
+
+// eval_rpn over an index with hybrid postings: the lists stay containers
+// until the end.
+static RList eval_rpn_hybrid(const IndexView* iv, const TokArr* rpn, const RList& ALL) {
+    RList* st = (RList*)xmalloc((rpn->n + 1) * sizeof(RList));
+    size_t n = 0;
+    bool bad = false;
+
+    for (size_t i = 0; i < rpn->n && !bad; ++i) {
+        Tok tk = rpn->a[i];
+        if (tk.t == T_END) break;
+
+        if (tk.t == T_TERM) {
+            st[n++] = rlist_from_term(iv, tk.s, tk.len);
+        } else if (tk.t == T_NOT) {
+            if (n < 1) { bad = true; break; }
+            RList R = rl_andnot(ALL, st[n - 1]);
+            rl_free(&st[n - 1]);
+            st[n - 1] = R;
+        } else if (tk.t == T_AND || tk.t == T_OR) {
+            if (n < 2) { bad = true; break; }
+            RList R = (tk.t == T_AND) ? rl_and(st[n - 2], st[n - 1]) : rl_or(st[n - 2], st[n - 1]);
+            rl_free(&st[n - 2]);
+            rl_free(&st[n - 1]);
+            st[n - 2] = R;
+            n--;
+        }
+    }
+
+    RList out{nullptr, 0, 0};
+    if (!bad && n == 1) out = st[--n];
+    for (size_t i = 0; i < n; ++i) rl_free(&st[i]);
+    std::free(st);
+    return out;
+}
+
+// What queries run over: one or more index.bin shards, or the live segments
+// of a segment set (see segments.h), in doc-id order. A shard's local doc id
+// d is d + offset globally; shards given as files are numbered one after
+// another, segments already carry global ids (offset 0). A set is reloaded
+// whenever its manifest version changes; segments already loaded are kept.
+struct SegView {
+    char name[SEG_NAME_MAX];
+    IndexView iv;
+    uint32_t offset;
+    List all;
+    RList rall;
+};
+
+struct IndexSet {
+    const char* dir;
+    uint64_t version;
+    SegView* segs;
+    size_t n;
+    Tombstones del;
+};
+
+// Doc ids of the view that are not deleted, as containers too when its
+// postings are.
+static void live_docs(SegView* v, const Tombstones* del) {
+    const IndexView* iv = &v->iv;
+    List all;
+    all.a = (uint32_t*)xmalloc((size_t)iv->docs_count * sizeof(uint32_t) + 1);
+    all.n = 0;
+    for (uint32_t i = 1; i <= (uint32_t)iv->docs_count; ++i) {
+        uint32_t id = iv->doc_base + i;
+        if (!tombstones_has(del, id)) all.a[all.n++] = id;
+    }
+    v->all = all;
+    if (iv->flags & IDX_FLAG_ROARING) v->rall = rl_from_ids(all.a, all.n);
+}
+
+static void free_view(SegView* v) {
+    free_index(&v->iv);
+    list_free(&v->all);
+    rl_free(&v->rall);
+}
+
+// Adds the stemmer iv was built with, if it recorded one; false if it
+// differs from one seen before.
+static bool stem_add(const IndexView* iv, StemMode* stem, bool* known) {
+    if (!(iv->flags & IDX_FLAG_STEM)) return true;
+    if (*known && (uint32_t)*stem != iv->stem) return false;
+    *stem = (StemMode)iv->stem;
+    *known = true;
+    return true;
+}
+
+// The stemmer the loaded indexes were built with, if they recorded it; false
+// if two of them recorded different ones.
+static bool set_stem(const IndexSet* s, StemMode* stem, bool* known) {
+    *known = false;
+    for (size_t i = 0; i < s->n; ++i) {
+        if (!stem_add(&s->segs[i].iv, stem, known)) return false;
+    }
+    return true;
+}
+
+static bool set_open_files(IndexSet* s, const char* const* paths, size_t n) {
+    std::memset(s, 0, sizeof(*s));
+    s->segs = (SegView*)xmalloc(n * sizeof(SegView));
+    std::memset(s->segs, 0, n * sizeof(SegView));
+    uint64_t end = 0;
+    for (size_t i = 0; i < n; ++i) {
+        SegView* v = &s->segs[i];
+        if (!load_index(paths[i], &v->iv)) return false;
+        s->n = i + 1;
+        v->offset = (uint32_t)(end - v->iv.doc_base);
+        live_docs(v, &s->del);
+        end += v->iv.docs_count;
+        if (end > 0xFFFFFFFFULL) return false;
+    }
+    return true;
+}
+
+// Returns false if the set cannot be read, or if its segments recorded
+// different stemmers or one other than --stem; the old view stays then.
+// Otherwise *stem becomes the recorded stemmer, if there is one.
+static bool set_refresh(IndexSet* s, StemMode* stem, bool stem_given) {
+    SegManifest m;
+    if (!manifest_load(s->dir, &m)) return false;
+    if (s->segs && m.version == s->version) {
+        manifest_free(&m);
+        return true;
+    }
+    Tombstones del;
+    if (!tombstones_load(s->dir, &del)) {
+        manifest_free(&m);
+        return false;
+    }
+
+    // from[i]: the loaded segment that segs[i] of the new manifest reuses.
+    SegView* ns = (SegView*)xmalloc((m.n + 1) * sizeof(SegView));
+    size_t* from = (size_t*)xmalloc((m.n + 1) * sizeof(size_t));
+    std::memset(ns, 0, (m.n + 1) * sizeof(SegView));
+    bool ok = true;
+    for (size_t i = 0; ok && i < m.n; ++i) {
+        std::memcpy(ns[i].name, m.segs[i].name, SEG_NAME_MAX);
+        from[i] = 0;
+        while (from[i] < s->n && std::strcmp(s->segs[from[i]].name, ns[i].name) != 0) from[i]++;
+        if (from[i] == s->n) {
+            char p[1024];
+            seg_path(p, sizeof(p), s->dir, ns[i].name);
+            ok = load_index(p, &ns[i].iv);
+        }
+    }
+    StemMode built = *stem;
+    bool known = false;
+    for (size_t i = 0; ok && i < m.n; ++i) {
+        const IndexView* iv = (from[i] == s->n ? &ns[i].iv : &s->segs[from[i]].iv);
+        if (!stem_add(iv, &built, &known)) {
+            std::fprintf(stderr, "[index] segments were built with different stemmers\n");
+            ok = false;
+        }
+    }
+    if (ok && known && stem_given && built != *stem) {
+        std::fprintf(stderr, "[index] --stem does not match the stemmer the segments were built with\n");
+        ok = false;
+    }
+    if (!ok) {
+        for (size_t i = 0; i < m.n; ++i) free_index(&ns[i].iv);
+        std::free(ns);
+        std::free(from);
+        tombstones_free(&del);
+        manifest_free(&m);
+        return false;
+    }
+    for (size_t i = 0; i < m.n; ++i) {
+        if (from[i] == s->n) continue;
+        ns[i].iv = s->segs[from[i]].iv;
+        std::memset(&s->segs[from[i]].iv, 0, sizeof(IndexView));
+    }
+    std::free(from);
+
+    for (size_t j = 0; j < s->n; ++j) free_view(&s->segs[j]);
+    std::free(s->segs);
+    tombstones_free(&s->del);
+    s->segs = ns;
+    s->n = m.n;
+    s->del = del;
+    s->version = m.version;
+    uint64_t docs = 0;
+    for (size_t i = 0; i < s->n; ++i) {
+        live_docs(&s->segs[i], &s->del);
+        docs += s->segs[i].all.n;
+    }
+    std::fprintf(stderr, "[index] segments=%" PRIu64 " live_docs=%" PRIu64 " version=%" PRIu64 "\n",
+        (uint64_t)s->n, (uint64_t)docs, (uint64_t)s->version);
+    if (known) {
+        *stem = built;
+        std::fprintf(stderr, "[index] stem=%s\n", stem_mode_name(built));
+    }
+    manifest_free(&m);
+    return true;
+}
+
+static void set_free(IndexSet* s) {
+    for (size_t i = 0; i < s->n; ++i) free_view(&s->segs[i]);
+    std::free(s->segs);
+    tombstones_free(&s->del);
+    std::memset(s, 0, sizeof(*s));
+}
+
+// Evaluates a query on every shard of a set at once. The caller's thread
+// takes shards too, so a pool of n threads runs n + 1 shards side by side.
+struct ShardPool {
+    std::vector<std::thread> th;
+
+    std::mutex mu;
+    std::condition_variable go;
+    std::condition_variable done;
+    uint64_t gen;
+    size_t busy;
+    bool stopping;
+
+    const IndexSet* set;
+    const TokArr* rpn;
+    List* out;
+    std::atomic<size_t> next;
+};
+
+static void pool_take(ShardPool* p) {
+    for (;;) {
+        size_t i = p->next.fetch_add(1);
+        if (i >= p->set->n) return;
+        const SegView* v = &p->set->segs[i];
+        if (!(v->iv.flags & IDX_FLAG_ROARING)) {
+            p->out[i] = eval_rpn(&v->iv, p->rpn, v->all);
+            continue;
+        }
+        RList r = eval_rpn_hybrid(&v->iv, p->rpn, v->rall);
+        List ids{(uint32_t*)xmalloc((size_t)r.card * sizeof(uint32_t) + 1), r.card};
+        rl_to_ids(&r, ids.a);
+        rl_free(&r);
+        p->out[i] = ids;
+    }
+}
+
+static void pool_main(ShardPool* p) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lk(p->mu);
+    for (;;) {
+        p->go.wait(lk, [&] { return p->stopping || p->gen != seen; });
+        if (p->stopping) return;
+        seen = p->gen;
+        lk.unlock();
+        pool_take(p);
+        lk.lock();
+        if (--p->busy == 0) p->done.notify_all();
+    }
+}
+
+static void pool_start(ShardPool* p, size_t n) {
+    p->gen = 0;
+    p->busy = 0;
+    p->stopping = false;
+    for (size_t i = 0; i < n; ++i) p->th.emplace_back(pool_main, p);
+}
+
+static void pool_stop(ShardPool* p) {
+    {
+        std::lock_guard<std::mutex> lk(p->mu);
+        p->stopping = true;
+    }
+    p->go.notify_all();
+    for (auto& t : p->th) t.join();
+    p->th.clear();
+}
+
+static void pool_eval(ShardPool* p, const IndexSet* s, const TokArr* rpn, List* out) {
+    p->set = s;
+    p->rpn = rpn;
+    p->out = out;
+    p->next = 0;
+    if (p->th.empty() || s->n < 2) {
+        pool_take(p);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(p->mu);
+        p->busy = p->th.size();
+        p->gen++;
+    }
+    p->go.notify_all();
+    pool_take(p);
+    std::unique_lock<std::mutex> lk(p->mu);
+    p->done.wait(lk, [p] { return p->busy == 0; });
+}
+
+// Shards hold disjoint, increasing global doc-id ranges, so their results
+// concatenate in order once moved by the shard's offset; total is the sum.
+// Deleted docs are dropped here.
+static List eval_set(const IndexSet* s, ShardPool* pool, const TokArr* rpn) {
+    List* rs = (List*)xmalloc((s->n ? s->n : 1) * sizeof(List));
+    pool_eval(pool, s, rpn, rs);
+
+    size_t total = 0;
+    for (size_t i = 0; i < s->n; ++i) total += rs[i].n;
+    List out{nullptr, 0};
+    out.a = (uint32_t*)xmalloc((total ? total : 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < s->n; ++i) {
+        uint32_t off = s->segs[i].offset;
+        for (uint32_t k = 0; k < rs[i].n; ++k) {
+            if (!tombstones_has(&s->del, rs[i].a[k])) out.a[out.n++] = rs[i].a[k] + off;
+        }
+        list_free(&rs[i]);
+    }
+    std::free(rs);
+    return out;
+}
+
+static const SegView* set_view_of(const IndexSet* s, uint32_t doc_id) {
+    size_t lo = 0, hi = s->n;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (s->segs[mid].offset + s->segs[mid].iv.doc_base < doc_id) lo = mid;
+        else hi = mid;
+    }
+    return (s->n ? &s->segs[lo] : nullptr);
+}
+
 static const char* base_url_by_source(uint32_t source_id) {
     if (source_id == 1) return "https://ru.wikipedia.org/?curid=";
     if (source_id == 2) return "https://ru.wikisource.org/?curid=";
@@ -525,8 +878,8 @@ static const char* base_url_by_source(uint32_t source_id) {
 static bool get_doc_meta_v2(const IndexView* iv, uint32_t doc_id,
                             uint32_t* out_source_id, uint32_t* out_page_id,
                             const unsigned char** out_title, uint32_t* out_title_len) {
-    if (doc_id == 0 || doc_id > (uint32_t)iv->docs_count) return false;
-    const unsigned char* offs_p = iv->docs_offs_ptr + 8ULL * (uint64_t)(doc_id - 1);
+    if (doc_id <= iv->doc_base || doc_id - iv->doc_base > (uint32_t)iv->docs_count) return false;
+    const unsigned char* offs_p = iv->docs_offs_ptr + 8ULL * (uint64_t)(doc_id - iv->doc_base - 1);
     uint64_t rel = rd_u64(offs_p);
     const unsigned char* rec = iv->docs_records_ptr + rel;
 
@@ -562,7 +915,7 @@ static bool get_doc_meta_v1(const IndexView* iv, uint32_t doc_id,
     return true;
 }
 
-static void print_results(const IndexView* iv, const List& res, uint32_t limit, uint32_t offset) {
+static void print_results(const IndexSet* set, const List& res, uint32_t limit, uint32_t offset) {
     uint32_t total = res.n;
     std::printf("OK\ttotal=%u\toffset=%u\tlimit=%u\n", total, offset, limit);
 
@@ -571,6 +924,10 @@ static void print_results(const IndexView* iv, const List& res, uint32_t limit,
 
     for (uint32_t i = offset; i < end; ++i) {
         uint32_t doc_id = res.a[i];
+        const SegView* v = set_view_of(set, doc_id);
+        if (!v) continue;
+        const IndexView* iv = &v->iv;
+        uint32_t local_id = doc_id - v->offset;
 
         uint32_t source_id = 1;
         uint32_t page_id = 0;
@@ -578,9 +935,9 @@ static void print_results(const IndexView* iv, const List& res, uint32_t limit,
         uint32_t tl = 0;
 
         if (iv->version >= 2) {
-            if (!get_doc_meta_v2(iv, doc_id, &source_id, &page_id, &title, &tl)) continue;
+            if (!get_doc_meta_v2(iv, local_id, &source_id, &page_id, &title, &tl)) continue;
         } else {
-            if (!get_doc_meta_v1(iv, doc_id, &page_id, &title, &tl)) continue;
+            if (!get_doc_meta_v1(iv, local_id, &page_id, &title, &tl)) continue;
             source_id = 1;
         }
 
@@ -613,30 +970,122 @@ static bool read_line(FILE* f, unsigned char** out, size_t* out_n) {
     return true;
 }
 
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// Runs every query of fin reps times without printing results and reports
+// each query's best time, so two index layouts can be compared on one log.
+static void run_bench(IndexSet* set, ShardPool* pool, FILE* fin, StemMode stem, int reps) {
+    unsigned char** qs = nullptr;
+    size_t* qn = nullptr;
+    size_t n = 0, cap = 0;
+    unsigned char* line = nullptr;
+    size_t ln = 0;
+    while (read_line(fin, &line, &ln)) {
+        bool any = false;
+        for (size_t k = 0; k < ln; ++k) if (!is_space(line[k])) { any = true; break; }
+        if (!any) { std::free(line); continue; }
+        if (n == cap) {
+            cap = (cap ? cap * 2 : 256);
+            qs = (unsigned char**)xrealloc(qs, cap * sizeof(unsigned char*));
+            qn = (size_t*)xrealloc(qn, cap * sizeof(size_t));
+        }
+        qs[n] = line;
+        qn[n++] = ln;
+    }
+
+    double* best = (double*)xmalloc((n ? n : 1) * sizeof(double));
+    uint64_t results = 0;
+    for (int r = 0; r < reps; ++r) {
+        results = 0;
+        for (size_t i = 0; i < n; ++i) {
+            TokArr toks, rpn;
+            auto t0 = std::chrono::steady_clock::now();
+            tokenize_query(qs[i], qn[i], stem, &toks);
+            to_rpn(&toks, &rpn);
+            List res = eval_set(set, pool, &rpn);
+            auto t1 = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            if (r == 0 || ms < best[i]) best[i] = ms;
+            results += res.n;
+            list_free(&res);
+            ta_free(&toks);
+            ta_free(&rpn);
+        }
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) sum += best[i];
+    std::qsort(best, n, sizeof(double), cmp_double);
+    uint64_t postings = 0;
+    for (size_t i = 0; i < set->n; ++i) postings += set->segs[i].iv.postings_bytes;
+    std::printf("queries=%" PRIu64 " reps=%d results=%" PRIu64 " postings_bytes=%" PRIu64 "\n",
+        (uint64_t)n, reps, (uint64_t)results, (uint64_t)postings);
+    if (n > 0) {
+        std::printf("best per query: total=%.3f ms avg=%.4f ms p50=%.4f ms p99=%.4f ms max=%.4f ms\n",
+            sum, sum / (double)n, best[n / 2], best[(n * 99) / 100], best[n - 1]);
+    }
+    for (size_t i = 0; i < n; ++i) std::free(qs[i]);
+    std::free(qs);
+    std::free(qn);
+    std::free(best);
+}
+
 static void usage() {
     std::fprintf(stderr,
         "Usage:\n"
-        "  search.exe <index.bin> [--offset N] [--limit N] [--in queries.txt]\n"
+        "  search.exe <index.bin... | segment_dir> [--offset N] [--limit N] [--in queries.txt] [--stem=none|simple|snowball] [--threads=N] [--bench=N]\n"
+        "  Queries are stemmed like the index when it records its stemmer (indexer.exe --add-raw);\n"
+        "    a different --stem is refused. Otherwise --stem applies (default: simple).\n"
+        "  Several index.bin shards are searched together: the docs of each shard are numbered\n"
+        "  after those of the shards before it.\n"
+        "  A segment_dir (indexer.exe --into) is searched across its live segments and re-read\n"
+        "  before each query once its manifest changes.\n"
+        "  --threads=N evaluates up to N shards or segments of a query at once\n"
+        "    (default: hardware threads, up to 8).\n"
+        "  --bench=N runs the queries N times without printing results and reports the best\n"
+        "    time of each: total, average and percentiles.\n"
     );
 }
 
 int main(int argc, char** argv) {
     if (argc < 2) { usage(); return 2; }
 
-    const char* index_path = argv[1];
+    const char** index_paths = (const char**)xmalloc((size_t)argc * sizeof(char*));
+    size_t index_n = 0;
     uint32_t offset = 0;
     uint32_t limit = 50;
     const char* in_path = nullptr;
-
-    for (int i = 2; i < argc; ++i) {
+    int bench = 0;
+    StemMode stem = STEM_SIMPLE;
+    bool stem_given = false;
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    if (threads > 8) threads = 8;
+
+    for (int i = 1; i < argc; ++i) {
         if (std::strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
             offset = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
         } else if (std::strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
             limit = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
         } else if (std::strcmp(argv[i], "--in") == 0 && i + 1 < argc) {
             in_path = argv[++i];
+        } else if (std::strncmp(argv[i], "--stem=", 7) == 0) {
+            if (!parse_stem_mode(argv[i] + 7, &stem)) die("bad --stem mode");
+            stem_given = true;
+        } else if (std::strncmp(argv[i], "--bench=", 8) == 0) {
+            bench = std::atoi(argv[i] + 8);
+            if (bench < 1) bench = 1;
+        } else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = (unsigned)std::strtoul(argv[i] + 10, nullptr, 10);
+            if (threads == 0) threads = 1;
+        } else if (argv[i][0] != '-') {
+            index_paths[index_n++] = argv[i];
         }
     }
+    if (index_n == 0) { usage(); return 2; }
 
     FILE* fin = stdin;
     if (in_path) {
@@ -644,18 +1093,44 @@ int main(int argc, char** argv) {
         if (!fin) die("cannot open --in file");
     }
 
-    IndexView iv{};
-    if (!load_index(index_path, &iv)) die("load_index failed");
+    IndexSet set;
+    if (index_n == 1 && seg_set_exists(index_paths[0])) {
+        std::memset(&set, 0, sizeof(set));
+        set.dir = index_paths[0];
+        if (!set_refresh(&set, &stem, stem_given)) die("cannot load segment set");
+    } else {
+        if (!set_open_files(&set, index_paths, index_n)) die("load_index failed");
+        for (size_t i = 0; i < set.n; ++i) {
+            const IndexView& iv = set.segs[i].iv;
+            if (set.n > 1) std::fprintf(stderr, "[index] shard=%s offset=%u ", index_paths[i], set.segs[i].offset);
+            else std::fprintf(stderr, "[index] ");
+            std::fprintf(stderr, "version=%u docs=%" PRIu64 " terms=%" PRIu64 "\n",
+                iv.version,
+                (uint64_t)iv.docs_count,
+                (uint64_t)iv.terms_count);
+        }
+
+        StemMode built;
+        bool known;
+        if (!set_stem(&set, &built, &known)) die("index files were built with different stemmers");
+        if (known) {
+            if (stem_given && stem != built) die("--stem does not match the stemmer the index was built with");
+            stem = built;
+            std::fprintf(stderr, "[index] stem=%s\n", stem_mode_name(stem));
+        }
+    }
 
-    std::fprintf(stderr, "[index] version=%u docs=%I64u terms=%I64u\n",
-        iv.version,
-        (unsigned long long)iv.docs_count,
-        (unsigned long long)iv.terms_count);
+    ShardPool pool;
+    pool_start(&pool, threads - 1);
 
-    List ALL;
-    ALL.n = (uint32_t)iv.docs_count;
-    ALL.a = (uint32_t*)xmalloc((size_t)ALL.n * sizeof(uint32_t));
-    for (uint32_t i = 0; i < ALL.n; ++i) ALL.a[i] = i + 1;
+    if (bench > 0) {
+        run_bench(&set, &pool, fin, stem, bench);
+        if (fin != stdin) std::fclose(fin);
+        pool_stop(&pool);
+        set_free(&set);
+        std::free(index_paths);
+        return 0;
+    }
 
     unsigned char* line = nullptr;
     size_t ln = 0;
@@ -665,16 +1140,19 @@ int main(int argc, char** argv) {
         for (size_t k = 0; k < ln; ++k) if (!is_space(line[k])) { any = true; break; }
         if (!any) { std::free(line); continue; }
 
+        if (set.dir && !set_refresh(&set, &stem, stem_given)) std::fprintf(stderr, "[index] reload failed, keeping version %" PRIu64 "\n",
+                                                        (uint64_t)set.version);
+
         TokArr toks, rpn;
         auto t0 = std::chrono::high_resolution_clock::now();
-        tokenize_query(line, ln, &toks);
+        tokenize_query(line, ln, stem, &toks);
         to_rpn(&toks, &rpn);
-        List res = eval_rpn(&iv, &rpn, ALL);
+        List res = eval_set(&set, &pool, &rpn);
         auto t1 = std::chrono::high_resolution_clock::now();
         auto ms = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0;
         std::fprintf(stderr, "[time] %.3f ms\n", ms);
 
-        print_results(&iv, res, limit, offset);
+        print_results(&set, res, limit, offset);
 
         list_free(&res);
         ta_free(&toks);
@@ -685,7 +1163,8 @@ int main(int argc, char** argv) {
     }
 
     if (fin != stdin) std::fclose(fin);
-    list_free(&ALL);
-    free_index(&iv);
+    pool_stop(&pool);
+    set_free(&set);
+    std::free(index_paths);
     return 0;
 }
@@ -0,0 +1,238 @@
+#include "segments.h"
+#include "paths.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+void seg_path(char* out, size_t out_sz, const char* dir, const char* name) {
+    join_path(out, out_sz, dir, name);
+}
+
+bool seg_set_exists(const char* dir) {
+    char p[1024];
+    seg_path(p, sizeof(p), dir, SEG_MANIFEST_NAME);
+    FILE* f = std::fopen(p, "rb");
+    if (!f) return false;
+    std::fclose(f);
+    return true;
+}
+
+static bool replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from, to) == 0;
+#endif
+}
+
+bool manifest_push(SegManifest* m, const char* name, uint32_t doc_base, uint32_t docs, uint32_t dropped) {
+    if (std::strlen(name) >= SEG_NAME_MAX) return false;
+    if (m->n == m->cap) {
+        size_t nc = (m->cap ? m->cap * 2 : 16);
+        SegInfo* ns = (SegInfo*)std::realloc(m->segs, nc * sizeof(SegInfo));
+        if (!ns) return false;
+        m->segs = ns;
+        m->cap = nc;
+    }
+    SegInfo* s = &m->segs[m->n++];
+    std::memset(s, 0, sizeof(*s));
+    std::memcpy(s->name, name, std::strlen(name));
+    s->doc_base = doc_base;
+    s->docs = docs;
+    s->dropped = dropped;
+    return true;
+}
+
+void manifest_free(SegManifest* m) {
+    std::free(m->segs);
+    std::memset(m, 0, sizeof(*m));
+}
+
+bool manifest_load(const char* dir, SegManifest* m) {
+    std::memset(m, 0, sizeof(*m));
+    char p[1024];
+    seg_path(p, sizeof(p), dir, SEG_MANIFEST_NAME);
+    FILE* f = std::fopen(p, "rb");
+    if (!f) return true;
+
+    bool ok = true;
+    char line[512];
+    while (ok && std::fgets(line, sizeof(line), f)) {
+        size_t n = std::strlen(line);
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = 0;
+        if (n == 0) continue;
+
+        char* tab = std::strchr(line, '\t');
+        if (!tab) { ok = false; break; }
+        *tab = 0;
+        const char* val = tab + 1;
+        if (std::strcmp(line, "version") == 0) {
+            m->version = std::strtoull(val, nullptr, 10);
+        } else if (std::strcmp(line, "next_gen") == 0) {
+            m->next_gen = (uint32_t)std::strtoul(val, nullptr, 10);
+        } else if (std::strcmp(line, "next_doc") == 0) {
+            m->next_doc = (uint32_t)std::strtoul(val, nullptr, 10);
+        } else if (std::strcmp(line, "seg") == 0) {
+            char* t1 = std::strchr(tab + 1, '\t');
+            char* t2 = (t1 ? std::strchr(t1 + 1, '\t') : nullptr);
+            char* t3 = (t2 ? std::strchr(t2 + 1, '\t') : nullptr);
+            if (!t3) { ok = false; break; }
+            *t1 = 0;
+            ok = manifest_push(m, val, (uint32_t)std::strtoul(t1 + 1, nullptr, 10),
+                               (uint32_t)std::strtoul(t2 + 1, nullptr, 10),
+                               (uint32_t)std::strtoul(t3 + 1, nullptr, 10));
+        }
+    }
+    std::fclose(f);
+    if (!ok) manifest_free(m);
+    return ok;
+}
+
+bool manifest_save(const char* dir, const SegManifest* m) {
+    char p[1024], tmp[1040];
+    seg_path(p, sizeof(p), dir, SEG_MANIFEST_NAME);
+    std::snprintf(tmp, sizeof(tmp), "%s.tmp", p);
+    FILE* f = std::fopen(tmp, "wb");
+    if (!f) return false;
+    std::fprintf(f, "version\t%llu\nnext_gen\t%u\nnext_doc\t%u\n",
+                 (unsigned long long)m->version, m->next_gen, m->next_doc);
+    for (size_t i = 0; i < m->n; ++i) {
+        const SegInfo* s = &m->segs[i];
+        std::fprintf(f, "seg\t%s\t%u\t%u\t%u\n", s->name, s->doc_base, s->docs, s->dropped);
+    }
+    bool ok = !std::ferror(f);
+    if (std::fclose(f) != 0) ok = false;
+    return ok && replace_file(tmp, p);
+}
+
+bool tombstones_load(const char* dir, Tombstones* t) {
+    std::memset(t, 0, sizeof(*t));
+    char p[1024];
+    seg_path(p, sizeof(p), dir, SEG_TOMBSTONES_NAME);
+    FILE* f = std::fopen(p, "rb");
+    if (!f) return true;
+
+    bool ok = true;
+    size_t cap = 0;
+    uint64_t buf[512];
+    for (;;) {
+        size_t rd = std::fread(buf, 8, 512, f);
+        if (rd == 0) break;
+        if (t->n + rd > cap) {
+            size_t nc = (cap ? cap * 2 : 1024);
+            while (nc < t->n + rd) nc *= 2;
+            uint64_t* nw = (uint64_t*)std::realloc(t->words, nc * 8);
+            if (!nw) { ok = false; break; }
+            t->words = nw;
+            cap = nc;
+        }
+        std::memcpy(t->words + t->n, buf, rd * 8);
+        t->n += rd;
+    }
+    if (std::ferror(f)) ok = false;
+    std::fclose(f);
+    if (!ok) tombstones_free(t);
+    return ok;
+}
+
+bool tombstones_save(const char* dir, const Tombstones* t) {
+    char p[1024], tmp[1040];
+    seg_path(p, sizeof(p), dir, SEG_TOMBSTONES_NAME);
+    std::snprintf(tmp, sizeof(tmp), "%s.tmp", p);
+    FILE* f = std::fopen(tmp, "wb");
+    if (!f) return false;
+    bool ok = (t->n == 0 || std::fwrite(t->words, 8, t->n, f) == t->n);
+    if (std::fclose(f) != 0) ok = false;
+    return ok && replace_file(tmp, p);
+}
+
+bool tombstones_set(Tombstones* t, uint32_t doc_id) {
+    size_t w = doc_id >> 6;
+    if (w >= t->n) {
+        size_t nn = w + 1;
+        uint64_t* nw = (uint64_t*)std::realloc(t->words, nn * 8);
+        if (!nw) return false;
+        std::memset(nw + t->n, 0, (nn - t->n) * 8);
+        t->words = nw;
+        t->n = nn;
+    }
+    t->words[w] |= 1ULL << (doc_id & 63);
+    return true;
+}
+
+uint32_t tombstones_count(const Tombstones* t, uint32_t lo, uint32_t hi) {
+    uint32_t c = 0;
+    for (uint32_t id = lo; id < hi; ) {
+        size_t w = id >> 6;
+        if (w >= t->n) break;
+        uint64_t bits = t->words[w] >> (id & 63);
+        uint32_t span = 64 - (id & 63);
+        if (hi - id < span) {
+            span = hi - id;
+            bits &= (1ULL << span) - 1;
+        }
+        c += (uint32_t)__builtin_popcountll(bits);
+        id += span;
+    }
+    return c;
+}
+
+void tombstones_free(Tombstones* t) {
+    std::free(t->words);
+    std::memset(t, 0, sizeof(*t));
+}
+
+#ifdef _WIN32
+
+bool seg_lock(const char* dir, SegLock* l) {
+    char p[1024];
+    seg_path(p, sizeof(p), dir, SEG_LOCK_NAME);
+    for (;;) {
+        HANDLE h = CreateFileA(p, GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h != INVALID_HANDLE_VALUE) {
+            l->handle = h;
+            l->fd = -1;
+            return true;
+        }
+        if (GetLastError() != ERROR_SHARING_VIOLATION) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+void seg_unlock(SegLock* l) {
+    if (l->handle) CloseHandle((HANDLE)l->handle);
+    l->handle = nullptr;
+}
+
+#else
+
+bool seg_lock(const char* dir, SegLock* l) {
+    char p[1024];
+    seg_path(p, sizeof(p), dir, SEG_LOCK_NAME);
+    int fd = open(p, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+    l->handle = nullptr;
+    l->fd = fd;
+    return true;
+}
+
+void seg_unlock(SegLock* l) {
+    if (l->fd >= 0) close(l->fd);
+    l->fd = -1;
+}
+
+#endif
@@ -1,4 +1,15 @@
 #pragma once
 #include <cstddef>
 
+enum StemMode {
+    STEM_NONE = 0,
+    STEM_SIMPLE,
+    STEM_SNOWBALL
+};
+
 void stem_ru_utf8(unsigned char* tok, size_t* len);
+void stem_ru_snowball_utf8(unsigned char* tok, size_t* len);
+
+void stem_apply(StemMode mode, unsigned char* tok, size_t* len);
+bool parse_stem_mode(const char* s, StemMode* out);
+const char* stem_mode_name(StemMode mode);
@@ -5,17 +5,27 @@ from flask import Flask, request
 BASE_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
 SEARCH_EXE = os.path.join(BASE_DIR, "bin", "search.exe")
 INDEX_BIN  = os.path.join(BASE_DIR, "index", "index.bin")
+INDEX_SEGS = os.path.join(BASE_DIR, "index", "segments")
+INDEX_SHARDS = os.path.join(BASE_DIR, "index", "shards")
 
 app = Flask(__name__)
 
 def run_search(query: str, offset: int, limit: int = 50):
     if not os.path.isfile(SEARCH_EXE):
         return 0, [], f"not found: {SEARCH_EXE}"
-    if not os.path.isfile(INDEX_BIN):
+    index_paths = [INDEX_BIN]
+    shards = []
+    if os.path.isdir(INDEX_SHARDS):
+        shards = sorted(os.path.join(INDEX_SHARDS, x) for x in os.listdir(INDEX_SHARDS) if x.endswith(".bin"))
+    if os.path.isfile(os.path.join(INDEX_SEGS, "segments.tsv")):
+        index_paths = [INDEX_SEGS]
+    elif shards:
+        index_paths = shards
+    elif not os.path.isfile(INDEX_BIN):
         return 0, [], f"not found: {INDEX_BIN}"
 
     p = subprocess.run(
-        [SEARCH_EXE, INDEX_BIN, "--offset", str(offset), "--limit", str(limit)],
+        [SEARCH_EXE, *index_paths, "--offset", str(offset), "--limit", str(limit)],
         input=(query.strip() + "\n").encode("utf-8"),
         stdout=subprocess.PIPE,
         stderr=subprocess.PIPE,